@@ -1,2 +1,7 @@
 /usr/local/bin/glslc shaders/simple_shader.vert -o shaders/simple_shader.vert.spv
+/usr/local/bin/glslc shaders/depth_only.vert -o shaders/depth_only.vert.spv
 /usr/local/bin/glslc shaders/simple_shader.frag -o shaders/simple_shader.frag.spv
+/usr/local/bin/glslc shaders/meshlet_cull.comp -o shaders/meshlet_cull.comp.spv
+/usr/local/bin/glslc shaders/frustum_cull.comp -o shaders/frustum_cull.comp.spv
+/usr/local/bin/glslc shaders/frustum_cull_commands.comp -o shaders/frustum_cull_commands.comp.spv
+/usr/local/bin/glslc shaders/frustum_cull_instances.comp -o shaders/frustum_cull_instances.comp.spv
@@ -1,10 +1,15 @@
 #include "first_app.hpp"
+#include "frustum_cull_system.hpp"
+#include "helios_buffer.hpp"
 #include "helios_camera.hpp"
 #include "helios_device.hpp"
+#include "helios_frame_info.hpp"
 #include "helios_game_object.hpp"
 #include "helios_model.hpp"
 #include "helios_pipeline.hpp"
+#include "helios_swap_chain.hpp"
 #include "keyboard_movement_controller.hpp"
+#include "meshlet_cull_system.hpp"
 #include "simple_render_system.hpp"
 
 #define GLM_FORCE_RADIANS
@@ -22,13 +27,68 @@
 
 namespace helios {
 
-FirstApp::FirstApp() { loadGameObjects(); }
+namespace {
+
+// from this many objects on, culling and draw command generation move to
+// the GPU, trading meshlet culling for flat CPU cost
+constexpr size_t GPU_CULLING_OBJECT_COUNT = 4096;
+// from this many draw calls on, they are recorded from several threads into
+// secondary command buffers, below that the hand off costs more than it saves
+constexpr size_t PARALLEL_RECORDING_DRAW_COUNT = 512;
+
+} // namespace
+
+FirstApp::FirstApp() {
+  globalPool =
+      HeliosDescriptorPool::Builder(heliosDevice)
+          .setMaxSets(HeliosSwapChain::MAX_FRAMES_IN_FLIGHT)
+          .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                       HeliosSwapChain::MAX_FRAMES_IN_FLIGHT)
+          .build();
+  loadGameObjects();
+}
 
 FirstApp::~FirstApp() {}
 
 void FirstApp::run() {
+  std::vector<std::unique_ptr<HeliosBuffer>> uboBuffers(
+      HeliosSwapChain::MAX_FRAMES_IN_FLIGHT);
+  for (auto &uboBuffer : uboBuffers) {
+    uboBuffer = std::make_unique<HeliosBuffer>(
+        heliosDevice, sizeof(GlobalUbo), 1, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    uboBuffer->map();
+  }
+
+  auto globalSetLayout =
+      HeliosDescriptorSetLayout::Builder(heliosDevice)
+          .addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                      VK_SHADER_STAGE_ALL_GRAPHICS)
+          .build();
+  std::vector<VkDescriptorSet> globalDescriptorSets(
+      HeliosSwapChain::MAX_FRAMES_IN_FLIGHT);
+  for (size_t i = 0; i < globalDescriptorSets.size(); i++) {
+    auto bufferInfo = uboBuffers[i]->descriptorInfo();
+    if (!HeliosDescriptorWriter(*globalSetLayout, *globalPool)
+             .writeBuffer(0, &bufferInfo)
+             .build(globalDescriptorSets[i])) {
+      throw std::runtime_error("failed to build global descriptor set");
+    }
+  }
+
   SimpleRenderSystem simpleRenderSystem{
-      heliosDevice, heliosRenderer.getSwapChainRenderPass()};
+      heliosDevice, heliosRenderer.getSwapChainRenderPass(),
+      globalSetLayout->getDescriptorSetLayout()};
+  MeshletCullSystem meshletCullSystem{heliosDevice};
+  FrustumCullSystem frustumCullSystem{heliosDevice};
+
+  // a warm start loaded the cache and should create them much faster
+  auto pipelines = heliosDevice.pipelineCache().getStats();
+  std::cout << "pipeline cache: "
+            << (pipelines.loadedBytes > 0 ? "warm" : "cold") << " start, "
+            << (pipelines.loadedBytes >> 10) << " KiB loaded, "
+            << pipelines.pipelineCount << " pipelines created in "
+            << pipelines.creationMilliseconds << " ms" << std::endl;
 
   HeliosCamera camera{};
   camera.setViewTarget(glm::vec3(-1.0f, -2.0f, 2.0f),
@@ -38,6 +98,11 @@ void FirstApp::run() {
   KeyboardMovementController cameraController{};
 
   auto currentTime = std::chrono::high_resolution_clock::now();
+  float statsTime = 0.f;
+  uint64_t statsFrames = 0;
+  SimpleRenderSystem::LodStats lodStats{};
+  SimpleRenderSystem::DrawStats drawStats{};
+  SimpleRenderSystem::CullStats cullStats{};
 
   while (!heliosWindow.shouldClose()) {
     glfwPollEvents();
@@ -54,14 +119,93 @@ void FirstApp::run() {
     camera.setViewYXZ(viewerObject.transform.translation,
                       viewerObject.transform.rotation);
 
+    modelLoader.update();
+
     float aspect = heliosRenderer.getAspectRatio();
 
     camera.setPerspectiveProjection(glm::radians(50.0f), aspect, 0.1f, 10.0f);
     if (auto commandBuffer = heliosRenderer.beginFrame()) {
-      heliosRenderer.beginSwapChainRenderPass(commandBuffer);
-      simpleRenderSystem.renderGameObjects(commandBuffer, gameObjects, camera);
+      int frameIndex = heliosRenderer.getFrameIndex();
+      FrameInfo frameInfo{frameIndex, frameTime, commandBuffer, camera,
+                          globalDescriptorSets[frameIndex]};
+
+      // the frame's previous submission has completed, its buffer is free
+      GlobalUbo ubo{};
+      ubo.projection = camera.getProjection();
+      ubo.view = camera.getView();
+      uboBuffers[frameIndex]->writeToBuffer(&ubo);
+      uboBuffers[frameIndex]->flush();
+
+      // the first frame drawing newly uploaded models waits for them
+      heliosRenderer.waitForUpload(modelLoader.acquireUploads(commandBuffer));
+
+      bool gpuCulling = gameObjects.size() >= GPU_CULLING_OBJECT_COUNT;
+      if (gpuCulling) {
+        frustumCullSystem.cullGameObjects(frameInfo, gameObjects);
+      } else {
+        meshletCullSystem.cullGameObjects(frameInfo, gameObjects);
+      }
+
+      if (!gpuCulling) {
+        simpleRenderSystem.prepareGameObjects(frameInfo, gameObjects,
+                                              &meshletCullSystem);
+      }
+      bool parallelRecording =
+          !gpuCulling && heliosRenderer.getRecordingThreadCount() > 1 &&
+          simpleRenderSystem.getDrawCount() >= PARALLEL_RECORDING_DRAW_COUNT;
+
+      if (parallelRecording) {
+        heliosRenderer.beginSwapChainRenderPass(
+            commandBuffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        heliosRenderer.recordInParallel(
+            commandBuffer, simpleRenderSystem.getDrawCount(),
+            [&](VkCommandBuffer secondary, size_t begin, size_t end) {
+              simpleRenderSystem.recordDraws(frameInfo, secondary, begin, end,
+                                             &meshletCullSystem);
+            });
+      } else {
+        heliosRenderer.beginSwapChainRenderPass(commandBuffer);
+        if (gpuCulling) {
+          simpleRenderSystem.renderCulledGameObjects(frameInfo,
+                                                     frustumCullSystem);
+        } else {
+          simpleRenderSystem.recordDraws(
+              frameInfo, commandBuffer, 0, simpleRenderSystem.getDrawCount(),
+              &meshletCullSystem);
+        }
+      }
       heliosRenderer.endSwapChainRenderPass(commandBuffer);
       heliosRenderer.endFrame();
+
+      lodStats.trianglesDrawn +=
+          simpleRenderSystem.getLodStats().trianglesDrawn;
+      lodStats.trianglesSaved +=
+          simpleRenderSystem.getLodStats().trianglesSaved;
+      drawStats.drawCalls += simpleRenderSystem.getDrawStats().drawCalls;
+      drawStats.instances += simpleRenderSystem.getDrawStats().instances;
+      cullStats.visible += simpleRenderSystem.getCullStats().visible;
+      cullStats.culled += simpleRenderSystem.getCullStats().culled;
+      statsFrames++;
+    }
+
+    statsTime += frameTime;
+    if (statsTime >= 1.f && statsFrames > 0) {
+      std::cout << "lod: " << lodStats.trianglesDrawn / statsFrames
+                << " triangles drawn, " << lodStats.trianglesSaved / statsFrames
+                << " saved per frame" << std::endl;
+      std::cout << "draws: " << drawStats.drawCalls / statsFrames
+                << " draw calls for " << drawStats.instances / statsFrames
+                << " objects per frame" << std::endl;
+      if (cullStats.visible + cullStats.culled > 0) {
+        std::cout << "frustum culling: " << cullStats.visible / statsFrames
+                  << " visible, " << cullStats.culled / statsFrames
+                  << " culled per frame" << std::endl;
+      }
+      statsTime = 0.f;
+      statsFrames = 0;
+      lodStats = {};
+      drawStats = {};
+      cullStats = {};
     }
   }
 
@@ -69,13 +213,47 @@ void FirstApp::run() {
 };
 
 void FirstApp::loadGameObjects() {
-  std::shared_ptr<HeliosModel> heliosModel =
-      HeliosModel::createModelFromFile(heliosDevice, "models/flat_vase.obj");
+  // start every load before waiting on any so they run in parallel, objects
+  // are drawn once their model finished uploading
+  HeliosModel::LoadOptions options{};
+  options.optimize = true;
+  options.meshlets = true;
+  options.lods = true;
+  auto flatVase = modelLoader.loadAsync("models/flat_vase.obj", options);
+
   auto gameObject = HeliosGameObject::createGameObject();
-  gameObject.model = heliosModel;
+  gameObject.model = flatVase.get();
   gameObject.transform.translation = {0.0f, 0.5f, 2.5f};
   gameObject.transform.scale = glm::vec3(3.0f);
   gameObjects.push_back(std::move(gameObject));
+
+  auto stats = modelRegistry.getStats();
+  std::cout << "model registry: " << stats.residentModels << " resident, "
+            << stats.hits << " hits, " << stats.misses << " misses"
+            << std::endl;
+
+  auto memory = heliosDevice.allocator().getStats();
+  std::cout << "gpu memory: " << memory.allocationCount << " allocations in "
+            << memory.blockCount << " blocks + " << memory.dedicatedCount
+            << " dedicated, " << (memory.usedBytes >> 10) << " of "
+            << (memory.reservedBytes >> 10) << " KiB used, fragmentation "
+            << memory.internalFragmentation << " internal / "
+            << memory.externalFragmentation << " external" << std::endl;
+
+  auto staging = heliosDevice.stagingRing().getStats();
+  std::cout << "staging ring: " << staging.ringAllocations << " uploads, "
+            << staging.temporaryAllocations << " through temporary buffers, "
+            << (staging.usedBytes >> 10) << " of " << (staging.capacity >> 10)
+            << " KiB in flight" << std::endl;
+
+  for (const auto &arena : heliosDevice.getGeometryArenaStats()) {
+    std::cout << "geometry arena: " << arena.rangeCount << " models in "
+              << arena.blockCount << " blocks, " << arena.vertexCount
+              << " of " << arena.vertexCapacity << " vertices, "
+              << (arena.indexSize >> 10) << " of "
+              << (arena.indexCapacity >> 10) << " KiB of indices"
+              << std::endl;
+  }
 }
 
 } // namespace helios
@@ -1,6 +1,9 @@
 #pragma once
+#include "helios_descriptors.hpp"
 #include "helios_device.hpp"
 #include "helios_game_object.hpp"
+#include "helios_model_loader.hpp"
+#include "helios_model_registry.hpp"
 #include "helios_renderer.hpp"
 #include "helios_window.hpp"
 
@@ -29,6 +32,9 @@ private:
   HeliosWindow heliosWindow{WIDTH, HEIGHT, "Hello Vulkan!"};
   HeliosDevice heliosDevice{heliosWindow};
   HeliosRenderer heliosRenderer{heliosWindow, heliosDevice};
+  HeliosModelRegistry modelRegistry{};
+  HeliosModelLoader modelLoader{heliosDevice, &modelRegistry};
+  std::unique_ptr<HeliosDescriptorPool> globalPool{};
 
   std::vector<HeliosGameObject> gameObjects;
 };
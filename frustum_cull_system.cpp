@@ -0,0 +1,467 @@
+#include "frustum_cull_system.hpp"
+#include "helios_swap_chain.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_FORCE_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+namespace helios {
+
+namespace {
+
+// Object in frustum_cull.comp
+struct ObjectData {
+  glm::mat4 transform;
+  glm::mat4 normalMatrix;
+  // model space center and radius
+  glm::vec4 boundingSphere;
+  // group of level of detail 0, the other levels follow
+  uint32_t group;
+  uint32_t lodCount;
+  uint32_t padding[2];
+};
+
+// Group in frustum_cull.comp, one per model and level of detail
+struct GroupData {
+  glm::mat4 dequantize;
+  uint32_t indexCount;
+  uint32_t firstIndex;
+  int32_t vertexOffset;
+  uint32_t firstInstance;
+  uint32_t batch;
+  uint32_t firstBatchCommand;
+  // incremented by the GPU for every visible object
+  uint32_t visibleCount;
+  // HeliosModel::Lod::error of the group's level
+  float error;
+};
+
+// matches Instance in simple_shader.vert
+struct InstanceData {
+  glm::mat4 modelMatrix;
+  glm::mat4 normalMatrix;
+};
+
+struct FrustumCullPushConstantData {
+  glm::vec4 frustumPlanes[6];
+  // view space depth of a world space point, dot(xyz, p) + w
+  glm::vec4 depthPlane;
+  // levels may deviate by error * scale * lodScale <= depth, 0 selects
+  // level 0 only
+  float lodScale;
+  uint32_t objectCount;
+  uint32_t groupCount;
+  uint32_t flags;
+};
+
+// flags of FrustumCullPushConstantData, like in frustum_cull_commands.comp
+// commands are compacted and counted, otherwise written per group
+constexpr uint32_t COMPACT_COMMANDS = 1;
+// commands get their group's firstInstance, otherwise 0
+constexpr uint32_t COMMAND_FIRST_INSTANCE = 2;
+
+constexpr uint32_t WORKGROUP_SIZE = 64;
+constexpr uint32_t NO_GROUP = ~0u;
+
+// sizes the buffers start with, they grow on demand
+constexpr uint32_t INITIAL_OBJECT_CAPACITY = 1024;
+constexpr uint32_t INITIAL_GROUP_CAPACITY = 64;
+constexpr uint32_t INITIAL_BATCH_CAPACITY = 8;
+
+constexpr VkMemoryPropertyFlags HOST_VISIBLE =
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+} // namespace
+
+FrustumCullSystem::FrustumCullSystem(HeliosDevice &device)
+    : heliosDevice{device} {
+  createDescriptorSetLayout();
+  createPipelineLayout();
+  createPipelines();
+
+  descriptorPool = HeliosDescriptorPool::Builder(heliosDevice)
+                       .setMaxSets(HeliosSwapChain::MAX_FRAMES_IN_FLIGHT)
+                       .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                    6 * HeliosSwapChain::MAX_FRAMES_IN_FLIGHT)
+                       .build();
+  frames.resize(HeliosSwapChain::MAX_FRAMES_IN_FLIGHT);
+  for (auto &frame : frames) {
+    if (!descriptorPool->allocateDescriptor(setLayout->getDescriptorSetLayout(),
+                                            frame.descriptorSet)) {
+      throw std::runtime_error("failed to allocate culling descriptor set");
+    }
+    reserveFrame(frame, INITIAL_OBJECT_CAPACITY, INITIAL_OBJECT_CAPACITY,
+                 INITIAL_GROUP_CAPACITY, INITIAL_BATCH_CAPACITY);
+  }
+}
+
+FrustumCullSystem::~FrustumCullSystem() {
+  vkDestroyPipelineLayout(heliosDevice.device(), pipelineLayout, nullptr);
+}
+
+void FrustumCullSystem::createDescriptorSetLayout() {
+  setLayout = HeliosDescriptorSetLayout::Builder(heliosDevice)
+                  .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                              VK_SHADER_STAGE_COMPUTE_BIT)
+                  .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                              VK_SHADER_STAGE_COMPUTE_BIT)
+                  .addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                              VK_SHADER_STAGE_COMPUTE_BIT)
+                  .addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                              VK_SHADER_STAGE_COMPUTE_BIT)
+                  .addBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                              VK_SHADER_STAGE_COMPUTE_BIT)
+                  .addBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                              VK_SHADER_STAGE_COMPUTE_BIT)
+                  .build();
+}
+
+void FrustumCullSystem::createPipelineLayout() {
+  VkPushConstantRange pushConstantRange{};
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = sizeof(FrustumCullPushConstantData);
+
+  VkDescriptorSetLayout descriptorSetLayout =
+      setLayout->getDescriptorSetLayout();
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+  if (vkCreatePipelineLayout(heliosDevice.device(), &pipelineLayoutInfo,
+                             nullptr, &pipelineLayout) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create pipeline layout");
+  }
+}
+
+void FrustumCullSystem::createPipelines() {
+  assert(pipelineLayout != nullptr &&
+         "cannot create pipeline before pipeline layout");
+
+  cullPipeline = std::make_unique<HeliosPipeline>(
+      heliosDevice, "shaders/frustum_cull.comp.spv", pipelineLayout);
+  commandPipeline = std::make_unique<HeliosPipeline>(
+      heliosDevice, "shaders/frustum_cull_commands.comp.spv", pipelineLayout);
+  instancePipeline = std::make_unique<HeliosPipeline>(
+      heliosDevice, "shaders/frustum_cull_instances.comp.spv", pipelineLayout);
+}
+
+bool FrustumCullSystem::reserve(std::unique_ptr<HeliosBuffer> &buffer,
+                                VkDeviceSize elementSize, uint32_t count,
+                                VkBufferUsageFlags usage,
+                                VkMemoryPropertyFlags properties) {
+  if (buffer && buffer->getInstanceCount() >= count) {
+    return false;
+  }
+
+  // the frame's previous submission has completed, so replacing is safe
+  uint32_t capacity =
+      buffer ? std::max(count, 2 * buffer->getInstanceCount()) : count;
+  buffer = std::make_unique<HeliosBuffer>(heliosDevice, elementSize, capacity,
+                                          usage, properties);
+  if (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    buffer->map();
+  }
+  return true;
+}
+
+void FrustumCullSystem::reserveFrame(Frame &frame, uint32_t objects,
+                                     uint32_t instances, uint32_t groups,
+                                     uint32_t batches) {
+  const VkBufferUsageFlags storage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  const VkBufferUsageFlags indirect =
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+  bool replaced = false;
+  replaced |= reserve(frame.objects, sizeof(ObjectData), objects, storage,
+                      HOST_VISIBLE);
+  replaced |=
+      reserve(frame.groups, sizeof(GroupData), groups, storage, HOST_VISIBLE);
+  replaced |= reserve(frame.drawCounts, sizeof(uint32_t), batches, indirect,
+                      HOST_VISIBLE);
+  replaced |= reserve(frame.visibility, 2 * sizeof(uint32_t), objects,
+                      storage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  replaced |= reserve(frame.instances, sizeof(InstanceData), instances,
+                      storage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  replaced |= reserve(frame.commands, sizeof(VkDrawIndexedIndirectCommand),
+                      groups, indirect, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  if (!replaced) {
+    return;
+  }
+  // a replaced buffer starts out empty, write everything again
+  frame.lastUpdate = 0;
+  frame.layoutVersion = 0;
+
+  auto objectInfo = frame.objects->descriptorInfo();
+  auto groupInfo = frame.groups->descriptorInfo();
+  auto instanceInfo = frame.instances->descriptorInfo();
+  auto drawCountInfo = frame.drawCounts->descriptorInfo();
+  auto commandInfo = frame.commands->descriptorInfo();
+  auto visibilityInfo = frame.visibility->descriptorInfo();
+  HeliosDescriptorWriter(*setLayout, *descriptorPool)
+      .writeBuffer(0, &objectInfo)
+      .writeBuffer(1, &groupInfo)
+      .writeBuffer(2, &instanceInfo)
+      .writeBuffer(3, &drawCountInfo)
+      .writeBuffer(4, &commandInfo)
+      .writeBuffer(5, &visibilityInfo)
+      .overwrite(frame.descriptorSet);
+}
+
+void FrustumCullSystem::updateObjects(
+    std::vector<HeliosGameObject> &gameObjects) {
+  updateIndex++;
+  bool modelsChanged = objectStates.size() != gameObjects.size();
+  objectStates.resize(gameObjects.size());
+  for (size_t i = 0; i < gameObjects.size(); i++) {
+    HeliosModel *model = gameObjects[i].model.get();
+    if (model && (!model->isReady() || !model->isIndexed())) {
+      model = nullptr;
+    }
+    ObjectState &state = objectStates[i];
+    if (state.model.get() != model) {
+      state.model = model ? gameObjects[i].model : nullptr;
+      modelsChanged = true;
+    }
+    // comparing is cheaper than building and writing the matrices
+    const TransformComponent &transform = gameObjects[i].transform;
+    if (state.lastChange == 0 ||
+        transform.translation != state.transform.translation ||
+        transform.rotation != state.transform.rotation ||
+        transform.scale != state.transform.scale) {
+      state.transform = transform;
+      state.lastChange = updateIndex;
+    }
+  }
+  if (modelsChanged) {
+    buildGroups();
+  }
+}
+
+void FrustumCullSystem::buildGroups() {
+  groupIndices.clear();
+  groupModels.clear();
+  groupLods.clear();
+  groupSizes.clear();
+  objectCount = 0;
+  for (auto &state : objectStates) {
+    // slots and groups move, every object is written again
+    state.lastChange = updateIndex;
+    state.slot = NO_GROUP;
+    if (!state.model) {
+      continue;
+    }
+    HeliosModel *model = state.model.get();
+    auto group = groupIndices.try_emplace(
+        model, static_cast<uint32_t>(groupModels.size()));
+    if (group.second) {
+      for (uint32_t lod = 0; lod < model->getLodCount(); lod++) {
+        groupModels.push_back(model);
+        groupLods.push_back(lod);
+        groupSizes.push_back(0);
+      }
+    }
+    for (uint32_t lod = 0; lod < model->getLodCount(); lod++) {
+      groupSizes[group.first->second + lod]++;
+    }
+    state.group = group.first->second;
+    state.slot = objectCount++;
+  }
+
+  // there are few batches, a linear search is fine
+  batches.clear();
+  groupBatches.assign(groupModels.size(), 0);
+  for (size_t g = 0; g < groupModels.size(); g++) {
+    HeliosModel *model = groupModels[g];
+    auto batch = std::find_if(
+        batches.begin(), batches.end(), [&](const Batch &b) {
+          return b.model->getVertexFormat() == model->getVertexFormat() &&
+                 b.model->sharesBindingWith(*model);
+        });
+    if (batch == batches.end()) {
+      batches.push_back({model, 0, 0});
+      batch = std::prev(batches.end());
+    }
+    groupBatches[g] = static_cast<uint32_t>(batch - batches.begin());
+    batch->commandCount++;
+  }
+
+  uint32_t firstCommand = 0;
+  for (auto &batch : batches) {
+    batch.firstCommand = firstCommand;
+    firstCommand += batch.commandCount;
+    batch.commandCount = 0;
+  }
+  groupSlots.resize(groupModels.size());
+  for (size_t g = 0; g < groupModels.size(); g++) {
+    Batch &batch = batches[groupBatches[g]];
+    groupSlots[g] = batch.firstCommand + batch.commandCount++;
+  }
+  for (auto &state : objectStates) {
+    if (state.slot != NO_GROUP) {
+      state.group = groupSlots[state.group];
+    }
+  }
+
+  // An object lands in one group, so with the first instances summed up on
+  // the GPU there are at most objectCount instances. Otherwise any object
+  // may pick any level and each level reserves room for all of them.
+  commandFirstInstances.resize(groupModels.size());
+  uint32_t firstInstance = 0;
+  for (size_t g = 0; g < groupModels.size(); g++) {
+    commandFirstInstances[groupSlots[g]] = firstInstance;
+    firstInstance += groupSizes[g];
+  }
+  instanceCapacity = commandsCarryFirstInstance() ? objectCount : firstInstance;
+  layoutVersion++;
+}
+
+void FrustumCullSystem::writeFrame(Frame &frame) {
+  auto *groups = static_cast<GroupData *>(frame.groups->getMappedMemory());
+  if (frame.layoutVersion != layoutVersion) {
+    for (size_t g = 0; g < groupModels.size(); g++) {
+      const HeliosModel &model = *groupModels[g];
+      const auto &lod = model.getLod(groupLods[g]);
+      GroupData &group = groups[groupSlots[g]];
+      group.dequantize = model.getDequantizeMatrix();
+      group.indexCount = lod.indexCount;
+      group.firstIndex = model.getFirstIndex() + lod.firstIndex;
+      group.vertexOffset = model.getVertexOffset();
+      // replaced by the GPU when the commands carry it
+      group.firstInstance = commandFirstInstances[groupSlots[g]];
+      group.batch = groupBatches[g];
+      group.firstBatchCommand = batches[group.batch].firstCommand;
+      group.error = lod.error;
+    }
+    frame.layoutVersion = layoutVersion;
+  }
+  for (size_t g = 0; g < groupModels.size(); g++) {
+    groups[g].visibleCount = 0;
+  }
+  memset(frame.drawCounts->getMappedMemory(), 0,
+         batches.size() * sizeof(uint32_t));
+
+  auto *objects = static_cast<ObjectData *>(frame.objects->getMappedMemory());
+  for (auto &state : objectStates) {
+    if (state.slot == NO_GROUP || state.lastChange <= frame.lastUpdate) {
+      continue;
+    }
+    const auto &bounds = state.model->getBounds();
+    ObjectData &object = objects[state.slot];
+    object.transform = state.transform.mat4();
+    object.normalMatrix = state.transform.normalMatrix();
+    object.boundingSphere = glm::vec4{bounds.center, bounds.radius};
+    object.group = state.group;
+    object.lodCount = state.model->getLodCount();
+  }
+  frame.lastUpdate = updateIndex;
+}
+
+void FrustumCullSystem::cullGameObjects(
+    FrameInfo &frameInfo, std::vector<HeliosGameObject> &gameObjects) {
+  updateObjects(gameObjects);
+  if (objectCount == 0) {
+    return;
+  }
+
+  const auto groupCount = static_cast<uint32_t>(groupModels.size());
+  Frame &frame = frames[frameInfo.frameIndex];
+  reserveFrame(frame, objectCount, instanceCapacity, groupCount,
+               static_cast<uint32_t>(batches.size()));
+  writeFrame(frame);
+
+  FrustumCullPushConstantData push{};
+  const auto &planes = frameInfo.camera.getFrustumPlanes();
+  std::copy(planes.begin(), planes.end(), push.frustumPlanes);
+  const glm::mat4 &view = frameInfo.camera.getView();
+  push.depthPlane = {view[0][2], view[1][2], view[2][2], view[3][2]};
+  // see SimpleRenderSystem::selectLod, assumes a perspective projection
+  if (lodErrorThreshold > 0.f) {
+    push.lodScale =
+        frameInfo.camera.getProjection()[1][1] * 0.5f / lodErrorThreshold;
+  }
+  push.objectCount = objectCount;
+  push.groupCount = groupCount;
+  // commands drawn one by one must stay in the slot of their group
+  if (commandsCarryFirstInstance()) {
+    push.flags = COMMAND_FIRST_INSTANCE;
+    if (heliosDevice.drawIndirectCountEnabled) {
+      push.flags |= COMPACT_COMMANDS;
+    }
+  }
+
+  VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+  cullPipeline->bind(commandBuffer);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          pipelineLayout, 0, 1, &frame.descriptorSet, 0,
+                          nullptr);
+  vkCmdPushConstants(commandBuffer, pipelineLayout,
+                     VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                     sizeof(FrustumCullPushConstantData), &push);
+  vkCmdDispatch(commandBuffer,
+                (objectCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+  // the visible counts are complete once every object was culled
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0,
+                       nullptr, 0, nullptr);
+
+  // a single workgroup sums up the counts of all groups
+  commandPipeline->bind(commandBuffer);
+  vkCmdDispatch(commandBuffer, 1, 1, 1);
+
+  // the first instances are known once every group was summed up
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0,
+                       nullptr, 0, nullptr);
+
+  instancePipeline->bind(commandBuffer);
+  vkCmdDispatch(commandBuffer,
+                (objectCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+  barrier.dstAccessMask =
+      VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                           VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                       0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void FrustumCullSystem::drawBatch(FrameInfo &frameInfo,
+                                  size_t batchIndex) const {
+  const Batch &batch = batches[batchIndex];
+  const Frame &frame = frames[frameInfo.frameIndex];
+  batch.model->drawIndirectCount(
+      frameInfo.commandBuffer, frame.commands->getBuffer(),
+      batch.firstCommand * sizeof(VkDrawIndexedIndirectCommand),
+      frame.drawCounts->getBuffer(), batchIndex * sizeof(uint32_t),
+      batch.commandCount);
+}
+
+void FrustumCullSystem::drawCommand(FrameInfo &frameInfo, size_t batchIndex,
+                                    uint32_t command) const {
+  const Batch &batch = batches[batchIndex];
+  assert(command >= batch.firstCommand &&
+         command < batch.firstCommand + batch.commandCount &&
+         "command is not part of the batch");
+  const Frame &frame = frames[frameInfo.frameIndex];
+  batch.model->drawIndirect(frameInfo.commandBuffer,
+                            frame.commands->getBuffer(),
+                            command * sizeof(VkDrawIndexedIndirectCommand), 1);
+}
+
+} // namespace helios
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "helios_buffer.hpp"
+#include "helios_descriptors.hpp"
+#include "helios_device.hpp"
+#include "helios_frame_info.hpp"
+#include "helios_game_object.hpp"
+#include "helios_pipeline.hpp"
+
+// std
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace helios {
+
+// Culls whole game objects against the camera frustum on the GPU. The
+// transform and bounds of every object go to a storage buffer that is kept
+// between frames, only objects whose transform changed are rewritten. A
+// compute pass counts the visible objects per model and level of detail, a
+// second one sums the counts up into each group's first instance and turns
+// them into indexed indirect draw commands, and a third copies the instance
+// data of the visible objects, compacted per group, into an instance buffer
+// laid out like SimpleRenderSystem's. Models sharing vertex format and
+// bound buffers form a batch that is drawn with a single
+// vkCmdDrawIndexedIndirectCount. The culling pass picks each object's level
+// of detail like SimpleRenderSystem does, every level of a model has its own
+// group and command. Meshlet culling is not done on this path, and only
+// indexed models are drawn.
+class FrustumCullSystem {
+public:
+  struct Batch {
+    // any model of the batch, they all bind the same buffers
+    HeliosModel *model;
+    uint32_t firstCommand;
+    // upper bound, the GPU writes the actual count
+    uint32_t commandCount;
+  };
+
+  FrustumCullSystem(HeliosDevice &device);
+  ~FrustumCullSystem();
+
+  FrustumCullSystem(const FrustumCullSystem &) = delete;
+  FrustumCullSystem &operator=(const FrustumCullSystem &) = delete;
+
+  // Records the culling dispatches, must be called outside a render pass
+  // and before drawing the batches in this frame.
+  void cullGameObjects(FrameInfo &frameInfo,
+                       std::vector<HeliosGameObject> &gameObjects);
+
+  // same as SimpleRenderSystem::setLodErrorThreshold
+  void setLodErrorThreshold(float threshold) { lodErrorThreshold = threshold; }
+
+  // batches of the last cullGameObjects call
+  const std::vector<Batch> &getBatches() const { return batches; }
+  // objects submitted by the last cullGameObjects call
+  uint32_t getObjectCount() const { return objectCount; }
+  // Draws batches[batchIndex], the caller binds the pipeline, the model and
+  // the instance buffer. Only when commandsCarryFirstInstance().
+  void drawBatch(FrameInfo &frameInfo, size_t batchIndex) const;
+  // Whether the commands' firstInstance points at their instances. Without
+  // the drawIndirectFirstInstance feature it is 0, and each command of a
+  // batch is drawn with drawCommand after the caller passed the command's
+  // getCommandFirstInstance to its shader.
+  bool commandsCarryFirstInstance() const {
+    return heliosDevice.enabledFeatures.drawIndirectFirstInstance;
+  }
+  // command indices of a batch run from firstCommand to firstCommand +
+  // commandCount
+  uint32_t getCommandFirstInstance(uint32_t command) const {
+    return commandFirstInstances[command];
+  }
+  void drawCommand(FrameInfo &frameInfo, size_t batchIndex,
+                   uint32_t command) const;
+  // instance data of the visible objects, firstInstance of each command
+  // points into it
+  VkDescriptorBufferInfo instanceBufferInfo(int frameIndex) const {
+    return frames[frameIndex].instances->descriptorInfo();
+  }
+
+private:
+  struct Frame {
+    // host visible, objects and groups are only rewritten where they changed
+    // since the frame's last update
+    std::unique_ptr<HeliosBuffer> objects;
+    std::unique_ptr<HeliosBuffer> groups;
+    std::unique_ptr<HeliosBuffer> drawCounts;
+    // written by the culling passes
+    std::unique_ptr<HeliosBuffer> visibility;
+    std::unique_ptr<HeliosBuffer> instances;
+    std::unique_ptr<HeliosBuffer> commands;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    // updateIndex and layoutVersion the buffers were written with, 0 when
+    // they hold nothing
+    uint64_t lastUpdate = 0;
+    uint64_t layoutVersion = 0;
+  };
+
+  // what the object buffers were last written from
+  struct ObjectState {
+    // null when the object is not drawn, owned so its address can't be
+    // reused by another model while the groups refer to it
+    std::shared_ptr<HeliosModel> model;
+    TransformComponent transform{};
+    // index in the object buffers, ~0u when not drawn
+    uint32_t slot = 0;
+    // group of level of detail 0
+    uint32_t group = 0;
+    // updateIndex of the last change, 0 for objects not written yet
+    uint64_t lastChange = 0;
+  };
+
+  void createDescriptorSetLayout();
+  void createPipelineLayout();
+  void createPipelines();
+  // grows buffer to at least count elements, returns whether it was replaced
+  bool reserve(std::unique_ptr<HeliosBuffer> &buffer, VkDeviceSize elementSize,
+               uint32_t count, VkBufferUsageFlags usage,
+               VkMemoryPropertyFlags properties);
+  void reserveFrame(Frame &frame, uint32_t objects, uint32_t instances,
+                    uint32_t groups, uint32_t batches);
+  // records changed models and transforms, rebuilding the groups when the
+  // models changed
+  void updateObjects(std::vector<HeliosGameObject> &gameObjects);
+  // assigns every object the first group of its model and the groups to
+  // batches, groups of a batch and the levels of a model are adjacent
+  void buildGroups();
+  // brings the frame's object and group buffers up to date
+  void writeFrame(Frame &frame);
+
+  HeliosDevice &heliosDevice;
+
+  std::unique_ptr<HeliosPipeline> cullPipeline;
+  std::unique_ptr<HeliosPipeline> commandPipeline;
+  std::unique_ptr<HeliosPipeline> instancePipeline;
+  VkPipelineLayout pipelineLayout;
+  std::unique_ptr<HeliosDescriptorSetLayout> setLayout;
+  std::unique_ptr<HeliosDescriptorPool> descriptorPool;
+
+  std::vector<Frame> frames;
+
+  // indexed like gameObjects
+  std::vector<ObjectState> objectStates;
+  // incremented by every cullGameObjects call
+  uint64_t updateIndex = 0;
+  // incremented by every buildGroups call
+  uint64_t layoutVersion = 0;
+
+  // rebuilt when the models change, kept to reuse their memory
+  // first group of each model, one group per level of detail follows
+  std::unordered_map<const HeliosModel *, uint32_t> groupIndices;
+  std::vector<HeliosModel *> groupModels;
+  std::vector<uint32_t> groupLods;
+  std::vector<uint32_t> groupSizes;
+  std::vector<uint32_t> groupBatches;
+  // where each group's command goes, inside the range of its batch
+  std::vector<uint32_t> groupSlots;
+  // Indexed like the commands, the instance base reserved for their group
+  // when the commands can't carry the one the GPU computes. Each level then
+  // has room for every object of its model.
+  std::vector<uint32_t> commandFirstInstances;
+  std::vector<Batch> batches;
+  uint32_t objectCount = 0;
+  uint32_t instanceCapacity = 0;
+  float lodErrorThreshold = 0.001f;
+};
+
+} // namespace helios
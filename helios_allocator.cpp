@@ -0,0 +1,297 @@
+#include "helios_allocator.hpp"
+
+// std
+#include <algorithm>
+#include <stdexcept>
+
+namespace helios {
+
+HeliosAllocator::HeliosAllocator(VkDevice device,
+                                 VkPhysicalDevice physicalDevice,
+                                 const VkPhysicalDeviceProperties &properties)
+    : device{device},
+      bufferImageGranularity{properties.limits.bufferImageGranularity},
+      nonCoherentAtomSize{properties.limits.nonCoherentAtomSize} {
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+  // small heaps (e.g. the host visible part of VRAM) get smaller blocks so
+  // one half empty block can't take most of them
+  memoryTypes.resize(memoryProperties.memoryTypeCount);
+  for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+    VkDeviceSize heapSize =
+        memoryProperties
+            .memoryHeaps[memoryProperties.memoryTypes[i].heapIndex]
+            .size;
+    VkDeviceSize blockSize = MAX_BLOCK_SIZE;
+    while (blockSize > 4 * MIN_NODE_SIZE && blockSize > heapSize / 8) {
+      blockSize /= 2;
+    }
+    memoryTypes[i].blockSize = blockSize;
+    memoryTypes[i].maxOrder = orderFor(blockSize);
+  }
+}
+
+HeliosAllocator::~HeliosAllocator() {
+  for (auto &type : memoryTypes) {
+    for (auto &block : type.blocks) {
+      if (block) {
+        releaseMemory(block->memory, block->mapped);
+      }
+    }
+  }
+}
+
+uint32_t HeliosAllocator::orderFor(VkDeviceSize size) {
+  uint32_t order = 0;
+  while ((MIN_NODE_SIZE << order) < size) {
+    order++;
+  }
+  return order;
+}
+
+uint32_t HeliosAllocator::findMemoryType(
+    uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+  for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+    if ((typeFilter & (1 << i)) &&
+        (memoryProperties.memoryTypes[i].propertyFlags & properties) ==
+            properties) {
+      return i;
+    }
+  }
+
+  throw std::runtime_error("failed to find suitable memory type!");
+}
+
+VkDeviceMemory HeliosAllocator::allocateMemory(uint32_t memoryType,
+                                               VkDeviceSize size,
+                                               void *&mapped) {
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = size;
+  allocInfo.memoryTypeIndex = memoryType;
+
+  VkDeviceMemory memory;
+  if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate device memory!");
+  }
+
+  mapped = nullptr;
+  if (memoryProperties.memoryTypes[memoryType].propertyFlags &
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) !=
+        VK_SUCCESS) {
+      vkFreeMemory(device, memory, nullptr);
+      throw std::runtime_error("failed to map device memory!");
+    }
+  }
+  return memory;
+}
+
+void HeliosAllocator::releaseMemory(VkDeviceMemory memory, void *mapped) {
+  if (mapped) {
+    vkUnmapMemory(device, memory);
+  }
+  vkFreeMemory(device, memory, nullptr);
+}
+
+uint32_t HeliosAllocator::createBlock(uint32_t memoryType) {
+  MemoryType &type = memoryTypes[memoryType];
+  auto block = std::make_unique<Block>();
+  block->memory = allocateMemory(memoryType, type.blockSize, block->mapped);
+  block->freeNodes.resize(type.maxOrder + 1);
+  block->freeNodes[type.maxOrder].insert(0);
+
+  auto slot = std::find(type.blocks.begin(), type.blocks.end(), nullptr);
+  if (slot != type.blocks.end()) {
+    *slot = std::move(block);
+    return static_cast<uint32_t>(slot - type.blocks.begin());
+  }
+  type.blocks.push_back(std::move(block));
+  return static_cast<uint32_t>(type.blocks.size() - 1);
+}
+
+bool HeliosAllocator::allocateNode(Block &block, uint32_t order,
+                                   uint32_t maxOrder, VkDeviceSize &offset) {
+  uint32_t found = order;
+  while (found <= maxOrder && block.freeNodes[found].empty()) {
+    found++;
+  }
+  if (found > maxOrder) {
+    return false;
+  }
+
+  // lowest offset first keeps the allocations packed towards the start
+  offset = *block.freeNodes[found].begin();
+  block.freeNodes[found].erase(block.freeNodes[found].begin());
+  // split down to the requested order, freeing the upper halves
+  while (found > order) {
+    found--;
+    block.freeNodes[found].insert(offset + (MIN_NODE_SIZE << found));
+  }
+  return true;
+}
+
+void HeliosAllocator::freeNode(Block &block, VkDeviceSize offset,
+                               uint32_t order, uint32_t maxOrder) {
+  // merge with the buddy for as long as it is free as well
+  while (order < maxOrder) {
+    VkDeviceSize buddy = offset ^ (MIN_NODE_SIZE << order);
+    if (block.freeNodes[order].erase(buddy) == 0) {
+      break;
+    }
+    offset = std::min(offset, buddy);
+    order++;
+  }
+  block.freeNodes[order].insert(offset);
+}
+
+HeliosAllocator::Allocation
+HeliosAllocator::allocate(const VkMemoryRequirements &requirements,
+                          VkMemoryPropertyFlags properties,
+                          bool optimalTiling) {
+  std::lock_guard<std::mutex> lock{mutex};
+
+  Allocation allocation{};
+  allocation.memoryType =
+      findMemoryType(requirements.memoryTypeBits, properties);
+  allocation.requestedSize = requirements.size;
+  MemoryType &type = memoryTypes[allocation.memoryType];
+
+  VkDeviceSize size = std::max(requirements.size, requirements.alignment);
+  if (optimalTiling) {
+    size = std::max(size, bufferImageGranularity);
+  }
+  uint32_t order = orderFor(size);
+
+  allocationCount++;
+  usedBytes += requirements.size;
+
+  if (order >= type.maxOrder) {
+    allocation.block = DEDICATED;
+    allocation.size = requirements.size;
+    allocation.memory = allocateMemory(allocation.memoryType,
+                                       requirements.size, allocation.mapped);
+    dedicatedCount++;
+    dedicatedBytes += requirements.size;
+    return allocation;
+  }
+
+  allocation.size = MIN_NODE_SIZE << order;
+  uint32_t blockIndex = 0;
+  for (; blockIndex < type.blocks.size(); blockIndex++) {
+    auto &block = type.blocks[blockIndex];
+    if (block &&
+        allocateNode(*block, order, type.maxOrder, allocation.offset)) {
+      break;
+    }
+  }
+  if (blockIndex == type.blocks.size()) {
+    blockIndex = createBlock(allocation.memoryType);
+    allocateNode(*type.blocks[blockIndex], order, type.maxOrder,
+                 allocation.offset);
+  }
+
+  Block &block = *type.blocks[blockIndex];
+  block.allocationCount++;
+  allocation.block = blockIndex;
+  allocation.memory = block.memory;
+  if (block.mapped) {
+    allocation.mapped = static_cast<char *>(block.mapped) + allocation.offset;
+  }
+  nodeBytes += allocation.size;
+  nodeUsedBytes += requirements.size;
+  return allocation;
+}
+
+void HeliosAllocator::free(const Allocation &allocation) {
+  if (allocation.memory == VK_NULL_HANDLE) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock{mutex};
+
+  allocationCount--;
+  usedBytes -= allocation.requestedSize;
+
+  if (allocation.block == DEDICATED) {
+    releaseMemory(allocation.memory, allocation.mapped);
+    dedicatedCount--;
+    dedicatedBytes -= allocation.requestedSize;
+    return;
+  }
+
+  MemoryType &type = memoryTypes[allocation.memoryType];
+  auto &block = type.blocks[allocation.block];
+  freeNode(*block, allocation.offset, orderFor(allocation.size),
+           type.maxOrder);
+  nodeBytes -= allocation.size;
+  nodeUsedBytes -= allocation.requestedSize;
+
+  // an empty block is kept only while it is the last one of its type, so
+  // staging buffers created and freed in a loop don't reallocate it
+  if (--block->allocationCount == 0 &&
+      std::count_if(type.blocks.begin(), type.blocks.end(),
+                    [](const auto &b) { return b != nullptr; }) > 1) {
+    releaseMemory(block->memory, block->mapped);
+    block.reset();
+  }
+}
+
+VkMappedMemoryRange
+HeliosAllocator::mappedRange(const Allocation &allocation, VkDeviceSize size,
+                             VkDeviceSize offset) const {
+  VkDeviceSize begin = allocation.offset + offset;
+  VkDeviceSize end = size == VK_WHOLE_SIZE ? allocation.offset + allocation.size
+                                           : begin + size;
+  begin -= begin % nonCoherentAtomSize;
+  end = (end + nonCoherentAtomSize - 1) / nonCoherentAtomSize *
+        nonCoherentAtomSize;
+
+  VkMappedMemoryRange range{};
+  range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+  range.memory = allocation.memory;
+  range.offset = begin;
+  // nodes are multiples of the atom size (at most 256 bytes), only a
+  // dedicated allocation can end mid atom
+  range.size = allocation.block == DEDICATED && end > allocation.size
+                   ? VK_WHOLE_SIZE
+                   : end - begin;
+  return range;
+}
+
+HeliosAllocator::Stats HeliosAllocator::getStats() const {
+  std::lock_guard<std::mutex> lock{mutex};
+
+  Stats stats{};
+  stats.dedicatedCount = dedicatedCount;
+  stats.allocationCount = allocationCount;
+  stats.usedBytes = usedBytes;
+  stats.reservedBytes = dedicatedBytes;
+  for (const auto &type : memoryTypes) {
+    for (const auto &block : type.blocks) {
+      if (!block) {
+        continue;
+      }
+      stats.blockCount++;
+      stats.reservedBytes += type.blockSize;
+      for (uint32_t order = 0; order <= type.maxOrder; order++) {
+        const auto &nodes = block->freeNodes[order];
+        stats.freeBytes += nodes.size() * (MIN_NODE_SIZE << order);
+        if (!nodes.empty()) {
+          stats.largestFreeNode =
+              std::max(stats.largestFreeNode, MIN_NODE_SIZE << order);
+        }
+      }
+    }
+  }
+  if (nodeBytes > 0) {
+    stats.internalFragmentation =
+        1.f - static_cast<float>(nodeUsedBytes) / nodeBytes;
+  }
+  if (stats.freeBytes > 0) {
+    stats.externalFragmentation =
+        1.f - static_cast<float>(stats.largestFreeNode) / stats.freeBytes;
+  }
+  return stats;
+}
+
+} // namespace helios
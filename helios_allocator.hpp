@@ -0,0 +1,128 @@
+#pragma once
+
+#include "vulkan/vulkan_core.h"
+
+// std
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace helios {
+
+// Sub-allocates device memory so resources don't each cost a
+// vkAllocateMemory call, which is slow and limited to
+// maxMemoryAllocationCount live allocations. Every memory type gets its own
+// list of large blocks, each split by a buddy allocator: nodes are powers of
+// two aligned to their own size, so any alignment up to the node size holds
+// for free. Optimal tiling images are rounded up to bufferImageGranularity,
+// which leaves them whole pages and keeps linear resources off them.
+// Requests over half a block get a dedicated allocation. Host visible
+// blocks stay mapped for their whole lifetime.
+class HeliosAllocator {
+public:
+  static constexpr VkDeviceSize MAX_BLOCK_SIZE = VkDeviceSize{64} << 20;
+  static constexpr VkDeviceSize MIN_NODE_SIZE = 256;
+
+  struct Allocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    // bytes reserved, the requested size rounded up to a buddy node
+    VkDeviceSize size = 0;
+    // persistent mapping of offset, null unless host visible
+    void *mapped = nullptr;
+
+    uint32_t memoryType = 0;
+    // index into the memory type's blocks, DEDICATED for its own memory
+    uint32_t block = 0;
+    VkDeviceSize requestedSize = 0;
+  };
+
+  static constexpr uint32_t DEDICATED = UINT32_MAX;
+
+  struct Stats {
+    uint32_t blockCount = 0;
+    uint32_t dedicatedCount = 0;
+    uint32_t allocationCount = 0;
+    // device memory held, blocks and dedicated allocations
+    VkDeviceSize reservedBytes = 0;
+    // sum of requested sizes
+    VkDeviceSize usedBytes = 0;
+    // block bytes not in any node
+    VkDeviceSize freeBytes = 0;
+    VkDeviceSize largestFreeNode = 0;
+    // share of reserved node bytes lost to rounding up to powers of two
+    float internalFragmentation = 0.f;
+    // 1 - largestFreeNode / freeBytes, 0 when all free space is one node
+    float externalFragmentation = 0.f;
+  };
+
+  HeliosAllocator(VkDevice device, VkPhysicalDevice physicalDevice,
+                  const VkPhysicalDeviceProperties &properties);
+  ~HeliosAllocator();
+
+  HeliosAllocator(const HeliosAllocator &) = delete;
+  HeliosAllocator &operator=(const HeliosAllocator &) = delete;
+
+  // optimalTiling marks images with VK_IMAGE_TILING_OPTIMAL
+  Allocation allocate(const VkMemoryRequirements &requirements,
+                      VkMemoryPropertyFlags properties,
+                      bool optimalTiling = false);
+  void free(const Allocation &allocation);
+
+  // range for vkFlushMappedMemoryRanges, widened to nonCoherentAtomSize;
+  // size and offset are relative to the allocation
+  VkMappedMemoryRange mappedRange(const Allocation &allocation,
+                                  VkDeviceSize size = VK_WHOLE_SIZE,
+                                  VkDeviceSize offset = 0) const;
+
+  uint32_t findMemoryType(uint32_t typeFilter,
+                          VkMemoryPropertyFlags properties) const;
+
+  Stats getStats() const;
+
+private:
+  struct Block {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    void *mapped = nullptr;
+    // free node offsets per order, node size MIN_NODE_SIZE << order
+    std::vector<std::set<VkDeviceSize>> freeNodes;
+    uint32_t allocationCount = 0;
+  };
+
+  struct MemoryType {
+    VkDeviceSize blockSize = 0;
+    uint32_t maxOrder = 0;
+    // null slots are released blocks, reused by the next one
+    std::vector<std::unique_ptr<Block>> blocks;
+  };
+
+  VkDeviceMemory allocateMemory(uint32_t memoryType, VkDeviceSize size,
+                                void *&mapped);
+  void releaseMemory(VkDeviceMemory memory, void *mapped);
+  uint32_t createBlock(uint32_t memoryType);
+  bool allocateNode(Block &block, uint32_t order, uint32_t maxOrder,
+                    VkDeviceSize &offset);
+  void freeNode(Block &block, VkDeviceSize offset, uint32_t order,
+                uint32_t maxOrder);
+  static uint32_t orderFor(VkDeviceSize size);
+
+  VkDevice device;
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+  VkDeviceSize bufferImageGranularity;
+  VkDeviceSize nonCoherentAtomSize;
+
+  mutable std::mutex mutex;
+  std::vector<MemoryType> memoryTypes;
+  // for the stats
+  uint32_t dedicatedCount = 0;
+  VkDeviceSize dedicatedBytes = 0;
+  uint32_t allocationCount = 0;
+  VkDeviceSize usedBytes = 0;
+  // node sizes and requested sizes of the block allocations
+  VkDeviceSize nodeBytes = 0;
+  VkDeviceSize nodeUsedBytes = 0;
+};
+
+} // namespace helios
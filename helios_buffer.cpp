@@ -0,0 +1,89 @@
+#include "helios_buffer.hpp"
+
+// std
+#include <cassert>
+#include <cstring>
+
+namespace helios {
+
+// Returns the smallest multiple of minOffsetAlignment that holds instanceSize,
+// e.g. the stride of uniform buffer elements bound with dynamic offsets.
+VkDeviceSize HeliosBuffer::getAlignment(VkDeviceSize instanceSize,
+                                        VkDeviceSize minOffsetAlignment) {
+  if (minOffsetAlignment > 0) {
+    return (instanceSize + minOffsetAlignment - 1) &
+           ~(minOffsetAlignment - 1);
+  }
+  return instanceSize;
+}
+
+HeliosBuffer::HeliosBuffer(HeliosDevice &device, VkDeviceSize instanceSize,
+                           uint32_t instanceCount,
+                           VkBufferUsageFlags usageFlags,
+                           VkMemoryPropertyFlags memoryPropertyFlags,
+                           VkDeviceSize minOffsetAlignment,
+                           bool sharedWithTransferQueue)
+    : heliosDevice{device}, instanceCount{instanceCount},
+      instanceSize{instanceSize}, usageFlags{usageFlags},
+      memoryPropertyFlags{memoryPropertyFlags} {
+  alignmentSize = getAlignment(instanceSize, minOffsetAlignment);
+  bufferSize = alignmentSize * instanceCount;
+  device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer,
+                      allocation, sharedWithTransferQueue);
+}
+
+HeliosBuffer::~HeliosBuffer() {
+  unmap();
+  heliosDevice.destroyBuffer(buffer, allocation);
+}
+
+// Host visible memory stays mapped by HeliosAllocator, since buffers share
+// its blocks and a VkDeviceMemory can only be mapped once. map() and unmap()
+// only hand out and forget the pointer.
+VkResult HeliosBuffer::map([[maybe_unused]] VkDeviceSize size,
+                           VkDeviceSize offset) {
+  assert(buffer && allocation.memory && "called map on buffer before create");
+  assert((size == VK_WHOLE_SIZE ? offset : offset + size) <= bufferSize &&
+         "mapped range exceeds buffer");
+  if (allocation.mapped == nullptr) {
+    return VK_ERROR_MEMORY_MAP_FAILED;
+  }
+  mapped = static_cast<char *>(allocation.mapped) + offset;
+  return VK_SUCCESS;
+}
+
+void HeliosBuffer::unmap() { mapped = nullptr; }
+
+void HeliosBuffer::writeToBuffer(const void *data, VkDeviceSize size,
+                                 VkDeviceSize offset) {
+  assert(mapped && "cannot copy to unmapped buffer");
+
+  if (size == VK_WHOLE_SIZE) {
+    memcpy(mapped, data, bufferSize);
+  } else {
+    char *memOffset = static_cast<char *>(mapped);
+    memOffset += offset;
+    memcpy(memOffset, data, size);
+  }
+}
+
+VkResult HeliosBuffer::flush(VkDeviceSize size, VkDeviceSize offset) {
+  VkMappedMemoryRange mappedRange =
+      heliosDevice.allocator().mappedRange(allocation, size, offset);
+  return vkFlushMappedMemoryRanges(heliosDevice.device(), 1, &mappedRange);
+}
+
+VkDescriptorBufferInfo HeliosBuffer::descriptorInfo(VkDeviceSize size,
+                                                    VkDeviceSize offset) {
+  return VkDescriptorBufferInfo{buffer, offset, size};
+}
+
+void HeliosBuffer::writeToIndex(const void *data, uint32_t index) {
+  writeToBuffer(data, instanceSize, index * alignmentSize);
+}
+
+VkDescriptorBufferInfo HeliosBuffer::descriptorInfoForIndex(uint32_t index) {
+  return descriptorInfo(alignmentSize, index * alignmentSize);
+}
+
+} // namespace helios
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "helios_device.hpp"
+
+namespace helios {
+
+class HeliosBuffer {
+public:
+  HeliosBuffer(HeliosDevice &device, VkDeviceSize instanceSize,
+               uint32_t instanceCount, VkBufferUsageFlags usageFlags,
+               VkMemoryPropertyFlags memoryPropertyFlags,
+               VkDeviceSize minOffsetAlignment = 1,
+               bool sharedWithTransferQueue = false);
+  ~HeliosBuffer();
+
+  HeliosBuffer(const HeliosBuffer &) = delete;
+  HeliosBuffer &operator=(const HeliosBuffer &) = delete;
+
+  VkResult map(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+  void unmap();
+
+  void writeToBuffer(const void *data, VkDeviceSize size = VK_WHOLE_SIZE,
+                     VkDeviceSize offset = 0);
+  VkResult flush(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+  VkDescriptorBufferInfo descriptorInfo(VkDeviceSize size = VK_WHOLE_SIZE,
+                                        VkDeviceSize offset = 0);
+
+  void writeToIndex(const void *data, uint32_t index);
+  VkDescriptorBufferInfo descriptorInfoForIndex(uint32_t index);
+
+  VkBuffer getBuffer() const { return buffer; }
+  void *getMappedMemory() const { return mapped; }
+  uint32_t getInstanceCount() const { return instanceCount; }
+  VkDeviceSize getInstanceSize() const { return instanceSize; }
+  VkDeviceSize getAlignmentSize() const { return alignmentSize; }
+  VkDeviceSize getBufferSize() const { return bufferSize; }
+
+private:
+  static VkDeviceSize getAlignment(VkDeviceSize instanceSize,
+                                   VkDeviceSize minOffsetAlignment);
+
+  HeliosDevice &heliosDevice;
+  void *mapped = nullptr;
+  VkBuffer buffer = VK_NULL_HANDLE;
+  HeliosAllocator::Allocation allocation{};
+
+  VkDeviceSize bufferSize;
+  uint32_t instanceCount;
+  VkDeviceSize instanceSize;
+  VkDeviceSize alignmentSize;
+  VkBufferUsageFlags usageFlags;
+  VkMemoryPropertyFlags memoryPropertyFlags;
+};
+
+} // namespace helios
@@ -15,6 +15,7 @@ void HeliosCamera::setOrthographicProjection(float left, float right, float top,
   projectionMatrix[3][0] = -(right + left) / (right - left);
   projectionMatrix[3][1] = -(bottom + top) / (bottom - top);
   projectionMatrix[3][2] = -near / (far - near);
+  updateFrustumPlanes();
 }
 
 void HeliosCamera::setPerspectiveProjection(float fovy, float aspect,
@@ -27,6 +28,7 @@ void HeliosCamera::setPerspectiveProjection(float fovy, float aspect,
   projectionMatrix[2][2] = far / (far - near);
   projectionMatrix[2][3] = 1.f;
   projectionMatrix[3][2] = -(far * near) / (far - near);
+  updateFrustumPlanes();
 }
 
 void HeliosCamera::setViewDirection(glm::vec3 position, glm::vec3 direction,
@@ -48,6 +50,7 @@ void HeliosCamera::setViewDirection(glm::vec3 position, glm::vec3 direction,
   viewMatrix[3][0] = -glm::dot(u, position);
   viewMatrix[3][1] = -glm::dot(v, position);
   viewMatrix[3][2] = -glm::dot(w, position);
+  updateFrustumPlanes();
 }
 
 void HeliosCamera::setViewTarget(glm::vec3 position, glm::vec3 target,
@@ -80,6 +83,29 @@ void HeliosCamera::setViewYXZ(glm::vec3 position, glm::vec3 rotation) {
   viewMatrix[3][0] = -glm::dot(u, position);
   viewMatrix[3][1] = -glm::dot(v, position);
   viewMatrix[3][2] = -glm::dot(w, position);
+  updateFrustumPlanes();
+}
+
+void HeliosCamera::updateFrustumPlanes() {
+  extractFrustumPlanes(projectionMatrix * viewMatrix, frustumPlanes.data());
+}
+
+// Gribb/Hartmann
+void HeliosCamera::extractFrustumPlanes(const glm::mat4 &m,
+                                        glm::vec4 planes[6]) {
+  glm::vec4 rows[4];
+  for (int i = 0; i < 4; i++) {
+    rows[i] = glm::vec4{m[0][i], m[1][i], m[2][i], m[3][i]};
+  }
+  planes[0] = rows[3] + rows[0]; // left
+  planes[1] = rows[3] - rows[0]; // right
+  planes[2] = rows[3] + rows[1]; // top
+  planes[3] = rows[3] - rows[1]; // bottom
+  planes[4] = rows[2];           // near
+  planes[5] = rows[3] - rows[2]; // far
+  for (int i = 0; i < 6; i++) {
+    planes[i] = planes[i] / glm::length(glm::vec3{planes[i]});
+  }
 }
 
 } // namespace helios
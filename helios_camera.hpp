@@ -4,6 +4,9 @@
 #define GLM_FORCE_FORCE_ZERO_TO_ONE
 #include <glm/glm.hpp>
 
+// std
+#include <array>
+
 namespace helios {
 class HeliosCamera {
 public:
@@ -23,9 +26,22 @@ public:
 
   const glm::mat4 &getProjection() const { return projectionMatrix; }
   const glm::mat4 &getView() const { return viewMatrix; }
+  // world space planes of the view frustum, see extractFrustumPlanes;
+  // updated whenever the projection or view changes
+  const std::array<glm::vec4, 6> &getFrustumPlanes() const {
+    return frustumPlanes;
+  }
+
+  // Planes of the clip volume of m, e.g. projection * view * model, in the
+  // space m transforms from. Normals point inwards and are normalized.
+  // Assumes [0, 1] clip depth.
+  static void extractFrustumPlanes(const glm::mat4 &m, glm::vec4 planes[6]);
 
 private:
+  void updateFrustumPlanes();
+
   glm::mat4 projectionMatrix{1.0f};
   glm::mat4 viewMatrix{1.0f};
+  std::array<glm::vec4, 6> frustumPlanes{};
 };
 } // namespace helios
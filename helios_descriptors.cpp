@@ -0,0 +1,208 @@
+#include "helios_descriptors.hpp"
+
+// std
+#include <cassert>
+#include <stdexcept>
+
+namespace helios {
+
+// *************** Descriptor Set Layout Builder *********************
+
+HeliosDescriptorSetLayout::Builder &
+HeliosDescriptorSetLayout::Builder::addBinding(uint32_t binding,
+                                               VkDescriptorType descriptorType,
+                                               VkShaderStageFlags stageFlags,
+                                               uint32_t count) {
+  assert(bindings.count(binding) == 0 && "binding already in use");
+  VkDescriptorSetLayoutBinding layoutBinding{};
+  layoutBinding.binding = binding;
+  layoutBinding.descriptorType = descriptorType;
+  layoutBinding.descriptorCount = count;
+  layoutBinding.stageFlags = stageFlags;
+  bindings[binding] = layoutBinding;
+  return *this;
+}
+
+std::unique_ptr<HeliosDescriptorSetLayout>
+HeliosDescriptorSetLayout::Builder::build() const {
+  return std::make_unique<HeliosDescriptorSetLayout>(heliosDevice, bindings);
+}
+
+// *************** Descriptor Set Layout *********************
+
+HeliosDescriptorSetLayout::HeliosDescriptorSetLayout(
+    HeliosDevice &device,
+    std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings)
+    : heliosDevice{device}, bindings{bindings} {
+  std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
+  for (auto kv : bindings) {
+    setLayoutBindings.push_back(kv.second);
+  }
+
+  VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo{};
+  descriptorSetLayoutInfo.sType =
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  descriptorSetLayoutInfo.bindingCount =
+      static_cast<uint32_t>(setLayoutBindings.size());
+  descriptorSetLayoutInfo.pBindings = setLayoutBindings.data();
+
+  if (vkCreateDescriptorSetLayout(heliosDevice.device(),
+                                  &descriptorSetLayoutInfo, nullptr,
+                                  &descriptorSetLayout) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create descriptor set layout!");
+  }
+}
+
+HeliosDescriptorSetLayout::~HeliosDescriptorSetLayout() {
+  vkDestroyDescriptorSetLayout(heliosDevice.device(), descriptorSetLayout,
+                               nullptr);
+}
+
+// *************** Descriptor Pool Builder *********************
+
+HeliosDescriptorPool::Builder &
+HeliosDescriptorPool::Builder::addPoolSize(VkDescriptorType descriptorType,
+                                           uint32_t count) {
+  poolSizes.push_back({descriptorType, count});
+  return *this;
+}
+
+HeliosDescriptorPool::Builder &
+HeliosDescriptorPool::Builder::setPoolFlags(VkDescriptorPoolCreateFlags flags) {
+  poolFlags = flags;
+  return *this;
+}
+
+HeliosDescriptorPool::Builder &
+HeliosDescriptorPool::Builder::setMaxSets(uint32_t count) {
+  maxSets = count;
+  return *this;
+}
+
+std::unique_ptr<HeliosDescriptorPool>
+HeliosDescriptorPool::Builder::build() const {
+  return std::make_unique<HeliosDescriptorPool>(heliosDevice, maxSets,
+                                                poolFlags, poolSizes);
+}
+
+// *************** Descriptor Pool *********************
+
+HeliosDescriptorPool::HeliosDescriptorPool(
+    HeliosDevice &device, uint32_t maxSets,
+    VkDescriptorPoolCreateFlags poolFlags,
+    const std::vector<VkDescriptorPoolSize> &poolSizes)
+    : heliosDevice{device} {
+  VkDescriptorPoolCreateInfo descriptorPoolInfo{};
+  descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+  descriptorPoolInfo.pPoolSizes = poolSizes.data();
+  descriptorPoolInfo.maxSets = maxSets;
+  descriptorPoolInfo.flags = poolFlags;
+
+  if (vkCreateDescriptorPool(heliosDevice.device(), &descriptorPoolInfo,
+                             nullptr, &descriptorPool) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create descriptor pool!");
+  }
+}
+
+HeliosDescriptorPool::~HeliosDescriptorPool() {
+  vkDestroyDescriptorPool(heliosDevice.device(), descriptorPool, nullptr);
+}
+
+bool HeliosDescriptorPool::allocateDescriptor(
+    const VkDescriptorSetLayout descriptorSetLayout,
+    VkDescriptorSet &descriptor) const {
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = descriptorPool;
+  allocInfo.pSetLayouts = &descriptorSetLayout;
+  allocInfo.descriptorSetCount = 1;
+
+  if (vkAllocateDescriptorSets(heliosDevice.device(), &allocInfo,
+                               &descriptor) != VK_SUCCESS) {
+    return false;
+  }
+  return true;
+}
+
+void HeliosDescriptorPool::freeDescriptors(
+    std::vector<VkDescriptorSet> &descriptors) const {
+  vkFreeDescriptorSets(heliosDevice.device(), descriptorPool,
+                       static_cast<uint32_t>(descriptors.size()),
+                       descriptors.data());
+}
+
+void HeliosDescriptorPool::resetPool() {
+  vkResetDescriptorPool(heliosDevice.device(), descriptorPool, 0);
+}
+
+// *************** Descriptor Writer *********************
+
+HeliosDescriptorWriter::HeliosDescriptorWriter(
+    HeliosDescriptorSetLayout &setLayout, HeliosDescriptorPool &pool)
+    : setLayout{setLayout}, pool{pool} {}
+
+HeliosDescriptorWriter &
+HeliosDescriptorWriter::writeBuffer(uint32_t binding,
+                                    VkDescriptorBufferInfo *bufferInfo) {
+  assert(setLayout.bindings.count(binding) == 1 &&
+         "layout does not contain specified binding");
+
+  auto &bindingDescription = setLayout.bindings[binding];
+
+  assert(bindingDescription.descriptorCount == 1 &&
+         "binding single descriptor info, but binding expects multiple");
+
+  VkWriteDescriptorSet write{};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.descriptorType = bindingDescription.descriptorType;
+  write.dstBinding = binding;
+  write.pBufferInfo = bufferInfo;
+  write.descriptorCount = 1;
+
+  writes.push_back(write);
+  return *this;
+}
+
+HeliosDescriptorWriter &
+HeliosDescriptorWriter::writeImage(uint32_t binding,
+                                   VkDescriptorImageInfo *imageInfo) {
+  assert(setLayout.bindings.count(binding) == 1 &&
+         "layout does not contain specified binding");
+
+  auto &bindingDescription = setLayout.bindings[binding];
+
+  assert(bindingDescription.descriptorCount == 1 &&
+         "binding single descriptor info, but binding expects multiple");
+
+  VkWriteDescriptorSet write{};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.descriptorType = bindingDescription.descriptorType;
+  write.dstBinding = binding;
+  write.pImageInfo = imageInfo;
+  write.descriptorCount = 1;
+
+  writes.push_back(write);
+  return *this;
+}
+
+bool HeliosDescriptorWriter::build(VkDescriptorSet &set) {
+  bool success =
+      pool.allocateDescriptor(setLayout.getDescriptorSetLayout(), set);
+  if (!success) {
+    return false;
+  }
+  overwrite(set);
+  return true;
+}
+
+void HeliosDescriptorWriter::overwrite(VkDescriptorSet &set) {
+  for (auto &write : writes) {
+    write.dstSet = set;
+  }
+  vkUpdateDescriptorSets(pool.heliosDevice.device(),
+                         static_cast<uint32_t>(writes.size()), writes.data(),
+                         0, nullptr);
+}
+
+} // namespace helios
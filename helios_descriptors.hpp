@@ -0,0 +1,107 @@
+#pragma once
+
+#include "helios_device.hpp"
+
+// std
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace helios {
+
+class HeliosDescriptorSetLayout {
+public:
+  class Builder {
+  public:
+    Builder(HeliosDevice &device) : heliosDevice{device} {}
+
+    Builder &addBinding(uint32_t binding, VkDescriptorType descriptorType,
+                        VkShaderStageFlags stageFlags, uint32_t count = 1);
+    std::unique_ptr<HeliosDescriptorSetLayout> build() const;
+
+  private:
+    HeliosDevice &heliosDevice;
+    std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings{};
+  };
+
+  HeliosDescriptorSetLayout(
+      HeliosDevice &device,
+      std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings);
+  ~HeliosDescriptorSetLayout();
+
+  HeliosDescriptorSetLayout(const HeliosDescriptorSetLayout &) = delete;
+  HeliosDescriptorSetLayout &
+  operator=(const HeliosDescriptorSetLayout &) = delete;
+
+  VkDescriptorSetLayout getDescriptorSetLayout() const {
+    return descriptorSetLayout;
+  }
+
+private:
+  HeliosDevice &heliosDevice;
+  VkDescriptorSetLayout descriptorSetLayout;
+  std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings;
+
+  friend class HeliosDescriptorWriter;
+};
+
+class HeliosDescriptorPool {
+public:
+  class Builder {
+  public:
+    Builder(HeliosDevice &device) : heliosDevice{device} {}
+
+    Builder &addPoolSize(VkDescriptorType descriptorType, uint32_t count);
+    Builder &setPoolFlags(VkDescriptorPoolCreateFlags flags);
+    Builder &setMaxSets(uint32_t count);
+    std::unique_ptr<HeliosDescriptorPool> build() const;
+
+  private:
+    HeliosDevice &heliosDevice;
+    std::vector<VkDescriptorPoolSize> poolSizes{};
+    uint32_t maxSets = 1000;
+    VkDescriptorPoolCreateFlags poolFlags = 0;
+  };
+
+  HeliosDescriptorPool(HeliosDevice &device, uint32_t maxSets,
+                       VkDescriptorPoolCreateFlags poolFlags,
+                       const std::vector<VkDescriptorPoolSize> &poolSizes);
+  ~HeliosDescriptorPool();
+
+  HeliosDescriptorPool(const HeliosDescriptorPool &) = delete;
+  HeliosDescriptorPool &operator=(const HeliosDescriptorPool &) = delete;
+
+  bool allocateDescriptor(const VkDescriptorSetLayout descriptorSetLayout,
+                          VkDescriptorSet &descriptor) const;
+
+  void freeDescriptors(std::vector<VkDescriptorSet> &descriptors) const;
+
+  void resetPool();
+
+private:
+  HeliosDevice &heliosDevice;
+  VkDescriptorPool descriptorPool;
+
+  friend class HeliosDescriptorWriter;
+};
+
+class HeliosDescriptorWriter {
+public:
+  HeliosDescriptorWriter(HeliosDescriptorSetLayout &setLayout,
+                         HeliosDescriptorPool &pool);
+
+  HeliosDescriptorWriter &writeBuffer(uint32_t binding,
+                                      VkDescriptorBufferInfo *bufferInfo);
+  HeliosDescriptorWriter &writeImage(uint32_t binding,
+                                     VkDescriptorImageInfo *imageInfo);
+
+  bool build(VkDescriptorSet &set);
+  void overwrite(VkDescriptorSet &set);
+
+private:
+  HeliosDescriptorSetLayout &setLayout;
+  HeliosDescriptorPool &pool;
+  std::vector<VkWriteDescriptorSet> writes;
+};
+
+} // namespace helios
@@ -1,4 +1,5 @@
 #include "helios_device.hpp"
+#include "helios_upload_batch.hpp"
 #include "vulkan/vulkan_core.h"
 
 // std headers
@@ -53,9 +54,21 @@ HeliosDevice::HeliosDevice(HeliosWindow &window) : window{window} {
   pickPhysicalDevice();
   createLogicalDevice();
   createCommandPool();
+  createUploadSemaphore();
+  allocator_ =
+      std::make_unique<HeliosAllocator>(device_, physicalDevice, properties);
+  stagingRing_ = std::make_unique<HeliosStagingRing>(*this);
+  pipelineCache_ = std::make_unique<HeliosPipelineCache>(device_, properties);
 }
 
 HeliosDevice::~HeliosDevice() {
+  waitForUpload(lastUploadValue);
+  pipelineCache_.reset();
+  geometryArenas.clear();
+  stagingRing_.reset();
+  allocator_.reset();
+  vkDestroySemaphore(device_, uploadSemaphore_, nullptr);
+  vkDestroyCommandPool(device_, transferCommandPool, nullptr);
   vkDestroyCommandPool(device_, commandPool, nullptr);
   vkDestroyDevice(device_, nullptr);
 
@@ -78,7 +91,8 @@ void HeliosDevice::createInstance() {
   appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
   appInfo.pEngineName = "No Engine";
   appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-  appInfo.apiVersion = VK_API_VERSION_1_0;
+  // timeline semaphores are core in 1.2
+  appInfo.apiVersion = VK_API_VERSION_1_2;
 
   VkInstanceCreateInfo createInfo = {};
   // For macOS error
@@ -140,8 +154,11 @@ void HeliosDevice::createLogicalDevice() {
   QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-  std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily,
-                                            indices.presentFamily};
+  graphicsFamily_ = indices.graphicsFamily;
+  transferFamily_ = indices.transferFamilyHasValue ? indices.transferFamily
+                                                   : indices.graphicsFamily;
+  std::set<uint32_t> uniqueQueueFamilies = {
+      indices.graphicsFamily, indices.presentFamily, transferFamily_};
 
   float queuePriority = 1.0f;
   for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -153,11 +170,35 @@ void HeliosDevice::createLogicalDevice() {
     queueCreateInfos.push_back(queueCreateInfo);
   }
 
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
   VkPhysicalDeviceFeatures deviceFeatures = {};
   deviceFeatures.samplerAnisotropy = VK_TRUE;
+  deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+  // indirect commands with a non-zero firstInstance
+  deviceFeatures.drawIndirectFirstInstance =
+      supportedFeatures.drawIndirectFirstInstance;
+  enabledFeatures = deviceFeatures;
+
+  VkPhysicalDeviceVulkan12Features supportedVulkan12Features{};
+  supportedVulkan12Features.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES;
+  VkPhysicalDeviceFeatures2 features2{};
+  features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features2.pNext = &supportedVulkan12Features;
+  vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+  VkPhysicalDeviceVulkan12Features vulkan12Features{};
+  vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES;
+  vulkan12Features.timelineSemaphore = VK_TRUE;
+  vulkan12Features.drawIndirectCount =
+      supportedVulkan12Features.drawIndirectCount;
+  drawIndirectCountEnabled = vulkan12Features.drawIndirectCount;
 
   VkDeviceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  createInfo.pNext = &vulkan12Features;
 
   createInfo.queueCreateInfoCount =
       static_cast<uint32_t>(queueCreateInfos.size());
@@ -185,6 +226,10 @@ void HeliosDevice::createLogicalDevice() {
 
   vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
   vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+  vkGetDeviceQueue(device_, transferFamily_, 0, &transferQueue_);
+  std::cout << "upload queue family: " << transferFamily_
+            << (hasTransferQueue() ? " (transfer only)" : " (graphics)")
+            << std::endl;
 }
 
 void HeliosDevice::createCommandPool() {
@@ -200,6 +245,27 @@ void HeliosDevice::createCommandPool() {
       VK_SUCCESS) {
     throw std::runtime_error("failed to create command pool!");
   }
+
+  poolInfo.queueFamilyIndex = transferFamily_;
+  if (vkCreateCommandPool(device_, &poolInfo, nullptr,
+                          &transferCommandPool) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create transfer command pool!");
+  }
+}
+
+void HeliosDevice::createUploadSemaphore() {
+  VkSemaphoreTypeCreateInfo typeInfo{};
+  typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  typeInfo.initialValue = 0;
+
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphoreInfo.pNext = &typeInfo;
+  if (vkCreateSemaphore(device_, &semaphoreInfo, nullptr,
+                        &uploadSemaphore_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create upload semaphore!");
+  }
 }
 
 void HeliosDevice::createSurface() {
@@ -221,8 +287,22 @@ bool HeliosDevice::isDeviceSuitable(VkPhysicalDevice device) {
   VkPhysicalDeviceFeatures supportedFeatures;
   vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(device, &deviceProperties);
+  bool timelineSupported = false;
+  if (deviceProperties.apiVersion >= VK_API_VERSION_1_2) {
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES;
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &vulkan12Features;
+    vkGetPhysicalDeviceFeatures2(device, &features2);
+    timelineSupported = vulkan12Features.timelineSemaphore;
+  }
+
   return indices.isComplete() && extensionsSupported && swapChainAdequate &&
-         supportedFeatures.samplerAnisotropy;
+         supportedFeatures.samplerAnisotropy && timelineSupported;
 }
 
 void HeliosDevice::populateDebugMessengerCreateInfo(
@@ -351,18 +431,25 @@ QueueFamilyIndices HeliosDevice::findQueueFamilies(VkPhysicalDevice device) {
   int i = 0;
   for (const auto &queueFamily : queueFamilies) {
     if (queueFamily.queueCount > 0 &&
-        queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+        queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT &&
+        !indices.graphicsFamilyHasValue) {
       indices.graphicsFamily = i;
       indices.graphicsFamilyHasValue = true;
     }
     VkBool32 presentSupport = false;
     vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
-    if (queueFamily.queueCount > 0 && presentSupport) {
+    if (queueFamily.queueCount > 0 && presentSupport &&
+        !indices.presentFamilyHasValue) {
       indices.presentFamily = i;
       indices.presentFamilyHasValue = true;
     }
-    if (indices.isComplete()) {
-      break;
+    if (queueFamily.queueCount > 0 &&
+        (queueFamily.queueFlags &
+         (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT |
+          VK_QUEUE_COMPUTE_BIT)) == VK_QUEUE_TRANSFER_BIT &&
+        !indices.transferFamilyHasValue) {
+      indices.transferFamily = i;
+      indices.transferFamilyHasValue = true;
     }
 
     i++;
@@ -419,27 +506,48 @@ HeliosDevice::findSupportedFormat(const std::vector<VkFormat> &candidates,
 
 uint32_t HeliosDevice::findMemoryType(uint32_t typeFilter,
                                       VkMemoryPropertyFlags properties) {
-  VkPhysicalDeviceMemoryProperties memProperties;
-  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-    if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags &
-                                    properties) == properties) {
-      return i;
+  return allocator_->findMemoryType(typeFilter, properties);
+}
+
+HeliosGeometryArena &HeliosDevice::geometryArena(uint32_t positionStride,
+                                                 uint32_t attributeStride) {
+  std::lock_guard<std::mutex> lock{geometryArenaMutex};
+  for (auto &arena : geometryArenas) {
+    if (arena->getPositionStride() == positionStride &&
+        arena->getAttributeStride() == attributeStride) {
+      return *arena;
     }
   }
+  geometryArenas.push_back(std::make_unique<HeliosGeometryArena>(
+      *this, positionStride, attributeStride));
+  return *geometryArenas.back();
+}
 
-  throw std::runtime_error("failed to find suitable memory type!");
+std::vector<HeliosGeometryArena::Stats> HeliosDevice::getGeometryArenaStats() {
+  std::lock_guard<std::mutex> lock{geometryArenaMutex};
+  std::vector<HeliosGeometryArena::Stats> stats{};
+  for (auto &arena : geometryArenas) {
+    stats.push_back(arena->getStats());
+  }
+  return stats;
 }
 
 void HeliosDevice::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
                                 VkMemoryPropertyFlags properties,
                                 VkBuffer &buffer,
-                                VkDeviceMemory &bufferMemory) {
+                                HeliosAllocator::Allocation &allocation,
+                                bool sharedWithTransferQueue) {
   VkBufferCreateInfo bufferInfo{};
   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   bufferInfo.size = size;
   bufferInfo.usage = usage;
   bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  uint32_t queueFamilies[] = {graphicsFamily_, transferFamily_};
+  if (sharedWithTransferQueue && hasTransferQueue()) {
+    bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    bufferInfo.queueFamilyIndexCount = 2;
+    bufferInfo.pQueueFamilyIndices = queueFamilies;
+  }
 
   if (vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
     throw std::runtime_error("failed to create vertex buffer!");
@@ -448,18 +556,20 @@ void HeliosDevice::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
   VkMemoryRequirements memRequirements;
   vkGetBufferMemoryRequirements(device_, buffer, &memRequirements);
 
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex =
-      findMemoryType(memRequirements.memoryTypeBits, properties);
-
-  if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) !=
-      VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate vertex buffer memory!");
+  try {
+    allocation = allocator_->allocate(memRequirements, properties);
+  } catch (...) {
+    vkDestroyBuffer(device_, buffer, nullptr);
+    throw;
   }
 
-  vkBindBufferMemory(device_, buffer, bufferMemory, 0);
+  vkBindBufferMemory(device_, buffer, allocation.memory, allocation.offset);
+}
+
+void HeliosDevice::destroyBuffer(
+    VkBuffer buffer, const HeliosAllocator::Allocation &allocation) {
+  vkDestroyBuffer(device_, buffer, nullptr);
+  allocator_->free(allocation);
 }
 
 VkCommandBuffer HeliosDevice::beginSingleTimeCommands() {
@@ -488,30 +598,106 @@ void HeliosDevice::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &commandBuffer;
 
-  vkQueueSubmit(graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE);
-  vkQueueWaitIdle(graphicsQueue_);
+  // waits for these commands only, not for frames in flight on the queue
+  VkFenceCreateInfo fenceInfo{};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  VkFence fence;
+  if (vkCreateFence(device_, &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create fence!");
+  }
+  vkQueueSubmit(graphicsQueue_, 1, &submitInfo, fence);
+  vkWaitForFences(device_, 1, &fence, VK_TRUE, UINT64_MAX);
+  vkDestroyFence(device_, fence, nullptr);
 
   vkFreeCommandBuffers(device_, commandPool, 1, &commandBuffer);
 }
 
+uint64_t HeliosDevice::submitUpload(
+    const std::function<void(VkCommandBuffer)> &record) {
+  retireUploadCommandBuffers();
+
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandPool = transferCommandPool;
+  allocInfo.commandBufferCount = 1;
+  VkCommandBuffer commandBuffer;
+  if (vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate upload command buffer!");
+  }
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  vkBeginCommandBuffer(commandBuffer, &beginInfo);
+  record(commandBuffer);
+  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+    vkFreeCommandBuffers(device_, transferCommandPool, 1, &commandBuffer);
+    throw std::runtime_error("failed to record upload command buffer!");
+  }
+
+  uint64_t signalValue = lastUploadValue + 1;
+  VkTimelineSemaphoreSubmitInfo timelineInfo{};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timelineInfo.signalSemaphoreValueCount = 1;
+  timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.pNext = &timelineInfo;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer;
+  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.pSignalSemaphores = &uploadSemaphore_;
+  if (vkQueueSubmit(transferQueue_, 1, &submitInfo, VK_NULL_HANDLE) !=
+      VK_SUCCESS) {
+    vkFreeCommandBuffers(device_, transferCommandPool, 1, &commandBuffer);
+    throw std::runtime_error("failed to submit uploads!");
+  }
+
+  lastUploadValue = signalValue;
+  uploadCommandBuffers.emplace_back(signalValue, commandBuffer);
+  return signalValue;
+}
+
+uint64_t HeliosDevice::completedUploadValue() {
+  uint64_t value = 0;
+  vkGetSemaphoreCounterValue(device_, uploadSemaphore_, &value);
+  return value;
+}
+
+void HeliosDevice::waitForUpload(uint64_t value) {
+  VkSemaphoreWaitInfo waitInfo{};
+  waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  waitInfo.semaphoreCount = 1;
+  waitInfo.pSemaphores = &uploadSemaphore_;
+  waitInfo.pValues = &value;
+  vkWaitSemaphores(device_, &waitInfo, UINT64_MAX);
+}
+
+void HeliosDevice::retireUploadCommandBuffers() {
+  uint64_t completed = completedUploadValue();
+  auto it = uploadCommandBuffers.begin();
+  while (it != uploadCommandBuffers.end() && it->first <= completed) {
+    vkFreeCommandBuffers(device_, transferCommandPool, 1, &it->second);
+    ++it;
+  }
+  uploadCommandBuffers.erase(uploadCommandBuffers.begin(), it);
+}
+
 void HeliosDevice::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer,
                               VkDeviceSize size) {
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
   VkBufferCopy copyRegion{};
-  copyRegion.srcOffset = 0; // Optional
-  copyRegion.dstOffset = 0; // Optional
   copyRegion.size = size;
-  vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-  endSingleTimeCommands(commandBuffer);
+  HeliosUploadBatch batch{*this};
+  batch.copyBuffer(srcBuffer, dstBuffer, copyRegion);
+  batch.submitAndWait();
 }
 
 void HeliosDevice::copyBufferToImage(VkBuffer buffer, VkImage image,
                                      uint32_t width, uint32_t height,
                                      uint32_t layerCount) {
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
   VkBufferImageCopy region{};
   region.bufferOffset = 0;
   region.bufferRowLength = 0;
@@ -525,15 +711,14 @@ void HeliosDevice::copyBufferToImage(VkBuffer buffer, VkImage image,
   region.imageOffset = {0, 0, 0};
   region.imageExtent = {width, height, 1};
 
-  vkCmdCopyBufferToImage(commandBuffer, buffer, image,
-                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-  endSingleTimeCommands(commandBuffer);
+  HeliosUploadBatch batch{*this};
+  batch.copyBufferToImage(buffer, image, region);
+  batch.submitAndWait();
 }
 
-void HeliosDevice::createImageWithInfo(const VkImageCreateInfo &imageInfo,
-                                       VkMemoryPropertyFlags properties,
-                                       VkImage &image,
-                                       VkDeviceMemory &imageMemory) {
+void HeliosDevice::createImageWithInfo(
+    const VkImageCreateInfo &imageInfo, VkMemoryPropertyFlags properties,
+    VkImage &image, HeliosAllocator::Allocation &allocation) {
   if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS) {
     throw std::runtime_error("failed to create image!");
   }
@@ -541,20 +726,25 @@ void HeliosDevice::createImageWithInfo(const VkImageCreateInfo &imageInfo,
   VkMemoryRequirements memRequirements;
   vkGetImageMemoryRequirements(device_, image, &memRequirements);
 
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex =
-      findMemoryType(memRequirements.memoryTypeBits, properties);
-
-  if (vkAllocateMemory(device_, &allocInfo, nullptr, &imageMemory) !=
-      VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate image memory!");
+  try {
+    allocation = allocator_->allocate(
+        memRequirements, properties,
+        imageInfo.tiling == VK_IMAGE_TILING_OPTIMAL);
+  } catch (...) {
+    vkDestroyImage(device_, image, nullptr);
+    throw;
   }
 
-  if (vkBindImageMemory(device_, image, imageMemory, 0) != VK_SUCCESS) {
+  if (vkBindImageMemory(device_, image, allocation.memory,
+                        allocation.offset) != VK_SUCCESS) {
     throw std::runtime_error("failed to bind image memory!");
   }
 }
 
+void HeliosDevice::destroyImage(VkImage image,
+                                const HeliosAllocator::Allocation &allocation) {
+  vkDestroyImage(device_, image, nullptr);
+  allocator_->free(allocation);
+}
+
 } // namespace helios
@@ -1,9 +1,17 @@
 #pragma once
 
+#include "helios_allocator.hpp"
+#include "helios_geometry_arena.hpp"
+#include "helios_pipeline_cache.hpp"
+#include "helios_staging_ring.hpp"
 #include "helios_window.hpp"
 
 // std lib headers
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace helios {
@@ -17,8 +25,12 @@ struct SwapChainSupportDetails {
 struct QueueFamilyIndices {
   uint32_t graphicsFamily;
   uint32_t presentFamily;
+  // a family with transfer but neither graphics nor compute support, which
+  // usually maps to the copy engines
+  uint32_t transferFamily;
   bool graphicsFamilyHasValue = false;
   bool presentFamilyHasValue = false;
+  bool transferFamilyHasValue = false;
   bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
 };
 
@@ -44,6 +56,21 @@ public:
   VkSurfaceKHR surface() { return surface_; }
   VkQueue graphicsQueue() { return graphicsQueue_; }
   VkQueue presentQueue() { return presentQueue_; }
+  uint32_t graphicsQueueFamily() const { return graphicsFamily_; }
+  uint32_t transferQueueFamily() const { return transferFamily_; }
+  // true when uploads run on a queue family of their own, the buffers they
+  // write are then created with sharedWithTransferQueue
+  bool hasTransferQueue() const { return transferFamily_ != graphicsFamily_; }
+  HeliosAllocator &allocator() { return *allocator_; }
+  // the arena shared by all vertex buffers with these strides, created on
+  // first use
+  HeliosGeometryArena &geometryArena(uint32_t positionStride,
+                                     uint32_t attributeStride);
+  std::vector<HeliosGeometryArena::Stats> getGeometryArenaStats();
+  // shared staging memory for uploads
+  HeliosStagingRing &stagingRing() { return *stagingRing_; }
+  // used for every pipeline, persisted across runs
+  HeliosPipelineCache &pipelineCache() { return *pipelineCache_; }
 
   SwapChainSupportDetails getSwapChainSupport() {
     return querySwapChainSupport(physicalDevice);
@@ -58,20 +85,42 @@ public:
                                VkFormatFeatureFlags features);
 
   // Buffer Helper Functions
+  // sharedWithTransferQueue creates the buffer with concurrent sharing
+  // between the graphics and transfer families, for buffers both use
   void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
                     VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                    VkDeviceMemory &bufferMemory);
+                    HeliosAllocator::Allocation &allocation,
+                    bool sharedWithTransferQueue = false);
+  void destroyBuffer(VkBuffer buffer,
+                     const HeliosAllocator::Allocation &allocation);
   VkCommandBuffer beginSingleTimeCommands();
   void endSingleTimeCommands(VkCommandBuffer commandBuffer);
   void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
   void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width,
                          uint32_t height, uint32_t layerCount);
 
+  // Asynchronous uploads on the transfer queue, or the graphics queue when
+  // there is no separate transfer family. Records the copies with record,
+  // submits them without waiting and returns the value uploadSemaphore()
+  // reaches once they completed. Graphics submissions reading the uploaded
+  // data wait for that value. Call from a single thread.
+  uint64_t submitUpload(const std::function<void(VkCommandBuffer)> &record);
+  // timeline semaphore signalled by submitUpload
+  VkSemaphore uploadSemaphore() { return uploadSemaphore_; }
+  uint64_t completedUploadValue();
+  void waitForUpload(uint64_t value);
+
   void createImageWithInfo(const VkImageCreateInfo &imageInfo,
                            VkMemoryPropertyFlags properties, VkImage &image,
-                           VkDeviceMemory &imageMemory);
+                           HeliosAllocator::Allocation &allocation);
+  void destroyImage(VkImage image,
+                    const HeliosAllocator::Allocation &allocation);
 
   VkPhysicalDeviceProperties properties;
+  // optional features are enabled when the physical device supports them
+  VkPhysicalDeviceFeatures enabledFeatures{};
+  // Vulkan 1.2 drawIndirectCount, for vkCmdDrawIndexedIndirectCount
+  bool drawIndirectCountEnabled = false;
 
 private:
   void createInstance();
@@ -80,6 +129,8 @@ private:
   void pickPhysicalDevice();
   void createLogicalDevice();
   void createCommandPool();
+  void createUploadSemaphore();
+  void retireUploadCommandBuffers();
 
   // helper functions
   bool isDeviceSuitable(VkPhysicalDevice device);
@@ -102,6 +153,20 @@ private:
   VkSurfaceKHR surface_;
   VkQueue graphicsQueue_;
   VkQueue presentQueue_;
+  VkQueue transferQueue_;
+  uint32_t graphicsFamily_;
+  uint32_t transferFamily_;
+
+  VkCommandPool transferCommandPool;
+  VkSemaphore uploadSemaphore_;
+  uint64_t lastUploadValue = 0;
+  // submitted upload command buffers and the value they signal
+  std::vector<std::pair<uint64_t, VkCommandBuffer>> uploadCommandBuffers;
+  std::unique_ptr<HeliosAllocator> allocator_;
+  std::unique_ptr<HeliosStagingRing> stagingRing_;
+  std::unique_ptr<HeliosPipelineCache> pipelineCache_;
+  std::mutex geometryArenaMutex;
+  std::vector<std::unique_ptr<HeliosGeometryArena>> geometryArenas;
 
   const std::vector<const char *> validationLayers = {
       "VK_LAYER_KHRONOS_validation"};
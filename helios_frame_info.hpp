@@ -0,0 +1,30 @@
+#pragma once
+
+#include "helios_camera.hpp"
+
+// lib
+#include <vulkan/vulkan.h>
+
+namespace helios {
+
+// per frame data shared by every draw, matches GlobalUbo in
+// simple_shader.vert (std140)
+struct GlobalUbo {
+  glm::mat4 projection{1.f};
+  glm::mat4 view{1.f};
+  // w is the intensity
+  glm::vec4 ambientLightColor{1.f, 1.f, 1.f, .02f};
+  // w unused
+  glm::vec4 directionToLight{glm::normalize(glm::vec3{1.f, -3.f, -1.f}), 0.f};
+};
+
+struct FrameInfo {
+  int frameIndex;
+  float frameTime;
+  VkCommandBuffer commandBuffer;
+  HeliosCamera &camera;
+  // GlobalUbo of this frame in flight
+  VkDescriptorSet globalDescriptorSet;
+};
+
+} // namespace helios
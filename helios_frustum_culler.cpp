@@ -0,0 +1,135 @@
+#include "helios_frustum_culler.hpp"
+#include "helios_simd.hpp"
+
+namespace helios {
+
+void HeliosFrustumCuller::clear() {
+  centerX.clear();
+  centerY.clear();
+  centerZ.clear();
+  extentX.clear();
+  extentY.clear();
+  extentZ.clear();
+  boxCount = 0;
+}
+
+uint32_t HeliosFrustumCuller::addBox(const glm::vec3 &center,
+                                     const glm::vec3 &extent) {
+  // the padding of the previous box count is overwritten first
+  if (boxCount % LANES == 0) {
+    size_t size = boxCount + LANES;
+    centerX.resize(size, 0.f);
+    centerY.resize(size, 0.f);
+    centerZ.resize(size, 0.f);
+    extentX.resize(size, 0.f);
+    extentY.resize(size, 0.f);
+    extentZ.resize(size, 0.f);
+  }
+  centerX[boxCount] = center.x;
+  centerY[boxCount] = center.y;
+  centerZ[boxCount] = center.z;
+  extentX[boxCount] = extent.x;
+  extentY[boxCount] = extent.y;
+  extentZ[boxCount] = extent.z;
+  return boxCount++;
+}
+
+// A box is outside a plane when its center is further behind it than the
+// box reaches along the normal: dot(n, c) + w <= -dot(|n|, e).
+uint32_t HeliosFrustumCuller::cull(const std::array<glm::vec4, 6> &planes) {
+  visible.resize(centerX.size());
+  uint32_t visibleCount = 0;
+
+#if HELIOS_SIMD_SSE2
+  __m128 normalX[6], normalY[6], normalZ[6], distance[6];
+  __m128 absX[6], absY[6], absZ[6];
+  for (int p = 0; p < 6; p++) {
+    normalX[p] = _mm_set1_ps(planes[p].x);
+    normalY[p] = _mm_set1_ps(planes[p].y);
+    normalZ[p] = _mm_set1_ps(planes[p].z);
+    distance[p] = _mm_set1_ps(planes[p].w);
+    absX[p] = _mm_set1_ps(glm::abs(planes[p].x));
+    absY[p] = _mm_set1_ps(glm::abs(planes[p].y));
+    absZ[p] = _mm_set1_ps(glm::abs(planes[p].z));
+  }
+  const __m128 zero = _mm_setzero_ps();
+  for (size_t i = 0; i < boxCount; i += LANES) {
+    __m128 cx = _mm_loadu_ps(&centerX[i]);
+    __m128 cy = _mm_loadu_ps(&centerY[i]);
+    __m128 cz = _mm_loadu_ps(&centerZ[i]);
+    __m128 ex = _mm_loadu_ps(&extentX[i]);
+    __m128 ey = _mm_loadu_ps(&extentY[i]);
+    __m128 ez = _mm_loadu_ps(&extentZ[i]);
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int p = 0; p < 6; p++) {
+      __m128 d = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(normalX[p], cx), _mm_mul_ps(normalY[p], cy)),
+          _mm_add_ps(_mm_mul_ps(normalZ[p], cz), distance[p]));
+      __m128 r = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)),
+          _mm_mul_ps(absZ[p], ez));
+      inside = _mm_and_ps(inside, _mm_cmpgt_ps(_mm_add_ps(d, r), zero));
+    }
+    int mask = _mm_movemask_ps(inside);
+    for (size_t lane = 0; lane < LANES; lane++) {
+      visible[i + lane] = static_cast<uint8_t>((mask >> lane) & 1);
+    }
+  }
+#elif HELIOS_SIMD_NEON
+  float32x4_t normalX[6], normalY[6], normalZ[6], distance[6];
+  float32x4_t absX[6], absY[6], absZ[6];
+  for (int p = 0; p < 6; p++) {
+    normalX[p] = vdupq_n_f32(planes[p].x);
+    normalY[p] = vdupq_n_f32(planes[p].y);
+    normalZ[p] = vdupq_n_f32(planes[p].z);
+    distance[p] = vdupq_n_f32(planes[p].w);
+    absX[p] = vdupq_n_f32(glm::abs(planes[p].x));
+    absY[p] = vdupq_n_f32(glm::abs(planes[p].y));
+    absZ[p] = vdupq_n_f32(glm::abs(planes[p].z));
+  }
+  const float32x4_t zero = vdupq_n_f32(0.f);
+  for (size_t i = 0; i < boxCount; i += LANES) {
+    float32x4_t cx = vld1q_f32(&centerX[i]);
+    float32x4_t cy = vld1q_f32(&centerY[i]);
+    float32x4_t cz = vld1q_f32(&centerZ[i]);
+    float32x4_t ex = vld1q_f32(&extentX[i]);
+    float32x4_t ey = vld1q_f32(&extentY[i]);
+    float32x4_t ez = vld1q_f32(&extentZ[i]);
+    uint32x4_t inside = vdupq_n_u32(~0u);
+    for (int p = 0; p < 6; p++) {
+      float32x4_t d = vmlaq_f32(distance[p], normalX[p], cx);
+      d = vmlaq_f32(d, normalY[p], cy);
+      d = vmlaq_f32(d, normalZ[p], cz);
+      d = vmlaq_f32(d, absX[p], ex);
+      d = vmlaq_f32(d, absY[p], ey);
+      d = vmlaq_f32(d, absZ[p], ez);
+      inside = vandq_u32(inside, vcgtq_f32(d, zero));
+    }
+    uint32_t lanes[LANES];
+    vst1q_u32(lanes, inside);
+    for (size_t lane = 0; lane < LANES; lane++) {
+      visible[i + lane] = static_cast<uint8_t>(lanes[lane] & 1);
+    }
+  }
+#else
+  for (size_t i = 0; i < boxCount; i++) {
+    bool inside = true;
+    for (const auto &plane : planes) {
+      float d = plane.x * centerX[i] + plane.y * centerY[i] +
+                plane.z * centerZ[i] + plane.w;
+      float r = glm::abs(plane.x) * extentX[i] +
+                glm::abs(plane.y) * extentY[i] +
+                glm::abs(plane.z) * extentZ[i];
+      inside = inside && d + r > 0.f;
+    }
+    visible[i] = inside ? 1 : 0;
+  }
+#endif
+
+  for (size_t i = 0; i < boxCount; i++) {
+    visibleCount += visible[i];
+  }
+  return visibleCount;
+}
+
+} // namespace helios
@@ -0,0 +1,41 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_FORCE_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace helios {
+
+// Tests many axis aligned boxes against a frustum at once. Boxes are kept as
+// structure of arrays, so the SIMD paths of helios_simd.hpp test four boxes
+// per iteration; the arrays are padded to a multiple of four.
+class HeliosFrustumCuller {
+public:
+  static constexpr size_t LANES = 4;
+
+  void clear();
+  // returns the index of the box
+  uint32_t addBox(const glm::vec3 &center, const glm::vec3 &extent);
+  uint32_t getBoxCount() const { return boxCount; }
+
+  // Tests every box against planes with inward pointing normals, like
+  // HeliosCamera::getFrustumPlanes. Boxes outside a plane are culled, the
+  // test is conservative for boxes crossing the corners of the frustum.
+  // Returns the number of visible boxes.
+  uint32_t cull(const std::array<glm::vec4, 6> &planes);
+  // result of the last cull call
+  bool isVisible(uint32_t box) const { return visible[box] != 0; }
+
+private:
+  std::vector<float> centerX, centerY, centerZ;
+  std::vector<float> extentX, extentY, extentZ;
+  std::vector<uint8_t> visible;
+  uint32_t boxCount = 0;
+};
+
+} // namespace helios
@@ -56,4 +56,28 @@ glm::mat3 TransformComponent::normalMatrix() {
                    }};
 }
 
+HeliosModel::Bounds
+TransformComponent::worldBounds(const HeliosModel::Bounds &modelBounds) {
+  glm::mat4 transform = mat4();
+  glm::vec3 boxCenter = (modelBounds.min + modelBounds.max) * 0.5f;
+  glm::vec3 boxExtent = (modelBounds.max - modelBounds.min) * 0.5f;
+
+  // Arvo: the extent along each world axis is the absolute transform
+  // applied to the extent
+  glm::mat3 absolute{glm::abs(glm::vec3{transform[0]}),
+                     glm::abs(glm::vec3{transform[1]}),
+                     glm::abs(glm::vec3{transform[2]})};
+  glm::vec3 worldCenter{transform * glm::vec4{boxCenter, 1.f}};
+  glm::vec3 worldExtent = absolute * boxExtent;
+
+  glm::vec3 absScale = glm::abs(scale);
+  HeliosModel::Bounds result{};
+  result.min = worldCenter - worldExtent;
+  result.max = worldCenter + worldExtent;
+  result.center = glm::vec3{transform * glm::vec4{modelBounds.center, 1.f}};
+  result.radius = modelBounds.radius *
+                  glm::max(absScale.x, glm::max(absScale.y, absScale.z));
+  return result;
+}
+
 } // namespace helios
@@ -17,6 +17,9 @@ struct TransformComponent {
 
   glm::mat4 mat4();
   glm::mat3 normalMatrix();
+  // world space bounds of a model with modelBounds: the box enclosing the
+  // transformed box and the sphere scaled by the largest axis scale
+  HeliosModel::Bounds worldBounds(const HeliosModel::Bounds &modelBounds);
 };
 
 class HeliosGameObject {
@@ -0,0 +1,204 @@
+#include "helios_geometry_arena.hpp"
+#include "helios_device.hpp"
+
+// std
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+namespace helios {
+
+HeliosGeometryArena::FreeList::FreeList(uint64_t capacity)
+    : capacity{capacity}, freeSize{capacity} {
+  if (capacity > 0) {
+    ranges.emplace(0, capacity);
+  }
+}
+
+bool HeliosGeometryArena::FreeList::allocate(uint64_t size,
+                                             uint64_t &offset) {
+  if (size == 0) {
+    offset = 0;
+    return true;
+  }
+  for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+    if (it->second < size) {
+      continue;
+    }
+    offset = it->first;
+    uint64_t remaining = it->second - size;
+    ranges.erase(it);
+    if (remaining > 0) {
+      ranges.emplace(offset + size, remaining);
+    }
+    freeSize -= size;
+    return true;
+  }
+  return false;
+}
+
+void HeliosGeometryArena::FreeList::free(uint64_t offset, uint64_t size) {
+  if (size == 0) {
+    return;
+  }
+  freeSize += size;
+  auto next = ranges.lower_bound(offset);
+  // merge with the neighbours it touches
+  if (next != ranges.end() && offset + size == next->first) {
+    size += next->second;
+    next = ranges.erase(next);
+  }
+  if (next != ranges.begin()) {
+    auto previous = std::prev(next);
+    if (previous->first + previous->second == offset) {
+      previous->second += size;
+      return;
+    }
+  }
+  ranges.emplace_hint(next, offset, size);
+}
+
+HeliosGeometryArena::HeliosGeometryArena(HeliosDevice &device,
+                                         uint32_t positionStride,
+                                         uint32_t attributeStride)
+    : heliosDevice{device}, positionStride{positionStride},
+      attributeStride{attributeStride} {}
+
+HeliosGeometryArena::~HeliosGeometryArena() {
+  for (auto &block : blocks) {
+    if (block) {
+      destroyBlock(*block);
+    }
+  }
+}
+
+uint32_t HeliosGeometryArena::createBlock(uint32_t vertexCapacity,
+                                          VkDeviceSize indexCapacity) {
+  auto block = std::make_unique<Block>(vertexCapacity, indexCapacity);
+  // The transfer queue writes new ranges while the graphics queue reads the
+  // others, so the blocks can't be owned by either family.
+  try {
+    heliosDevice.createBuffer(
+        VkDeviceSize{positionStride} * vertexCapacity,
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, block->positionBuffer,
+        block->positionAllocation, true);
+    heliosDevice.createBuffer(
+        VkDeviceSize{attributeStride} * vertexCapacity,
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, block->attributeBuffer,
+        block->attributeAllocation, true);
+    heliosDevice.createBuffer(
+        indexCapacity,
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, block->indexBuffer,
+        block->indexAllocation, true);
+  } catch (...) {
+    destroyBlock(*block);
+    throw;
+  }
+
+  auto slot = std::find(blocks.begin(), blocks.end(), nullptr);
+  if (slot != blocks.end()) {
+    *slot = std::move(block);
+    return static_cast<uint32_t>(slot - blocks.begin());
+  }
+  blocks.push_back(std::move(block));
+  return static_cast<uint32_t>(blocks.size() - 1);
+}
+
+void HeliosGeometryArena::destroyBlock(Block &block) {
+  if (block.positionBuffer != VK_NULL_HANDLE) {
+    heliosDevice.destroyBuffer(block.positionBuffer, block.positionAllocation);
+  }
+  if (block.attributeBuffer != VK_NULL_HANDLE) {
+    heliosDevice.destroyBuffer(block.attributeBuffer,
+                               block.attributeAllocation);
+  }
+  if (block.indexBuffer != VK_NULL_HANDLE) {
+    heliosDevice.destroyBuffer(block.indexBuffer, block.indexAllocation);
+  }
+}
+
+HeliosGeometryArena::Range
+HeliosGeometryArena::allocate(uint32_t vertexCount, VkDeviceSize indexSize) {
+  const VkDeviceSize alignedIndexSize = (indexSize + 3) & ~VkDeviceSize{3};
+  std::lock_guard<std::mutex> lock{mutex};
+
+  uint64_t firstVertex = 0;
+  uint64_t indexOffset = 0;
+  uint32_t blockIndex = 0;
+  for (; blockIndex < blocks.size(); blockIndex++) {
+    auto &block = blocks[blockIndex];
+    if (!block || !block->vertices.allocate(vertexCount, firstVertex)) {
+      continue;
+    }
+    if (block->indices.allocate(alignedIndexSize, indexOffset)) {
+      break;
+    }
+    block->vertices.free(firstVertex, vertexCount);
+  }
+  if (blockIndex == blocks.size()) {
+    // never empty, Vulkan has no zero sized buffers
+    blockIndex = createBlock(
+        std::max(vertexCount, BLOCK_VERTEX_COUNT),
+        std::max({alignedIndexSize, BLOCK_INDEX_SIZE, VkDeviceSize{4}}));
+    blocks[blockIndex]->vertices.allocate(vertexCount, firstVertex);
+    blocks[blockIndex]->indices.allocate(alignedIndexSize, indexOffset);
+  }
+
+  Block &block = *blocks[blockIndex];
+  block.rangeCount++;
+  Range range{};
+  range.positionBuffer = block.positionBuffer;
+  range.attributeBuffer = block.attributeBuffer;
+  range.indexBuffer = block.indexBuffer;
+  range.block = blockIndex;
+  range.firstVertex = static_cast<uint32_t>(firstVertex);
+  range.vertexCount = vertexCount;
+  range.indexOffset = indexOffset;
+  range.indexSize = indexSize;
+  return range;
+}
+
+void HeliosGeometryArena::free(const Range &range) {
+  if (range.positionBuffer == VK_NULL_HANDLE) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock{mutex};
+
+  auto &block = blocks[range.block];
+  block->vertices.free(range.firstVertex, range.vertexCount);
+  block->indices.free(range.indexOffset,
+                      (range.indexSize + 3) & ~VkDeviceSize{3});
+
+  // like HeliosAllocator, the last block stays around even when empty
+  if (--block->rangeCount == 0 &&
+      std::count_if(blocks.begin(), blocks.end(),
+                    [](const auto &b) { return b != nullptr; }) > 1) {
+    destroyBlock(*block);
+    block.reset();
+  }
+}
+
+HeliosGeometryArena::Stats HeliosGeometryArena::getStats() const {
+  std::lock_guard<std::mutex> lock{mutex};
+
+  Stats stats{};
+  for (const auto &block : blocks) {
+    if (!block) {
+      continue;
+    }
+    stats.blockCount++;
+    stats.rangeCount += block->rangeCount;
+    stats.vertexCapacity += block->vertices.getCapacity();
+    stats.vertexCount +=
+        block->vertices.getCapacity() - block->vertices.getFreeSize();
+    stats.indexCapacity += block->indices.getCapacity();
+    stats.indexSize +=
+        block->indices.getCapacity() - block->indices.getFreeSize();
+  }
+  return stats;
+}
+
+} // namespace helios
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "helios_allocator.hpp"
+#include "vulkan/vulkan_core.h"
+
+// std
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace helios {
+
+class HeliosDevice;
+
+// Shared vertex and index buffers for every model of one vertex format.
+// Models own a range of them instead of buffers of their own and draw with
+// their firstVertex as vertexOffset and their index offset folded into
+// firstIndex, so consecutive models need no rebinding. A block holds the
+// position and attribute streams and an index buffer; models that don't fit
+// into a free range get a new block, models larger than a whole block one
+// sized for them alone. Index ranges are byte ranges aligned to 4, so 16
+// and 32 bit indices share the index buffer and only the bound index type
+// differs.
+class HeliosGeometryArena {
+public:
+  static constexpr uint32_t BLOCK_VERTEX_COUNT = 1u << 20;
+  static constexpr VkDeviceSize BLOCK_INDEX_SIZE = VkDeviceSize{16} << 20;
+
+  struct Range {
+    VkBuffer positionBuffer = VK_NULL_HANDLE;
+    VkBuffer attributeBuffer = VK_NULL_HANDLE;
+    VkBuffer indexBuffer = VK_NULL_HANDLE;
+    uint32_t block = 0;
+    // the vertexOffset of the draws
+    uint32_t firstVertex = 0;
+    uint32_t vertexCount = 0;
+    // in bytes, a multiple of 4
+    VkDeviceSize indexOffset = 0;
+    VkDeviceSize indexSize = 0;
+  };
+
+  struct Stats {
+    uint32_t blockCount = 0;
+    uint32_t rangeCount = 0;
+    uint64_t vertexCapacity = 0;
+    uint64_t vertexCount = 0;
+    VkDeviceSize indexCapacity = 0;
+    VkDeviceSize indexSize = 0;
+  };
+
+  HeliosGeometryArena(HeliosDevice &device, uint32_t positionStride,
+                      uint32_t attributeStride);
+  ~HeliosGeometryArena();
+
+  HeliosGeometryArena(const HeliosGeometryArena &) = delete;
+  HeliosGeometryArena &operator=(const HeliosGeometryArena &) = delete;
+
+  Range allocate(uint32_t vertexCount, VkDeviceSize indexSize);
+  // the range must no longer be read by pending command buffers
+  void free(const Range &range);
+
+  uint32_t getPositionStride() const { return positionStride; }
+  uint32_t getAttributeStride() const { return attributeStride; }
+
+  Stats getStats() const;
+
+private:
+  // first fit list of free [offset, offset + size) ranges, keyed by offset
+  class FreeList {
+  public:
+    explicit FreeList(uint64_t capacity);
+    bool allocate(uint64_t size, uint64_t &offset);
+    void free(uint64_t offset, uint64_t size);
+    uint64_t getCapacity() const { return capacity; }
+    uint64_t getFreeSize() const { return freeSize; }
+
+  private:
+    std::map<uint64_t, uint64_t> ranges;
+    uint64_t capacity;
+    uint64_t freeSize;
+  };
+
+  struct Block {
+    Block(uint64_t vertexCapacity, VkDeviceSize indexCapacity)
+        : vertices{vertexCapacity}, indices{indexCapacity} {}
+
+    VkBuffer positionBuffer = VK_NULL_HANDLE;
+    HeliosAllocator::Allocation positionAllocation{};
+    VkBuffer attributeBuffer = VK_NULL_HANDLE;
+    HeliosAllocator::Allocation attributeAllocation{};
+    VkBuffer indexBuffer = VK_NULL_HANDLE;
+    HeliosAllocator::Allocation indexAllocation{};
+    FreeList vertices;
+    FreeList indices;
+    uint32_t rangeCount = 0;
+  };
+
+  uint32_t createBlock(uint32_t vertexCapacity, VkDeviceSize indexCapacity);
+  void destroyBlock(Block &block);
+
+  HeliosDevice &heliosDevice;
+  uint32_t positionStride;
+  uint32_t attributeStride;
+
+  mutable std::mutex mutex;
+  // null slots are released blocks, reused by the next one
+  std::vector<std::unique_ptr<Block>> blocks;
+};
+
+} // namespace helios
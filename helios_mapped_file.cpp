@@ -0,0 +1,48 @@
+#include "helios_mapped_file.hpp"
+
+// std
+#include <stdexcept>
+
+// posix
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace helios {
+
+HeliosMappedFile::HeliosMappedFile(const std::string &filepath) {
+  int fd = open(filepath.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("failed to open file: " + filepath);
+  }
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0) {
+    close(fd);
+    throw std::runtime_error("failed to stat file: " + filepath);
+  }
+  size_ = static_cast<size_t>(fileStat.st_size);
+
+  // mmap of a zero length range is an error, leave empty files unmapped
+  if (size_ > 0) {
+    void *mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("failed to map file: " + filepath);
+    }
+    madvise(mapping, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const char *>(mapping);
+  }
+
+  // the mapping keeps its own reference to the file
+  close(fd);
+}
+
+HeliosMappedFile::~HeliosMappedFile() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char *>(data_), size_);
+  }
+}
+
+} // namespace helios
@@ -0,0 +1,26 @@
+#pragma once
+
+// std
+#include <cstddef>
+#include <string>
+
+namespace helios {
+
+// read-only memory mapping of a whole file, unmapped on destruction
+class HeliosMappedFile {
+public:
+  HeliosMappedFile(const std::string &filepath);
+  ~HeliosMappedFile();
+
+  HeliosMappedFile(const HeliosMappedFile &) = delete;
+  HeliosMappedFile &operator=(const HeliosMappedFile &) = delete;
+
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+} // namespace helios
@@ -0,0 +1,369 @@
+#include "helios_mesh_cache.hpp"
+#include "helios_utils.hpp"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace helios {
+
+namespace {
+
+constexpr uint64_t BLOB_ALIGNMENT = 16;
+constexpr uint64_t COPY_BUFFER_SIZE = 1 << 20;
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+int64_t sourceMtime(const std::string &sourcePath) {
+  return static_cast<int64_t>(std::filesystem::last_write_time(sourcePath)
+                                  .time_since_epoch()
+                                  .count());
+}
+
+uint64_t sourceHash(const std::string &sourcePath) {
+  HeliosMappedFile source{sourcePath};
+  return hashBytes(source.data(), source.size());
+}
+
+HeliosModel::VertexFormat vertexFormatFor(uint32_t buildFlags) {
+  return buildFlags & HeliosMeshCache::BUILD_PACKED
+             ? HeliosModel::VertexFormat::Packed
+             : HeliosModel::VertexFormat::Float;
+}
+
+uint64_t submeshRangeCount(const HeliosMeshCache::Header &h) {
+  return uint64_t{std::max(h.lodCount, 1u)} * h.submeshCount;
+}
+
+// Copies a blob into out, spilled blobs in bounded pieces so they never
+// have to fit in memory.
+void writeBlob(std::ofstream &out, const HeliosMeshCache::Blob &blob) {
+  if (blob.path == nullptr) {
+    out.write(static_cast<const char *>(blob.data),
+              static_cast<std::streamsize>(blob.size));
+    return;
+  }
+  std::ifstream in{*blob.path, std::ios::binary};
+  std::vector<char> buffer(std::min<uint64_t>(blob.size, COPY_BUFFER_SIZE));
+  for (uint64_t copied = 0; copied < blob.size;) {
+    auto size = static_cast<std::streamsize>(
+        std::min<uint64_t>(blob.size - copied, buffer.size()));
+    if (!in.read(buffer.data(), size)) {
+      throw std::runtime_error("failed to read spilled mesh data: " +
+                               *blob.path);
+    }
+    out.write(buffer.data(), size);
+    copied += static_cast<uint64_t>(size);
+  }
+}
+
+std::vector<HeliosMeshCache::AttributeDescriptor>
+currentLayout(uint32_t buildFlags) {
+  std::vector<HeliosMeshCache::AttributeDescriptor> layout{};
+  auto attributes = buildFlags & HeliosMeshCache::BUILD_PACKED
+                        ? HeliosModel::PackedVertex::getAttributeDescriptions()
+                        : HeliosModel::Vertex::getAttributeDescriptions();
+  for (const auto &attribute : attributes) {
+    layout.push_back({attribute.location,
+                      static_cast<uint32_t>(attribute.format),
+                      attribute.offset, attribute.binding});
+  }
+  return layout;
+}
+
+} // namespace
+
+std::unique_ptr<HeliosMeshCache>
+HeliosMeshCache::open(const std::string &cachePath,
+                      const std::string &sourcePath,
+                      uint32_t buildFlags) {
+  std::error_code error;
+  if (!std::filesystem::is_regular_file(cachePath, error)) {
+    return nullptr;
+  }
+
+  std::unique_ptr<HeliosMeshCache> cache{new HeliosMeshCache(cachePath)};
+  if (!cache->isValid(sourcePath, buildFlags)) {
+    return nullptr;
+  }
+  return cache;
+}
+
+bool HeliosMeshCache::isValid(const std::string &sourcePath,
+                              uint32_t buildFlags) const {
+  if (file.size() < sizeof(Header)) {
+    return false;
+  }
+
+  const Header &h = header();
+  if (memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.version != VERSION ||
+      h.buildFlags != buildFlags) {
+    return false;
+  }
+
+  auto layout = currentLayout(buildFlags);
+  auto format = vertexFormatFor(buildFlags);
+  if (h.positionStride != HeliosModel::positionStrideFor(format) ||
+      h.attributeStride != HeliosModel::attributeStrideFor(format) ||
+      h.attributeCount != layout.size()) {
+    return false;
+  }
+
+  uint64_t attributeEnd =
+      h.attributeOffset + h.attributeCount * sizeof(AttributeDescriptor);
+  uint64_t positionEnd =
+      h.positionOffset + uint64_t{h.vertexCount} * h.positionStride;
+  uint64_t vertexAttributeEnd =
+      h.vertexAttributeOffset + uint64_t{h.vertexCount} * h.attributeStride;
+  uint64_t indexEnd = h.indexOffset + uint64_t{h.indexCount} * sizeof(uint32_t);
+  uint64_t meshletEnd = h.meshletOffset + uint64_t{h.meshletCount} *
+                                              sizeof(HeliosModel::Meshlet);
+  uint64_t lodEnd =
+      h.lodOffset + uint64_t{h.lodCount} * sizeof(HeliosModel::Lod);
+  uint64_t submeshRangeEnd = h.submeshRangeOffset +
+                             submeshRangeCount(h) *
+                                 sizeof(HeliosModel::SubmeshRange);
+  uint64_t submeshNameEnd = h.submeshNameOffset + h.submeshNamesSize;
+  if (attributeEnd > file.size() || positionEnd > file.size() ||
+      vertexAttributeEnd > file.size() || indexEnd > file.size() ||
+      meshletEnd > file.size() || lodEnd > file.size() ||
+      submeshRangeEnd > file.size() || submeshNameEnd > file.size() ||
+      h.positionOffset % BLOB_ALIGNMENT != 0 ||
+      h.vertexAttributeOffset % BLOB_ALIGNMENT != 0 ||
+      h.indexOffset % BLOB_ALIGNMENT != 0 ||
+      h.meshletOffset % BLOB_ALIGNMENT != 0 ||
+      h.lodOffset % BLOB_ALIGNMENT != 0 ||
+      h.submeshRangeOffset % BLOB_ALIGNMENT != 0) {
+    return false;
+  }
+
+  // a name and a material string per submesh
+  const char *names = file.data() + h.submeshNameOffset;
+  if (std::count(names, names + h.submeshNamesSize, '\0') !=
+          2 * h.submeshCount ||
+      (h.submeshNamesSize > 0 && names[h.submeshNamesSize - 1] != '\0')) {
+    return false;
+  }
+
+  if (memcmp(file.data() + h.attributeOffset, layout.data(),
+             layout.size() * sizeof(AttributeDescriptor)) != 0) {
+    return false;
+  }
+
+  std::error_code error;
+  uint64_t size = std::filesystem::file_size(sourcePath, error);
+  if (error || size != h.sourceSize) {
+    return false;
+  }
+
+  // an untouched source is trusted without reading it, a touched one (e.g.
+  // after a checkout) is only stale if its contents actually changed
+  if (sourceMtime(sourcePath) == h.sourceMtime) {
+    return true;
+  }
+  return sourceHash(sourcePath) == h.sourceHash;
+}
+
+void HeliosMeshCache::write(const std::string &cachePath,
+                            const std::string &sourcePath,
+                            const HeliosModel::Builder &builder,
+                            uint32_t buildFlags) {
+  auto bounds = builder.computeBounds();
+  std::vector<uint8_t> positions{};
+  std::vector<uint8_t> attributes{};
+  builder.writeVertexStreams(bounds, positions, attributes);
+
+  Header h{};
+  h.vertexCount = static_cast<uint32_t>(builder.vertices.size());
+  h.indexCount = static_cast<uint32_t>(builder.indices.size());
+  h.meshletCount = static_cast<uint32_t>(builder.meshlets.size());
+  h.lodCount = static_cast<uint32_t>(builder.lods.size());
+  h.submeshCount = static_cast<uint32_t>(builder.submeshes.size());
+  if (submeshRangeCount(h) != builder.submeshRanges.size()) {
+    throw std::runtime_error("submesh ranges do not match the lods");
+  }
+
+  Blobs blobs{};
+  blobs.positions = {positions.data(), positions.size()};
+  blobs.attributes = {attributes.data(), attributes.size()};
+  blobs.indices = {builder.indices.data(),
+                   builder.indices.size() * sizeof(uint32_t)};
+  blobs.meshlets = {builder.meshlets.data(),
+                    builder.meshlets.size() * sizeof(HeliosModel::Meshlet)};
+  blobs.lods = {builder.lods.data(),
+                builder.lods.size() * sizeof(HeliosModel::Lod)};
+  blobs.submeshRanges = {builder.submeshRanges.data(),
+                         builder.submeshRanges.size() *
+                             sizeof(HeliosModel::SubmeshRange)};
+  writeFile(cachePath, sourcePath, buildFlags, bounds, builder.submeshes, h,
+            blobs);
+}
+
+void HeliosMeshCache::write(const std::string &cachePath,
+                            const std::string &sourcePath,
+                            const SpilledMesh &mesh, uint32_t buildFlags) {
+  auto format = vertexFormatFor(buildFlags);
+
+  Header h{};
+  h.vertexCount = mesh.vertexCount;
+  h.indexCount = mesh.indexCount;
+  h.submeshCount = static_cast<uint32_t>(mesh.submeshes.size());
+  if (submeshRangeCount(h) != mesh.submeshRanges.size()) {
+    throw std::runtime_error("submesh ranges do not match the lods");
+  }
+
+  Blobs blobs{};
+  blobs.positions.path = &mesh.positionPath;
+  blobs.positions.size =
+      uint64_t{mesh.vertexCount} * HeliosModel::positionStrideFor(format);
+  blobs.attributes.path = &mesh.attributePath;
+  blobs.attributes.size =
+      uint64_t{mesh.vertexCount} * HeliosModel::attributeStrideFor(format);
+  blobs.indices.path = &mesh.indexPath;
+  blobs.indices.size = uint64_t{mesh.indexCount} * sizeof(uint32_t);
+  blobs.submeshRanges = {mesh.submeshRanges.data(),
+                         mesh.submeshRanges.size() *
+                             sizeof(HeliosModel::SubmeshRange)};
+  writeFile(cachePath, sourcePath, buildFlags, mesh.bounds, mesh.submeshes, h,
+            blobs);
+}
+
+void HeliosMeshCache::writeFile(
+    const std::string &cachePath, const std::string &sourcePath,
+    uint32_t buildFlags, const HeliosModel::Bounds &bounds,
+    const std::vector<HeliosModel::Submesh> &submeshes, Header &h,
+    const Blobs &blobs) {
+  auto layout = currentLayout(buildFlags);
+  auto format = vertexFormatFor(buildFlags);
+
+  std::string submeshNames{};
+  for (const auto &submesh : submeshes) {
+    submeshNames.append(submesh.name).push_back('\0');
+    submeshNames.append(submesh.material).push_back('\0');
+  }
+
+  memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.version = VERSION;
+  h.sourceSize = std::filesystem::file_size(sourcePath);
+  h.sourceMtime = sourceMtime(sourcePath);
+  h.sourceHash = sourceHash(sourcePath);
+  h.positionStride = HeliosModel::positionStrideFor(format);
+  h.attributeStride = HeliosModel::attributeStrideFor(format);
+  h.attributeCount = static_cast<uint32_t>(layout.size());
+  h.buildFlags = buildFlags;
+  h.submeshNamesSize = static_cast<uint32_t>(submeshNames.size());
+  for (int i = 0; i < 3; i++) {
+    h.boundsMin[i] = bounds.min[i];
+    h.boundsMax[i] = bounds.max[i];
+    h.boundingSphere[i] = bounds.center[i];
+  }
+  h.boundingSphere[3] = bounds.radius;
+  h.attributeOffset = sizeof(Header);
+  h.positionOffset = alignUp(
+      h.attributeOffset + layout.size() * sizeof(AttributeDescriptor),
+      BLOB_ALIGNMENT);
+  h.vertexAttributeOffset =
+      alignUp(h.positionOffset + blobs.positions.size, BLOB_ALIGNMENT);
+  h.indexOffset =
+      alignUp(h.vertexAttributeOffset + blobs.attributes.size, BLOB_ALIGNMENT);
+  h.meshletOffset = alignUp(h.indexOffset + blobs.indices.size, BLOB_ALIGNMENT);
+  h.lodOffset = alignUp(h.meshletOffset + blobs.meshlets.size, BLOB_ALIGNMENT);
+  h.submeshRangeOffset =
+      alignUp(h.lodOffset + blobs.lods.size, BLOB_ALIGNMENT);
+  h.submeshNameOffset = h.submeshRangeOffset + blobs.submeshRanges.size;
+
+  const std::string tempPath = cachePath + ".tmp";
+  {
+    std::ofstream out{tempPath, std::ios::binary | std::ios::trunc};
+    if (!out.is_open()) {
+      throw std::runtime_error("failed to open file: " + tempPath);
+    }
+
+    const char padding[BLOB_ALIGNMENT] = {};
+    auto padTo = [&](uint64_t offset) {
+      out.write(padding, static_cast<std::streamsize>(
+                             offset - static_cast<uint64_t>(out.tellp())));
+    };
+
+    out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    out.write(reinterpret_cast<const char *>(layout.data()),
+              layout.size() * sizeof(AttributeDescriptor));
+    padTo(h.positionOffset);
+    writeBlob(out, blobs.positions);
+    padTo(h.vertexAttributeOffset);
+    writeBlob(out, blobs.attributes);
+    padTo(h.indexOffset);
+    writeBlob(out, blobs.indices);
+    padTo(h.meshletOffset);
+    writeBlob(out, blobs.meshlets);
+    padTo(h.lodOffset);
+    writeBlob(out, blobs.lods);
+    padTo(h.submeshRangeOffset);
+    writeBlob(out, blobs.submeshRanges);
+    out.write(submeshNames.data(), submeshNames.size());
+
+    if (!out.good()) {
+      throw std::runtime_error("failed to write mesh cache: " + tempPath);
+    }
+  }
+
+  std::filesystem::rename(tempPath, cachePath);
+}
+
+const void *HeliosMeshCache::positions() const {
+  return file.data() + header().positionOffset;
+}
+
+const void *HeliosMeshCache::vertexAttributes() const {
+  return file.data() + header().vertexAttributeOffset;
+}
+
+const uint32_t *HeliosMeshCache::indices() const {
+  return reinterpret_cast<const uint32_t *>(file.data() +
+                                            header().indexOffset);
+}
+
+const HeliosModel::Meshlet *HeliosMeshCache::meshlets() const {
+  return reinterpret_cast<const HeliosModel::Meshlet *>(
+      file.data() + header().meshletOffset);
+}
+
+const HeliosModel::Lod *HeliosMeshCache::lods() const {
+  return reinterpret_cast<const HeliosModel::Lod *>(file.data() +
+                                                    header().lodOffset);
+}
+
+std::vector<HeliosModel::Submesh> HeliosMeshCache::submeshes() const {
+  const Header &h = header();
+  std::vector<HeliosModel::Submesh> result(h.submeshCount);
+  // isValid checked the blob holds exactly two strings per submesh
+  const char *next = file.data() + h.submeshNameOffset;
+  for (auto &submesh : result) {
+    submesh.name = next;
+    next += submesh.name.size() + 1;
+    submesh.material = next;
+    next += submesh.material.size() + 1;
+  }
+  return result;
+}
+
+const HeliosModel::SubmeshRange *HeliosMeshCache::submeshRanges() const {
+  return reinterpret_cast<const HeliosModel::SubmeshRange *>(
+      file.data() + header().submeshRangeOffset);
+}
+
+HeliosModel::Bounds HeliosMeshCache::bounds() const {
+  const Header &h = header();
+  return {{h.boundsMin[0], h.boundsMin[1], h.boundsMin[2]},
+          {h.boundsMax[0], h.boundsMax[1], h.boundsMax[2]},
+          {h.boundingSphere[0], h.boundingSphere[1], h.boundingSphere[2]},
+          h.boundingSphere[3]};
+}
+
+} // namespace helios
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "helios_mapped_file.hpp"
+#include "helios_model.hpp"
+
+// std
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace helios {
+
+// Binary .hmesh cache of a built model. The file is laid out so vertex and
+// index blobs can be copied straight from the mapping into staging memory:
+//
+//   Header
+//   AttributeDescriptor[attributeCount]   (vertex layout the blob was built
+//                                          with, rejected if it changed)
+//   position blob                         (vertexCount * positionStride)
+//   vertex attribute blob                 (vertexCount * attributeStride)
+//   index blob                            (indexCount * sizeof(uint32_t))
+//   meshlet blob                          (meshletCount * sizeof(Meshlet))
+//   lod blob                              (lodCount * sizeof(Lod))
+//   submesh range blob                    (max(lodCount, 1) * submeshCount
+//                                          * sizeof(SubmeshRange))
+//   submesh name blob                     (name and material of each
+//                                          submesh, NUL terminated)
+//
+// Blobs start on 16 byte boundaries. The header records size, mtime and hash
+// of the source file so a stale cache is detected and rebuilt, and the build
+// flags so a cache is only reused by loads with the same options.
+class HeliosMeshCache {
+public:
+  static constexpr char MAGIC[4] = {'H', 'M', 'S', 'H'};
+  static constexpr uint32_t VERSION = 8;
+
+  enum BuildFlags : uint32_t {
+    BUILD_OPTIMIZED = 1 << 0,
+    // vertex blob holds HeliosModel::PackedVertex instead of Vertex
+    BUILD_PACKED = 1 << 1,
+    BUILD_MESHLETS = 1 << 2,
+    BUILD_LODS = 1 << 3,
+    // imported by HeliosObjStreamer, see SpilledMesh
+    BUILD_STREAMED = 1 << 4,
+    // parsed by HeliosObjParser instead of tinyobj, kept apart so the two
+    // loaders can be compared
+    BUILD_NATIVE_LOADER = 1 << 5,
+  };
+
+  struct Header {
+    char magic[4];
+    uint32_t version;
+
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    uint64_t sourceHash;
+
+    uint32_t vertexCount;
+    uint32_t positionStride;
+    uint32_t attributeStride;
+    uint32_t indexCount;
+    uint32_t attributeCount;
+    uint32_t buildFlags;
+    uint32_t meshletCount;
+    uint32_t lodCount;
+    uint32_t submeshCount;
+    uint32_t submeshNamesSize;
+
+    float boundsMin[3];
+    float boundsMax[3];
+    // center and radius
+    float boundingSphere[4];
+
+    uint64_t attributeOffset;
+    uint64_t positionOffset;
+    uint64_t vertexAttributeOffset;
+    uint64_t indexOffset;
+    uint64_t meshletOffset;
+    uint64_t lodOffset;
+    uint64_t submeshRangeOffset;
+    uint64_t submeshNameOffset;
+  };
+
+  struct AttributeDescriptor {
+    uint32_t location;
+    uint32_t format;
+    uint32_t offset;
+    uint32_t binding;
+  };
+
+  // Mesh whose vertex streams and indices were spilled to files instead of
+  // being held in a Builder. The files hold exactly the position, attribute
+  // and index blobs; submeshRanges has one level.
+  struct SpilledMesh {
+    std::string positionPath{};
+    std::string attributePath{};
+    std::string indexPath{};
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+    HeliosModel::Bounds bounds{};
+    std::vector<HeliosModel::Submesh> submeshes{};
+    std::vector<HeliosModel::SubmeshRange> submeshRanges{};
+  };
+
+  // data of one blob, either in memory or (with path set) in a file
+  struct Blob {
+    const void *data = nullptr;
+    uint64_t size = 0;
+    const std::string *path = nullptr;
+  };
+
+  // Maps cachePath and validates it against sourcePath. Returns nullptr when
+  // the cache is missing, malformed, built for another vertex layout or with
+  // other build flags, or out of date with respect to the source.
+  static std::unique_ptr<HeliosMeshCache> open(const std::string &cachePath,
+                                               const std::string &sourcePath,
+                                               uint32_t buildFlags);
+
+  // Serializes builder to cachePath. The file is written under a temporary
+  // name and renamed so readers never observe a partial cache.
+  static void write(const std::string &cachePath,
+                    const std::string &sourcePath,
+                    const HeliosModel::Builder &builder,
+                    uint32_t buildFlags);
+  // Same for a spilled mesh, copying its files in bounded pieces.
+  static void write(const std::string &cachePath,
+                    const std::string &sourcePath, const SpilledMesh &mesh,
+                    uint32_t buildFlags);
+
+  // Each set of build flags gets its own file, so loading one source with
+  // different options does not keep replacing the other's cache.
+  static std::string cachePathFor(const std::string &sourcePath,
+                                  uint32_t buildFlags) {
+    return sourcePath + "." + std::to_string(buildFlags) + ".hmesh";
+  }
+
+  HeliosMeshCache(const HeliosMeshCache &) = delete;
+  HeliosMeshCache &operator=(const HeliosMeshCache &) = delete;
+
+  // position and attribute streams of Vertex or PackedVertex data depending
+  // on vertexFormat(), see HeliosModel::Builder::writeVertexStreams
+  const void *positions() const;
+  const void *vertexAttributes() const;
+  uint32_t vertexCount() const { return header().vertexCount; }
+  HeliosModel::VertexFormat vertexFormat() const {
+    return header().buildFlags & BUILD_PACKED
+               ? HeliosModel::VertexFormat::Packed
+               : HeliosModel::VertexFormat::Float;
+  }
+  const uint32_t *indices() const;
+  uint32_t indexCount() const { return header().indexCount; }
+  const HeliosModel::Meshlet *meshlets() const;
+  uint32_t meshletCount() const { return header().meshletCount; }
+  const HeliosModel::Lod *lods() const;
+  uint32_t lodCount() const { return header().lodCount; }
+  std::vector<HeliosModel::Submesh> submeshes() const;
+  // submeshes().size() ranges per level of detail
+  const HeliosModel::SubmeshRange *submeshRanges() const;
+  HeliosModel::Bounds bounds() const;
+
+private:
+  struct Blobs {
+    Blob positions{};
+    Blob attributes{};
+    Blob indices{};
+    Blob meshlets{};
+    Blob lods{};
+    Blob submeshRanges{};
+  };
+
+  HeliosMeshCache(const std::string &cachePath) : file{cachePath} {}
+
+  // fills in the rest of h, which holds the element counts, and writes it
+  static void writeFile(const std::string &cachePath,
+                        const std::string &sourcePath, uint32_t buildFlags,
+                        const HeliosModel::Bounds &bounds,
+                        const std::vector<HeliosModel::Submesh> &submeshes,
+                        Header &h, const Blobs &blobs);
+
+  const Header &header() const {
+    return *reinterpret_cast<const Header *>(file.data());
+  }
+  bool isValid(const std::string &sourcePath, uint32_t buildFlags) const;
+
+  HeliosMappedFile file;
+};
+
+} // namespace helios
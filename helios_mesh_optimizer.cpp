@@ -0,0 +1,703 @@
+#include "helios_mesh_optimizer.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+
+namespace helios {
+
+namespace {
+
+// FIFO cache simulation using per vertex insertion timestamps, a vertex is
+// resident while fewer than CACHE_SIZE other vertices were inserted after it
+class FifoCache {
+public:
+  explicit FifoCache(size_t vertexCount) : timestamps(vertexCount, 0) {}
+
+  // returns true on a cache miss
+  bool access(uint32_t vertex) {
+    if (time - timestamps[vertex] > HeliosMeshOptimizer::CACHE_SIZE) {
+      timestamps[vertex] = time++;
+      return true;
+    }
+    return false;
+  }
+
+  void reset() { time += HeliosMeshOptimizer::CACHE_SIZE + 1; }
+
+private:
+  std::vector<uint32_t> timestamps;
+  uint32_t time = HeliosMeshOptimizer::CACHE_SIZE + 1;
+};
+
+// triangles using each vertex, in compressed row form
+struct Adjacency {
+  std::vector<uint32_t> offsets{};
+  std::vector<uint32_t> triangles{};
+};
+
+Adjacency buildAdjacency(const std::vector<uint32_t> &indices,
+                         size_t vertexCount) {
+  Adjacency adjacency{};
+  adjacency.offsets.assign(vertexCount + 1, 0);
+  for (uint32_t index : indices) {
+    adjacency.offsets[index + 1]++;
+  }
+  for (size_t v = 0; v < vertexCount; v++) {
+    adjacency.offsets[v + 1] += adjacency.offsets[v];
+  }
+
+  std::vector<uint32_t> fill(adjacency.offsets.begin(),
+                             adjacency.offsets.end() - 1);
+  adjacency.triangles.resize(indices.size());
+  for (size_t i = 0; i < indices.size(); i++) {
+    adjacency.triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+  }
+  return adjacency;
+}
+
+// symmetric 4x4 quadric of summed squared plane distances, weighted by area
+struct Quadric {
+  double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+  double b0 = 0, b1 = 0, b2 = 0, c = 0;
+  double weight = 0;
+
+  static Quadric fromPlane(const glm::vec3 &normal, float distance,
+                           double weight) {
+    double x = normal.x, y = normal.y, z = normal.z, d = distance;
+    Quadric q{};
+    q.a00 = weight * x * x;
+    q.a01 = weight * x * y;
+    q.a02 = weight * x * z;
+    q.a11 = weight * y * y;
+    q.a12 = weight * y * z;
+    q.a22 = weight * z * z;
+    q.b0 = weight * x * d;
+    q.b1 = weight * y * d;
+    q.b2 = weight * z * d;
+    q.c = weight * d * d;
+    q.weight = weight;
+    return q;
+  }
+
+  Quadric &operator+=(const Quadric &o) {
+    a00 += o.a00, a01 += o.a01, a02 += o.a02;
+    a11 += o.a11, a12 += o.a12, a22 += o.a22;
+    b0 += o.b0, b1 += o.b1, b2 += o.b2;
+    c += o.c;
+    weight += o.weight;
+    return *this;
+  }
+
+  // weighted mean squared distance of p to the accumulated planes
+  double error(const glm::vec3 &p) const {
+    double x = p.x, y = p.y, z = p.z;
+    double e = a00 * x * x + a11 * y * y + a22 * z * z +
+               2 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+               2 * (b0 * x + b1 * y + b2 * z) + c;
+    return weight > 0 ? std::max(e, 0.0) / weight : 0.0;
+  }
+};
+
+} // namespace
+
+HeliosMeshOptimizer::VertexCacheStats
+HeliosMeshOptimizer::analyzeVertexCache(const std::vector<uint32_t> &indices,
+                                        size_t vertexCount) {
+  VertexCacheStats stats{};
+  if (indices.empty() || vertexCount == 0) {
+    return stats;
+  }
+
+  FifoCache cache{vertexCount};
+  size_t misses = 0;
+  for (uint32_t index : indices) {
+    misses += cache.access(index);
+  }
+
+  stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+  stats.atvr = static_cast<float>(misses) / vertexCount;
+  return stats;
+}
+
+void HeliosMeshOptimizer::optimizeVertexCache(std::vector<uint32_t> &indices,
+                                              size_t vertexCount) {
+  const size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+
+  Adjacency adjacency = buildAdjacency(indices, vertexCount);
+  std::vector<uint32_t> liveTriangles(vertexCount);
+  for (size_t v = 0; v < vertexCount; v++) {
+    liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+  }
+
+  std::vector<uint32_t> cacheTime(vertexCount, 0);
+  uint32_t time = CACHE_SIZE + 1;
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<uint32_t> deadEnd{};
+  deadEnd.reserve(indices.size());
+  std::vector<uint32_t> candidates{};
+  std::vector<uint32_t> result{};
+  result.reserve(indices.size());
+  size_t cursor = 0;
+
+  // fallback when the fan runs out: the most recently used vertex that
+  // still has triangles, otherwise the next one in input order
+  auto skipDeadEnd = [&]() -> int64_t {
+    while (!deadEnd.empty()) {
+      uint32_t vertex = deadEnd.back();
+      deadEnd.pop_back();
+      if (liveTriangles[vertex] > 0) {
+        return vertex;
+      }
+    }
+    for (; cursor < vertexCount; cursor++) {
+      if (liveTriangles[cursor] > 0) {
+        return static_cast<int64_t>(cursor);
+      }
+    }
+    return -1;
+  };
+
+  int64_t fanning = skipDeadEnd();
+  while (fanning >= 0) {
+    candidates.clear();
+    for (uint32_t k = adjacency.offsets[fanning];
+         k < adjacency.offsets[fanning + 1]; k++) {
+      uint32_t triangle = adjacency.triangles[k];
+      if (emitted[triangle]) {
+        continue;
+      }
+      emitted[triangle] = true;
+
+      for (int corner = 0; corner < 3; corner++) {
+        uint32_t vertex = indices[3 * triangle + corner];
+        result.push_back(vertex);
+        deadEnd.push_back(vertex);
+        candidates.push_back(vertex);
+        liveTriangles[vertex]--;
+        if (time - cacheTime[vertex] > CACHE_SIZE) {
+          cacheTime[vertex] = time++;
+        }
+      }
+    }
+
+    // prefer the oldest candidate that stays cached while its remaining
+    // triangles are emitted
+    int64_t next = -1;
+    uint32_t bestPriority = 0;
+    for (uint32_t vertex : candidates) {
+      if (liveTriangles[vertex] == 0) {
+        continue;
+      }
+      uint32_t age = time - cacheTime[vertex];
+      uint32_t priority = 0;
+      if (age + 2 * liveTriangles[vertex] <= CACHE_SIZE) {
+        priority = age;
+      }
+      if (priority > bestPriority) {
+        bestPriority = priority;
+        next = vertex;
+      }
+    }
+    fanning = next >= 0 ? next : skipDeadEnd();
+  }
+
+  indices.swap(result);
+}
+
+void HeliosMeshOptimizer::optimizeOverdraw(
+    std::vector<uint32_t> &indices,
+    const std::vector<HeliosModel::Vertex> &vertices, float threshold) {
+  const size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+
+  auto triangleMisses = [&indices](FifoCache &cache, size_t triangle) {
+    return cache.access(indices[3 * triangle + 0]) +
+           cache.access(indices[3 * triangle + 1]) +
+           cache.access(indices[3 * triangle + 2]);
+  };
+
+  // hard boundaries: a triangle with no cached vertex starts a new fan, so
+  // moving it elsewhere costs nothing
+  std::vector<size_t> hardBoundaries{};
+  {
+    FifoCache cache{vertices.size()};
+    for (size_t t = 0; t < triangleCount; t++) {
+      if (triangleMisses(cache, t) == 3) {
+        hardBoundaries.push_back(t);
+      }
+    }
+    hardBoundaries.push_back(triangleCount);
+  }
+
+  // soft boundaries: split a hard cluster once the prefix since the last
+  // split is about as cache friendly as the whole cluster
+  std::vector<size_t> boundaries{};
+  FifoCache cache{vertices.size()};
+  for (size_t c = 0; c + 1 < hardBoundaries.size(); c++) {
+    size_t begin = hardBoundaries[c];
+    size_t end = hardBoundaries[c + 1];
+
+    cache.reset();
+    size_t clusterMisses = 0;
+    for (size_t t = begin; t < end; t++) {
+      clusterMisses += triangleMisses(cache, t);
+    }
+    float splitAcmr = threshold * clusterMisses / (end - begin);
+
+    cache.reset();
+    boundaries.push_back(begin);
+    size_t start = begin;
+    size_t misses = 0;
+    for (size_t t = begin; t < end; t++) {
+      misses += triangleMisses(cache, t);
+      if (t + 1 < end && misses <= splitAcmr * (t + 1 - start)) {
+        boundaries.push_back(t + 1);
+        start = t + 1;
+        misses = 0;
+        cache.reset();
+      }
+    }
+  }
+  boundaries.push_back(triangleCount);
+
+  struct Cluster {
+    size_t begin;
+    size_t end;
+    float sortKey;
+  };
+
+  // area weighted centroid and normal per cluster, the sort key measures how
+  // far out along its own normal a cluster lies relative to the mesh center
+  std::vector<Cluster> clusters(boundaries.size() - 1);
+  std::vector<glm::vec3> centroids(clusters.size());
+  std::vector<glm::vec3> normals(clusters.size());
+  glm::vec3 meshCentroid{0.f};
+  float meshArea = 0.f;
+  for (size_t c = 0; c < clusters.size(); c++) {
+    clusters[c].begin = boundaries[c];
+    clusters[c].end = boundaries[c + 1];
+
+    glm::vec3 centroid{0.f};
+    glm::vec3 normal{0.f};
+    float area = 0.f;
+    for (size_t t = clusters[c].begin; t < clusters[c].end; t++) {
+      const glm::vec3 &p0 = vertices[indices[3 * t + 0]].position;
+      const glm::vec3 &p1 = vertices[indices[3 * t + 1]].position;
+      const glm::vec3 &p2 = vertices[indices[3 * t + 2]].position;
+      glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+      float a = glm::length(n);
+      centroid += (p0 + p1 + p2) * (a / 3.f);
+      normal += n;
+      area += a;
+    }
+    meshCentroid += centroid;
+    meshArea += area;
+    centroids[c] = area > 0.f ? centroid / area : centroid;
+    normals[c] = normal;
+  }
+  if (meshArea > 0.f) {
+    meshCentroid /= meshArea;
+  }
+
+  for (size_t c = 0; c < clusters.size(); c++) {
+    float length = glm::length(normals[c]);
+    clusters[c].sortKey =
+        length > 0.f
+            ? glm::dot(centroids[c] - meshCentroid, normals[c] / length)
+            : 0.f;
+  }
+
+  std::stable_sort(clusters.begin(), clusters.end(),
+                   [](const Cluster &a, const Cluster &b) {
+                     return a.sortKey > b.sortKey;
+                   });
+
+  std::vector<uint32_t> result{};
+  result.reserve(indices.size());
+  for (const auto &cluster : clusters) {
+    result.insert(result.end(), indices.begin() + 3 * cluster.begin,
+                  indices.begin() + 3 * cluster.end);
+  }
+  indices.swap(result);
+}
+
+void HeliosMeshOptimizer::optimizeVertexFetch(
+    std::vector<HeliosModel::Vertex> &vertices,
+    std::vector<uint32_t> &indices) {
+  constexpr uint32_t UNUSED = UINT32_MAX;
+  std::vector<uint32_t> remap(vertices.size(), UNUSED);
+  std::vector<HeliosModel::Vertex> result{};
+  result.reserve(vertices.size());
+
+  for (auto &index : indices) {
+    if (remap[index] == UNUSED) {
+      remap[index] = static_cast<uint32_t>(result.size());
+      result.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+  vertices.swap(result);
+}
+
+std::vector<uint32_t>
+HeliosMeshOptimizer::simplify(const std::vector<HeliosModel::Vertex> &vertices,
+                              const std::vector<uint32_t> &indices,
+                              size_t targetIndexCount, float targetError,
+                              float &resultError) {
+  resultError = 0.f;
+  const size_t vertexCount = vertices.size();
+
+  // collapses work on positions, vertices that only differ in attributes
+  // (flat shading, uv seams) share one position id
+  std::vector<uint32_t> order(vertexCount);
+  for (uint32_t v = 0; v < vertexCount; v++) {
+    order[v] = v;
+  }
+  auto positionLess = [&vertices](uint32_t a, uint32_t b) {
+    const glm::vec3 &pa = vertices[a].position;
+    const glm::vec3 &pb = vertices[b].position;
+    if (pa.x != pb.x) {
+      return pa.x < pb.x;
+    }
+    if (pa.y != pb.y) {
+      return pa.y < pb.y;
+    }
+    return pa.z < pb.z;
+  };
+  std::sort(order.begin(), order.end(), positionLess);
+
+  std::vector<uint32_t> positionId(vertexCount);
+  std::vector<uint32_t> firstVertex{}; // CSR of vertices per position id
+  std::vector<uint32_t> positionVertices{};
+  positionVertices.reserve(vertexCount);
+  for (size_t i = 0; i < vertexCount; i++) {
+    if (i == 0 || positionLess(order[i - 1], order[i])) {
+      firstVertex.push_back(static_cast<uint32_t>(i));
+    }
+    positionId[order[i]] = static_cast<uint32_t>(firstVertex.size() - 1);
+    positionVertices.push_back(order[i]);
+  }
+  const size_t positionCount = firstVertex.size();
+  firstVertex.push_back(static_cast<uint32_t>(vertexCount));
+
+  auto positionOf = [&](uint32_t id) -> const glm::vec3 & {
+    return vertices[positionVertices[firstVertex[id]]].position;
+  };
+
+  std::vector<Quadric> quadrics(positionCount);
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    const glm::vec3 &p0 = vertices[indices[i + 0]].position;
+    const glm::vec3 &p1 = vertices[indices[i + 1]].position;
+    const glm::vec3 &p2 = vertices[indices[i + 2]].position;
+    glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+    float area2 = glm::length(n);
+    if (area2 == 0.f) {
+      continue;
+    }
+    n = n / area2;
+    Quadric q = Quadric::fromPlane(n, -glm::dot(n, p0), 0.5 * area2);
+    for (int corner = 0; corner < 3; corner++) {
+      quadrics[positionId[indices[i + corner]]] += q;
+    }
+  }
+
+  std::vector<uint32_t> result(indices);
+  const double maxError = double{targetError} * targetError;
+  std::vector<uint64_t> edgeKeys{};
+  std::vector<bool> locked(positionCount);
+  std::vector<bool> touched(positionCount);
+  std::vector<uint32_t> collapseTarget(positionCount);
+
+  struct Collapse {
+    uint32_t from;
+    uint32_t to;
+    double error;
+  };
+  std::vector<Collapse> collapses{};
+
+  while (result.size() > targetIndexCount) {
+    const size_t triangleCount = result.size() / 3;
+
+    // undirected position edges; borders (one triangle) and non-manifold
+    // edges (more than two) lock their endpoints
+    edgeKeys.clear();
+    for (size_t i = 0; i < result.size(); i += 3) {
+      for (int e = 0; e < 3; e++) {
+        uint64_t a = positionId[result[i + e]];
+        uint64_t b = positionId[result[i + (e + 1) % 3]];
+        edgeKeys.push_back(a < b ? (a << 32 | b) : (b << 32 | a));
+      }
+    }
+    std::sort(edgeKeys.begin(), edgeKeys.end());
+
+    std::fill(locked.begin(), locked.end(), false);
+    collapses.clear();
+    for (size_t i = 0; i < edgeKeys.size();) {
+      size_t j = i;
+      while (j < edgeKeys.size() && edgeKeys[j] == edgeKeys[i]) {
+        j++;
+      }
+      uint32_t a = static_cast<uint32_t>(edgeKeys[i] >> 32);
+      uint32_t b = static_cast<uint32_t>(edgeKeys[i]);
+      if (j - i != 2) {
+        locked[a] = locked[b] = true;
+      }
+      i = j;
+    }
+    for (size_t i = 0; i < edgeKeys.size(); i++) {
+      if (i > 0 && edgeKeys[i] == edgeKeys[i - 1]) {
+        continue;
+      }
+      uint32_t a = static_cast<uint32_t>(edgeKeys[i] >> 32);
+      uint32_t b = static_cast<uint32_t>(edgeKeys[i]);
+      Quadric q = quadrics[a];
+      q += quadrics[b];
+      double ab = locked[a] ? -1.0 : q.error(positionOf(b));
+      double ba = locked[b] ? -1.0 : q.error(positionOf(a));
+      if (ab >= 0 && (ba < 0 || ab <= ba)) {
+        collapses.push_back({a, b, ab});
+      } else if (ba >= 0) {
+        collapses.push_back({b, a, ba});
+      }
+    }
+    std::sort(collapses.begin(), collapses.end(),
+              [](const Collapse &x, const Collapse &y) {
+                return x.error < y.error;
+              });
+
+    // triangles around each position for the flip test
+    std::vector<uint32_t> adjacencyOffsets(positionCount + 1, 0);
+    for (uint32_t index : result) {
+      adjacencyOffsets[positionId[index] + 1]++;
+    }
+    for (size_t p = 0; p < positionCount; p++) {
+      adjacencyOffsets[p + 1] += adjacencyOffsets[p];
+    }
+    std::vector<uint32_t> adjacency(result.size());
+    {
+      std::vector<uint32_t> fill(adjacencyOffsets.begin(),
+                                 adjacencyOffsets.end() - 1);
+      for (size_t i = 0; i < result.size(); i++) {
+        adjacency[fill[positionId[result[i]]]++] =
+            static_cast<uint32_t>(i / 3);
+      }
+    }
+
+    // each collapse removes about two triangles; collapses in one pass may
+    // not share triangles so the flip test sees current geometry
+    const size_t collapseBudget =
+        (triangleCount - targetIndexCount / 3) / 2 + 1;
+    size_t collapseCount = 0;
+    std::fill(touched.begin(), touched.end(), false);
+    for (size_t p = 0; p < positionCount; p++) {
+      collapseTarget[p] = static_cast<uint32_t>(p);
+    }
+
+    for (const auto &collapse : collapses) {
+      if (collapse.error > maxError || collapseCount >= collapseBudget) {
+        break;
+      }
+      if (touched[collapse.from] || touched[collapse.to]) {
+        continue;
+      }
+
+      const glm::vec3 &target = positionOf(collapse.to);
+      bool flips = false;
+      for (uint32_t k = adjacencyOffsets[collapse.from];
+           k < adjacencyOffsets[collapse.from + 1] && !flips; k++) {
+        uint32_t t = adjacency[k];
+        glm::vec3 before[3];
+        glm::vec3 after[3];
+        bool hasTarget = false;
+        for (int corner = 0; corner < 3; corner++) {
+          uint32_t id = positionId[result[3 * t + corner]];
+          hasTarget = hasTarget || id == collapse.to;
+          before[corner] = positionOf(id);
+          after[corner] = id == collapse.from ? target : before[corner];
+        }
+        if (hasTarget) {
+          continue; // degenerates and is removed
+        }
+        glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+        glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+        flips = glm::dot(n0, n1) <= 0.f;
+      }
+      if (flips) {
+        continue;
+      }
+
+      for (uint32_t k = adjacencyOffsets[collapse.from];
+           k < adjacencyOffsets[collapse.from + 1]; k++) {
+        uint32_t t = adjacency[k];
+        for (int corner = 0; corner < 3; corner++) {
+          touched[positionId[result[3 * t + corner]]] = true;
+        }
+      }
+      collapseTarget[collapse.from] = collapse.to;
+      quadrics[collapse.to] += quadrics[collapse.from];
+      resultError = std::max(resultError,
+                             static_cast<float>(std::sqrt(collapse.error)));
+      collapseCount++;
+    }
+
+    if (collapseCount == 0) {
+      break;
+    }
+
+    // move every vertex of a collapsed position onto the vertex at the
+    // target position whose normal matches best
+    auto remapVertex = [&](uint32_t vertex) {
+      uint32_t to = collapseTarget[positionId[vertex]];
+      if (to == positionId[vertex]) {
+        return vertex;
+      }
+      uint32_t best = positionVertices[firstVertex[to]];
+      float bestDot = -2.f;
+      for (uint32_t k = firstVertex[to]; k < firstVertex[to + 1]; k++) {
+        uint32_t candidate = positionVertices[k];
+        float d = glm::dot(vertices[vertex].normal, vertices[candidate].normal);
+        if (d > bestDot) {
+          bestDot = d;
+          best = candidate;
+        }
+      }
+      return best;
+    };
+
+    size_t write = 0;
+    for (size_t i = 0; i < result.size(); i += 3) {
+      uint32_t v0 = remapVertex(result[i + 0]);
+      uint32_t v1 = remapVertex(result[i + 1]);
+      uint32_t v2 = remapVertex(result[i + 2]);
+      uint32_t p0 = positionId[v0];
+      uint32_t p1 = positionId[v1];
+      uint32_t p2 = positionId[v2];
+      if (p0 == p1 || p1 == p2 || p0 == p2) {
+        continue;
+      }
+      result[write++] = v0;
+      result[write++] = v1;
+      result[write++] = v2;
+    }
+    result.resize(write);
+  }
+
+  return result;
+}
+
+std::vector<HeliosModel::Meshlet> HeliosMeshOptimizer::buildMeshlets(
+    const std::vector<HeliosModel::Vertex> &vertices,
+    const std::vector<uint32_t> &indices) {
+  std::vector<HeliosModel::Meshlet> meshlets{};
+  const size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return meshlets;
+  }
+
+  // last meshlet each vertex was added to, so membership tests are O(1)
+  constexpr uint32_t NONE = UINT32_MAX;
+  std::vector<uint32_t> owner(vertices.size(), NONE);
+  std::vector<uint32_t> meshletVertices{};
+  meshletVertices.reserve(MAX_MESHLET_VERTICES);
+
+  auto finish = [&](size_t beginTriangle, size_t endTriangle) {
+    HeliosModel::Meshlet meshlet{};
+    meshlet.firstIndex = static_cast<uint32_t>(3 * beginTriangle);
+    meshlet.indexCount =
+        static_cast<uint32_t>(3 * (endTriangle - beginTriangle));
+
+    glm::vec3 min = vertices[meshletVertices[0]].position;
+    glm::vec3 max = min;
+    for (uint32_t v : meshletVertices) {
+      min = glm::min(min, vertices[v].position);
+      max = glm::max(max, vertices[v].position);
+    }
+    glm::vec3 center = (min + max) * 0.5f;
+    float radius = 0.f;
+    for (uint32_t v : meshletVertices) {
+      radius = glm::max(radius, glm::length(vertices[v].position - center));
+    }
+    meshlet.boundingSphere = glm::vec4{center, radius};
+
+    // face normals, oriented to agree with the shading normals since the
+    // winding of OBJ input is not reliable
+    std::vector<glm::vec3> normals{};
+    glm::vec3 axis{0.f};
+    bool coneValid = true;
+    for (size_t t = beginTriangle; t < endTriangle && coneValid; t++) {
+      const auto &v0 = vertices[indices[3 * t + 0]];
+      const auto &v1 = vertices[indices[3 * t + 1]];
+      const auto &v2 = vertices[indices[3 * t + 2]];
+      glm::vec3 n = glm::cross(v1.position - v0.position,
+                               v2.position - v0.position);
+      float length = glm::length(n);
+      float orientation = glm::dot(n, v0.normal + v1.normal + v2.normal);
+      if (length == 0.f) {
+        continue;
+      }
+      if (orientation == 0.f) {
+        coneValid = false;
+        break;
+      }
+      n = n / (orientation > 0.f ? length : -length);
+      normals.push_back(n);
+      axis += n;
+    }
+
+    float axisLength = glm::length(axis);
+    if (coneValid && !normals.empty() && axisLength > 0.f) {
+      axis = axis / axisLength;
+      float minDot = 1.f;
+      for (const auto &n : normals) {
+        minDot = glm::min(minDot, glm::dot(axis, n));
+      }
+      // a cone wider than a hemisphere can always be seen from somewhere
+      if (minDot > 0.f) {
+        meshlet.cone = glm::vec4{axis, glm::sqrt(1.f - minDot * minDot)};
+      }
+    }
+
+    meshlets.push_back(meshlet);
+    meshletVertices.clear();
+  };
+
+  size_t begin = 0;
+  for (size_t t = 0; t < triangleCount; t++) {
+    const uint32_t id = static_cast<uint32_t>(meshlets.size());
+    uint32_t newVertices = 0;
+    for (int corner = 0; corner < 3; corner++) {
+      uint32_t v = indices[3 * t + corner];
+      bool seen = owner[v] == id;
+      for (int prev = 0; prev < corner && !seen; prev++) {
+        seen = indices[3 * t + prev] == v;
+      }
+      newVertices += !seen;
+    }
+
+    if (meshletVertices.size() + newVertices > MAX_MESHLET_VERTICES ||
+        t - begin + 1 > MAX_MESHLET_TRIANGLES) {
+      finish(begin, t);
+      begin = t;
+    }
+
+    const uint32_t current = static_cast<uint32_t>(meshlets.size());
+    for (int corner = 0; corner < 3; corner++) {
+      uint32_t v = indices[3 * t + corner];
+      if (owner[v] != current) {
+        owner[v] = current;
+        meshletVertices.push_back(v);
+      }
+    }
+  }
+  finish(begin, triangleCount);
+
+  return meshlets;
+}
+
+} // namespace helios
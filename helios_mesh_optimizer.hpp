@@ -0,0 +1,72 @@
+#pragma once
+
+#include "helios_model.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace helios {
+
+// Post-load reordering of indexed triangle lists for the GPU. The passes are
+// meant to run in order: vertex cache, overdraw (which keeps most of the
+// cache locality), then vertex fetch (which renumbers vertices and so must
+// come last).
+class HeliosMeshOptimizer {
+public:
+  // size of the FIFO post-transform cache the passes optimize for
+  static constexpr uint32_t CACHE_SIZE = 16;
+  static constexpr uint32_t MAX_MESHLET_VERTICES = 64;
+  static constexpr uint32_t MAX_MESHLET_TRIANGLES = 124;
+
+  struct VertexCacheStats {
+    // average cache miss ratio: transformed vertices per triangle, 0.5 at
+    // best for large regular meshes and 3 at worst
+    float acmr = 0.f;
+    // average transform to vertex ratio: transformed vertices per unique
+    // vertex, 1 is optimal
+    float atvr = 0.f;
+  };
+
+  static VertexCacheStats
+  analyzeVertexCache(const std::vector<uint32_t> &indices,
+                     size_t vertexCount);
+
+  // Reorders triangles with Tipsify (Sander et al. 2007) so consecutive
+  // triangles reuse vertices still in the post-transform cache.
+  static void optimizeVertexCache(std::vector<uint32_t> &indices,
+                                  size_t vertexCount);
+
+  // Groups the cache optimized triangles into clusters and sorts the clusters
+  // so outward facing ones are drawn first, which lowers overdraw from any
+  // viewpoint. Clusters are only split where the local ACMR stays within
+  // threshold times that of the unsplit cluster.
+  static void optimizeOverdraw(std::vector<uint32_t> &indices,
+                               const std::vector<HeliosModel::Vertex> &vertices,
+                               float threshold = 1.05f);
+
+  // Renumbers vertices in the order the index buffer first references them.
+  // Vertices no index refers to are dropped.
+  static void optimizeVertexFetch(std::vector<HeliosModel::Vertex> &vertices,
+                                  std::vector<uint32_t> &indices);
+
+  // Quadric error edge collapse (Garland and Heckbert 1997) that only moves
+  // vertices onto existing ones, so the result indexes the same vertices.
+  // Stops at targetIndexCount or once the next collapse would move the
+  // surface by more than targetError (model space distance). resultError
+  // receives the error of the returned index list. Border and non-manifold
+  // vertices are kept in place.
+  static std::vector<uint32_t>
+  simplify(const std::vector<HeliosModel::Vertex> &vertices,
+           const std::vector<uint32_t> &indices, size_t targetIndexCount,
+           float targetError, float &resultError);
+
+  // Splits the index buffer, in its current order, into runs of at most
+  // MAX_MESHLET_TRIANGLES triangles touching at most MAX_MESHLET_VERTICES
+  // vertices. Cache optimized input keeps the runs spatially compact.
+  static std::vector<HeliosModel::Meshlet>
+  buildMeshlets(const std::vector<HeliosModel::Vertex> &vertices,
+                const std::vector<uint32_t> &indices);
+};
+
+} // namespace helios
@@ -1,145 +1,633 @@
 #include "helios_model.hpp"
-#include "helios_utils.hpp"
+#include "helios_mesh_cache.hpp"
+#include "helios_mesh_optimizer.hpp"
+#include "helios_obj_parser.hpp"
+#include "helios_obj_streamer.hpp"
+#include "helios_simd.hpp"
+#include "helios_upload_batch.hpp"
+#include "helios_vertex_table.hpp"
 #include "vulkan/vulkan_core.h"
 #include <memory>
 
 // libs
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp>
-#include <unordered_map>
+
+#include <glm/gtc/matrix_transform.hpp>
 
 // std
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cmath>
 #include <cstring>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <utility>
 
-namespace std {
+namespace helios {
 
-template <> struct hash<helios::HeliosModel::Vertex> {
-  size_t operator()(helios::HeliosModel::Vertex const &vertex) const {
-    size_t seed = 0;
-    helios::hashCombine(seed, vertex.position, vertex.color, vertex.normal,
-                        vertex.uv);
-    return seed;
+namespace {
+
+// coarsest level of detail allowed, relative to the bounds diagonal
+constexpr float MAX_LOD_RELATIVE_ERROR = 0.05f;
+
+// Expands per corner attribute indices into deduplicated vertices. Shared by
+// both OBJ loaders so their output is directly comparable. Groups with the
+// same name and material become one submesh, so their corners are reordered
+// to keep every submesh contiguous.
+template <typename Index>
+void buildVertices(const std::vector<float> &positions,
+                   const std::vector<float> &colors,
+                   const std::vector<float> &normals,
+                   const std::vector<float> &texcoords,
+                   const std::vector<Index> &cornerIndices,
+                   const std::vector<HeliosObjParser::Group> &groups,
+                   HeliosModel::Builder &builder) {
+  builder.submeshes.clear();
+  builder.submeshRanges.clear();
+
+  // groups of each submesh, submeshes in order of first appearance
+  std::map<std::pair<std::string, std::string>, size_t> submeshIndices{};
+  std::vector<std::vector<size_t>> submeshGroups{};
+  for (size_t i = 0; i < groups.size(); i++) {
+    auto key = std::make_pair(groups[i].name, groups[i].material);
+    auto inserted = submeshIndices.emplace(key, submeshGroups.size());
+    if (inserted.second) {
+      builder.submeshes.push_back({groups[i].name, groups[i].material});
+      submeshGroups.emplace_back();
+    }
+    submeshGroups[inserted.first->second].push_back(i);
   }
-};
 
-} // namespace std
+  // file order already keeps submeshes contiguous unless groups were merged
+  const bool reorder = submeshGroups.size() < groups.size();
+  std::vector<uint32_t> cornerOrder{};
+  if (reorder) {
+    cornerOrder.reserve(cornerIndices.size());
+  }
+  uint32_t firstIndex = 0;
+  for (const auto &groupIndices : submeshGroups) {
+    uint32_t indexCount = 0;
+    for (size_t i : groupIndices) {
+      const auto &group = groups[i];
+      if (reorder) {
+        for (size_t corner = 0; corner < group.indexCount; corner++) {
+          cornerOrder.push_back(
+              static_cast<uint32_t>(group.firstIndex + corner));
+        }
+      }
+      indexCount += static_cast<uint32_t>(group.indexCount);
+    }
+    builder.submeshRanges.push_back({firstIndex, indexCount});
+    firstIndex += indexCount;
+  }
 
-namespace helios {
+  auto makeVertex = [&](size_t corner) {
+    const auto &index =
+        cornerIndices[reorder ? cornerOrder[corner] : corner];
+    HeliosModel::Vertex vertex{};
+    if (index.vertex_index >= 0) {
+      vertex.position = {
+          positions[3 * index.vertex_index + 0],
+          positions[3 * index.vertex_index + 1],
+          positions[3 * index.vertex_index + 2],
+      };
+      vertex.color = {
+          colors[3 * index.vertex_index + 0],
+          colors[3 * index.vertex_index + 1],
+          colors[3 * index.vertex_index + 2],
+      };
+    }
+    if (index.normal_index >= 0) {
+      vertex.normal = {
+          normals[3 * index.normal_index + 0],
+          normals[3 * index.normal_index + 1],
+          normals[3 * index.normal_index + 2],
+      };
+    }
+    if (index.texcoord_index >= 0) {
+      vertex.uv = {
+          texcoords[2 * index.texcoord_index + 0],
+          texcoords[2 * index.texcoord_index + 1],
+      };
+    }
+    return vertex;
+  };
+
+  HeliosVertexTable::deduplicate(cornerIndices.size(), makeVertex,
+                                 builder.vertices, builder.indices);
+}
+
+// The SIMD paths load a position as four floats, the fourth being color.x,
+// which stays inside the vertex and is ignored.
+static_assert(offsetof(HeliosModel::Vertex, color) ==
+                  offsetof(HeliosModel::Vertex, position) + 3 * sizeof(float),
+              "position must be followed by another float");
+
+// min and max position of count > 0 vertices
+void positionBox(const HeliosModel::Vertex *vertices, size_t count,
+                 glm::vec3 &min, glm::vec3 &max) {
+#if HELIOS_SIMD_SSE2
+  // two accumulator pairs to hide the latency of the min/max chains
+  __m128 min0 = _mm_loadu_ps(&vertices[0].position.x);
+  __m128 max0 = min0;
+  __m128 min1 = min0;
+  __m128 max1 = min0;
+  size_t i = 1;
+  for (; i + 2 <= count; i += 2) {
+    __m128 p0 = _mm_loadu_ps(&vertices[i].position.x);
+    __m128 p1 = _mm_loadu_ps(&vertices[i + 1].position.x);
+    min0 = _mm_min_ps(min0, p0);
+    max0 = _mm_max_ps(max0, p0);
+    min1 = _mm_min_ps(min1, p1);
+    max1 = _mm_max_ps(max1, p1);
+  }
+  for (; i < count; i++) {
+    __m128 p = _mm_loadu_ps(&vertices[i].position.x);
+    min0 = _mm_min_ps(min0, p);
+    max0 = _mm_max_ps(max0, p);
+  }
+  alignas(16) float lanes[2][4];
+  _mm_store_ps(lanes[0], _mm_min_ps(min0, min1));
+  _mm_store_ps(lanes[1], _mm_max_ps(max0, max1));
+  min = {lanes[0][0], lanes[0][1], lanes[0][2]};
+  max = {lanes[1][0], lanes[1][1], lanes[1][2]};
+#elif HELIOS_SIMD_NEON
+  float32x4_t min0 = vld1q_f32(&vertices[0].position.x);
+  float32x4_t max0 = min0;
+  float32x4_t min1 = min0;
+  float32x4_t max1 = min0;
+  size_t i = 1;
+  for (; i + 2 <= count; i += 2) {
+    float32x4_t p0 = vld1q_f32(&vertices[i].position.x);
+    float32x4_t p1 = vld1q_f32(&vertices[i + 1].position.x);
+    min0 = vminq_f32(min0, p0);
+    max0 = vmaxq_f32(max0, p0);
+    min1 = vminq_f32(min1, p1);
+    max1 = vmaxq_f32(max1, p1);
+  }
+  for (; i < count; i++) {
+    float32x4_t p = vld1q_f32(&vertices[i].position.x);
+    min0 = vminq_f32(min0, p);
+    max0 = vmaxq_f32(max0, p);
+  }
+  float lanes[2][4];
+  vst1q_f32(lanes[0], vminq_f32(min0, min1));
+  vst1q_f32(lanes[1], vmaxq_f32(max0, max1));
+  min = {lanes[0][0], lanes[0][1], lanes[0][2]};
+  max = {lanes[1][0], lanes[1][1], lanes[1][2]};
+#else
+  min = max = vertices[0].position;
+  for (size_t i = 1; i < count; i++) {
+    min = glm::min(min, vertices[i].position);
+    max = glm::max(max, vertices[i].position);
+  }
+#endif
+}
+
+// largest squared distance of a vertex position from center
+float maxDistanceSquared(const HeliosModel::Vertex *vertices, size_t count,
+                         const glm::vec3 &center) {
+#if HELIOS_SIMD_SSE2
+  const __m128 c = _mm_setr_ps(center.x, center.y, center.z, 0.f);
+  // clears the fourth lane, which holds color.x
+  const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+  __m128 result = _mm_setzero_ps();
+  for (size_t i = 0; i < count; i++) {
+    __m128 d = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(&vertices[i].position.x), c),
+                          xyz);
+    d = _mm_mul_ps(d, d);
+    // x + y + z in lane 0, as x + y + z + 0 across both halves
+    d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+    d = _mm_add_ss(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+    result = _mm_max_ss(result, d);
+  }
+  return _mm_cvtss_f32(result);
+#elif HELIOS_SIMD_NEON
+  const float32x4_t c = {center.x, center.y, center.z, 0.f};
+  const uint32x4_t xyz = {~0u, ~0u, ~0u, 0u};
+  float result = 0.f;
+  for (size_t i = 0; i < count; i++) {
+    float32x4_t d = vsubq_f32(vld1q_f32(&vertices[i].position.x), c);
+    d = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(d), xyz));
+    result = std::max(result, vaddvq_f32(vmulq_f32(d, d)));
+  }
+  return result;
+#else
+  float result = 0.f;
+  for (size_t i = 0; i < count; i++) {
+    glm::vec3 d = vertices[i].position - center;
+    result = std::max(result, glm::dot(d, d));
+  }
+  return result;
+#endif
+}
+
+// center and half extent of the box packed positions are relative to, flat
+// axes get a tiny extent so quantizing never divides by zero
+void quantizationBox(const HeliosModel::Bounds &bounds, glm::vec3 &center,
+                     glm::vec3 &halfExtent) {
+  center = (bounds.min + bounds.max) * 0.5f;
+  halfExtent = glm::max((bounds.max - bounds.min) * 0.5f, glm::vec3{1e-6f});
+}
+
+// octahedral mapping of a unit vector onto [-1, 1]^2, zero stays zero
+glm::vec2 octahedralEncode(const glm::vec3 &normal) {
+  float l1 = glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z);
+  if (l1 == 0.f) {
+    return glm::vec2{0.f};
+  }
+  glm::vec2 p{normal.x / l1, normal.y / l1};
+  if (normal.z < 0.f) {
+    p = glm::vec2{(1.f - glm::abs(p.y)) * (p.x >= 0.f ? 1.f : -1.f),
+                  (1.f - glm::abs(p.x)) * (p.y >= 0.f ? 1.f : -1.f)};
+  }
+  return p;
+}
+
+int16_t quantizeSnorm16(float value) {
+  return static_cast<int16_t>(
+      glm::round(glm::clamp(value, -1.f, 1.f) * 32767.f));
+}
+
+} // namespace
 
 HeliosModel::HeliosModel(HeliosDevice &device,
-                         const HeliosModel::Builder &builder)
-    : heliosDevice{device} {
-  createVertexBuffers(builder.vertices);
-  createIndexBuffer(builder.indices);
+                         const HeliosModel::Builder &builder, Upload upload)
+    : heliosDevice{device}, bounds{builder.computeBounds()},
+      vertexFormat{builder.vertexFormat},
+      geometryArena{device.geometryArena(positionStrideFor(vertexFormat),
+                                         attributeStrideFor(vertexFormat))} {
+  if (vertexFormat == VertexFormat::Packed) {
+    dequantizeMatrix = dequantizeMatrixFor(bounds);
+  }
+  std::vector<uint8_t> positions{};
+  std::vector<uint8_t> attributes{};
+  builder.writeVertexStreams(bounds, positions, attributes);
+  createGeometry(positions.data(), attributes.data(),
+                 static_cast<uint32_t>(builder.vertices.size()),
+                 builder.indices.data(),
+                 static_cast<uint32_t>(builder.indices.size()));
+  createMeshletBuffer(builder.meshlets.data(),
+                      static_cast<uint32_t>(builder.meshlets.size()));
+  createLods(builder.lods.data(), static_cast<uint32_t>(builder.lods.size()));
+  createSubmeshes(builder.submeshes.data(),
+                  static_cast<uint32_t>(builder.submeshes.size()),
+                  builder.submeshRanges.data());
+  if (upload == Upload::Immediate) {
+    uploadImmediately();
+  }
 }
 
-HeliosModel::~HeliosModel() {
-  vkDestroyBuffer(heliosDevice.device(), vertexBuffer, nullptr);
-  vkFreeMemory(heliosDevice.device(), vertexBufferMemory, nullptr);
-  if (hasIndexBuffer) {
-    vkDestroyBuffer(heliosDevice.device(), indexBuffer, nullptr);
-    vkFreeMemory(heliosDevice.device(), indexBufferMemory, nullptr);
+HeliosModel::HeliosModel(HeliosDevice &device, const HeliosMeshCache &cache,
+                         Upload upload)
+    : heliosDevice{device}, bounds{cache.bounds()},
+      vertexFormat{cache.vertexFormat()},
+      geometryArena{device.geometryArena(positionStrideFor(vertexFormat),
+                                         attributeStrideFor(vertexFormat))} {
+  if (vertexFormat == VertexFormat::Packed) {
+    dequantizeMatrix = dequantizeMatrixFor(bounds);
+  }
+  // copies straight out of the file mapping into staging memory
+  createGeometry(cache.positions(), cache.vertexAttributes(),
+                 cache.vertexCount(), cache.indices(), cache.indexCount());
+  createMeshletBuffer(cache.meshlets(), cache.meshletCount());
+  createLods(cache.lods(), cache.lodCount());
+  auto cachedSubmeshes = cache.submeshes();
+  createSubmeshes(cachedSubmeshes.data(),
+                  static_cast<uint32_t>(cachedSubmeshes.size()),
+                  cache.submeshRanges());
+  if (upload == Upload::Immediate) {
+    uploadImmediately();
   }
 }
 
+HeliosModel::~HeliosModel() { geometryArena.free(geometry); }
+
 std::unique_ptr<HeliosModel>
 HeliosModel::createModelFromFile(HeliosDevice &device,
                                  const std::string &filepath) {
-  Builder builder{};
-  builder.loadModel(filepath);
-  return std::make_unique<HeliosModel>(device, builder);
+  return createModelFromFile(device, filepath, LoadOptions{});
 }
 
-void HeliosModel::createVertexBuffers(const std::vector<Vertex> &vertices) {
-  vertexCount = static_cast<uint32_t>(vertices.size());
-  assert(vertexCount >= 3 && "vertex count must be at least 3");
-  VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
+std::unique_ptr<HeliosModel>
+HeliosModel::createModelFromFile(HeliosDevice &device,
+                                 const std::string &filepath,
+                                 const LoadOptions &options, Upload upload) {
+  auto startTime = std::chrono::high_resolution_clock::now();
+  auto elapsedMs = [&startTime]() {
+    return std::chrono::duration<float, std::chrono::milliseconds::period>(
+               std::chrono::high_resolution_clock::now() - startTime)
+        .count();
+  };
+
+  uint32_t buildFlags = 0;
+  if (options.loader == ObjLoader::Native) {
+    buildFlags |= HeliosMeshCache::BUILD_NATIVE_LOADER;
+  }
+  if (options.optimize) {
+    buildFlags |= HeliosMeshCache::BUILD_OPTIMIZED;
+  }
+  if (options.vertexFormat == VertexFormat::Packed) {
+    buildFlags |= HeliosMeshCache::BUILD_PACKED;
+  }
+  if (options.meshlets) {
+    buildFlags |= HeliosMeshCache::BUILD_MESHLETS;
+  }
+  if (options.lods) {
+    buildFlags |= HeliosMeshCache::BUILD_LODS;
+  }
+  if (options.streaming) {
+    buildFlags &= HeliosMeshCache::BUILD_PACKED;
+    buildFlags |= HeliosMeshCache::BUILD_STREAMED;
+  }
+  const std::string cachePath =
+      HeliosMeshCache::cachePathFor(filepath, buildFlags);
+  if (options.useCache || options.streaming) {
+    if (auto cache = HeliosMeshCache::open(cachePath, filepath, buildFlags)) {
+      std::cout << "loaded " << filepath << " (cache): "
+                << cache->vertexCount() << " vertices, "
+                << cache->indexCount() << " indices in " << elapsedMs()
+                << " ms" << std::endl;
+      return std::make_unique<HeliosModel>(device, *cache, upload);
+    }
+  }
+
+  if (options.streaming) {
+    // the cache doubles as the spill target, the model loads from it
+    auto stats = HeliosObjStreamer::streamToCache(
+        filepath, cachePath, options.memoryBudget, options.vertexFormat);
+    auto cache = HeliosMeshCache::open(cachePath, filepath, buildFlags);
+    if (!cache) {
+      throw std::runtime_error("failed to open streamed mesh cache: " +
+                               cachePath);
+    }
+    std::cout << "streamed " << filepath << ": " << stats.vertexCount
+              << " vertices, " << stats.indexCount << " indices in "
+              << stats.batchCount << " batches, peak host memory "
+              << (stats.peakMemory >> 20) << " of "
+              << (options.memoryBudget >> 20) << " MiB in " << elapsedMs()
+              << " ms" << std::endl;
+    return std::make_unique<HeliosModel>(device, *cache, upload);
+  }
+
+  Builder builder{};
+  builder.vertexFormat = options.vertexFormat;
+  builder.loadModel(filepath, options.loader);
+
+  std::cout << "loaded " << filepath << " ("
+            << (options.loader == ObjLoader::Native ? "native" : "tinyobj")
+            << "): " << builder.vertices.size() << " vertices, "
+            << builder.indices.size() << " indices, "
+            << builder.submeshes.size() << " submeshes in " << elapsedMs()
+            << " ms" << std::endl;
+
+  if (options.optimize) {
+    auto before = HeliosMeshOptimizer::analyzeVertexCache(
+        builder.indices, builder.vertices.size());
+    builder.optimize();
+    auto after = HeliosMeshOptimizer::analyzeVertexCache(
+        builder.indices, builder.vertices.size());
+    std::cout << "optimized " << filepath << ": ACMR " << before.acmr
+              << " -> " << after.acmr << ", ATVR " << before.atvr << " -> "
+              << after.atvr << " in " << elapsedMs() << " ms" << std::endl;
+  }
 
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingBufferMemory;
+  if (options.lods) {
+    builder.buildLods();
+    std::cout << "built " << builder.lods.size() << " lods for " << filepath
+              << ":";
+    for (const auto &lod : builder.lods) {
+      std::cout << " " << lod.indexCount / 3;
+    }
+    std::cout << " triangles" << std::endl;
+  }
 
-  heliosDevice.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                            stagingBuffer, stagingBufferMemory);
+  if (options.meshlets) {
+    builder.buildMeshlets();
+    std::cout << "built " << builder.meshlets.size() << " meshlets for "
+              << filepath << std::endl;
+  }
 
-  void *data;
-  vkMapMemory(heliosDevice.device(), stagingBufferMemory, 0, bufferSize, 0,
-              &data);
-  memcpy(data, vertices.data(), static_cast<size_t>(bufferSize));
-  vkUnmapMemory(heliosDevice.device(), stagingBufferMemory);
+  if (options.useCache) {
+    // a missing cache only costs start up time, never fail the load over it
+    try {
+      HeliosMeshCache::write(cachePath, filepath, builder, buildFlags);
+    } catch (const std::exception &e) {
+      std::cerr << "failed to write mesh cache: " << e.what() << std::endl;
+    }
+  }
 
-  heliosDevice.createBuffer(
-      bufferSize,
-      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+  return std::make_unique<HeliosModel>(device, builder, upload);
+}
 
-  heliosDevice.copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
-  vkDestroyBuffer(heliosDevice.device(), stagingBuffer, nullptr);
-  vkFreeMemory(heliosDevice.device(), stagingBufferMemory, nullptr);
+glm::mat4 HeliosModel::dequantizeMatrixFor(const Bounds &bounds) {
+  glm::vec3 center;
+  glm::vec3 halfExtent;
+  quantizationBox(bounds, center, halfExtent);
+  return glm::scale(glm::translate(glm::mat4{1.f}, center), halfExtent);
 }
 
-void HeliosModel::createIndexBuffer(const std::vector<uint32_t> &indices) {
-  indexCount = static_cast<uint32_t>(indices.size());
-  hasIndexBuffer = indexCount > 0;
+void HeliosModel::stageUpload(const void *data, VkDeviceSize size,
+                              VkBuffer dstBuffer, VkDeviceSize dstOffset) {
+  auto staging = heliosDevice.stagingRing().allocate(size);
+  std::memcpy(staging.getMappedMemory(), data, size);
+  pendingUploads.push_back({std::move(staging), dstBuffer, dstOffset, size});
+}
 
-  if (!hasIndexBuffer) {
-    return;
+void HeliosModel::addUploads(HeliosUploadBatch &batch) const {
+  for (const auto &upload : pendingUploads) {
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = upload.staging.getOffset();
+    copyRegion.dstOffset = upload.dstOffset;
+    copyRegion.size = upload.size;
+    batch.copyBuffer(upload.staging.getBuffer(), upload.dstBuffer, copyRegion);
   }
+}
+
+void HeliosModel::finishUpload() {
+  pendingUploads.clear();
+  ready.store(true, std::memory_order_release);
+}
 
-  VkDeviceSize bufferSize = sizeof(indices[0]) * indexCount;
+void HeliosModel::uploadImmediately() {
+  HeliosUploadBatch batch{heliosDevice};
+  addUploads(batch);
+  batch.submitAndWait();
+  finishUpload();
+}
 
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingBufferMemory;
+void HeliosModel::createGeometry(const void *positions,
+                                 const void *attributes, uint32_t vertices,
+                                 const uint32_t *indices, uint32_t indexTotal) {
+  vertexCount = vertices;
+  indexCount = indexTotal;
+  assert(vertexCount >= 3 && "vertex count must be at least 3");
+  hasIndexBuffer = indexCount > 0;
 
-  heliosDevice.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                            stagingBuffer, stagingBufferMemory);
+  // Indices stay relative to the model's first vertex, which the draws pass
+  // as vertexOffset. 0xffff is left out so it never collides with a
+  // primitive restart index.
+  std::vector<uint16_t> shortIndices;
+  if (hasIndexBuffer && vertexCount < std::numeric_limits<uint16_t>::max()) {
+    indexType = VK_INDEX_TYPE_UINT16;
+    shortIndices.assign(indices, indices + indexCount);
+  }
+  VkDeviceSize indexSize =
+      (indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t)
+                                         : sizeof(uint32_t)) *
+      VkDeviceSize{indexCount};
+
+  geometry = geometryArena.allocate(vertexCount, indexSize);
+  VkDeviceSize positionStride = positionStrideFor(vertexFormat);
+  VkDeviceSize attributeStride = attributeStrideFor(vertexFormat);
+  stageUpload(positions, positionStride * vertexCount,
+              geometry.positionBuffer, positionStride * geometry.firstVertex);
+  stageUpload(attributes, attributeStride * vertexCount,
+              geometry.attributeBuffer,
+              attributeStride * geometry.firstVertex);
+  if (indexType == VK_INDEX_TYPE_UINT16) {
+    stageUpload(shortIndices.data(), indexSize, geometry.indexBuffer,
+                geometry.indexOffset);
+  } else if (hasIndexBuffer) {
+    stageUpload(indices, indexSize, geometry.indexBuffer,
+                geometry.indexOffset);
+  }
+}
+
+void HeliosModel::createMeshletBuffer(const Meshlet *meshlets,
+                                      uint32_t count) {
+  meshletCount = count;
+  if (meshletCount == 0) {
+    return;
+  }
 
-  void *data;
-  vkMapMemory(heliosDevice.device(), stagingBufferMemory, 0, bufferSize, 0,
-              &data);
-  memcpy(data, indices.data(), static_cast<size_t>(bufferSize));
-  vkUnmapMemory(heliosDevice.device(), stagingBufferMemory);
+  meshletBuffer = std::make_unique<HeliosBuffer>(
+      heliosDevice, sizeof(Meshlet), meshletCount,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1, true);
+  stageUpload(meshlets, meshletBuffer->getBufferSize(),
+              meshletBuffer->getBuffer());
+}
 
-  heliosDevice.createBuffer(
-      bufferSize,
-      VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+void HeliosModel::createLods(const Lod *levels, uint32_t count) {
+  lods.assign(levels, levels + count);
+  if (lods.empty()) {
+    lods.push_back({0, indexCount, 0.f});
+  }
+}
 
-  heliosDevice.copyBuffer(stagingBuffer, indexBuffer, bufferSize);
-  vkDestroyBuffer(heliosDevice.device(), stagingBuffer, nullptr);
-  vkFreeMemory(heliosDevice.device(), stagingBufferMemory, nullptr);
+void HeliosModel::createSubmeshes(const Submesh *parts, uint32_t count,
+                                  const SubmeshRange *ranges) {
+  if (count == 0) {
+    submeshes.assign(1, Submesh{});
+    submeshRanges.clear();
+    for (const Lod &lod : lods) {
+      submeshRanges.push_back({lod.firstIndex, lod.indexCount});
+    }
+    return;
+  }
+  submeshes.assign(parts, parts + count);
+  submeshRanges.assign(ranges, ranges + lods.size() * count);
 }
 
 void HeliosModel::draw(VkCommandBuffer commandBuffer) {
+  drawLod(commandBuffer, 0);
+}
+
+void HeliosModel::drawLod(VkCommandBuffer commandBuffer, uint32_t level,
+                          uint32_t instanceCount) {
   if (hasIndexBuffer) {
-    vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+    const Lod &lod = lods[level];
+    vkCmdDrawIndexed(commandBuffer, lod.indexCount, instanceCount,
+                     getFirstIndex() + lod.firstIndex, getVertexOffset(), 0);
   } else {
-    vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+    vkCmdDraw(commandBuffer, vertexCount, instanceCount, geometry.firstVertex,
+              0);
   }
 }
 
+void HeliosModel::drawSubmesh(VkCommandBuffer commandBuffer, uint32_t submesh,
+                              uint32_t level) {
+  if (hasIndexBuffer) {
+    const SubmeshRange &range = getSubmeshRange(submesh, level);
+    vkCmdDrawIndexed(commandBuffer, range.indexCount, 1,
+                     getFirstIndex() + range.firstIndex, getVertexOffset(),
+                     0);
+  } else {
+    vkCmdDraw(commandBuffer, vertexCount, 1, geometry.firstVertex, 0);
+  }
+}
+
+void HeliosModel::drawIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer,
+                               VkDeviceSize offset, uint32_t drawCount) {
+  constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+  if (heliosDevice.enabledFeatures.multiDrawIndirect) {
+    vkCmdDrawIndexedIndirect(commandBuffer, buffer, offset, drawCount, stride);
+    return;
+  }
+  for (uint32_t i = 0; i < drawCount; i++) {
+    vkCmdDrawIndexedIndirect(commandBuffer, buffer, offset + i * stride, 1,
+                             stride);
+  }
+}
+
+void HeliosModel::drawIndirectCount(VkCommandBuffer commandBuffer,
+                                    VkBuffer buffer, VkDeviceSize offset,
+                                    VkBuffer countBuffer,
+                                    VkDeviceSize countOffset,
+                                    uint32_t maxDrawCount) {
+  if (!heliosDevice.drawIndirectCountEnabled) {
+    drawIndirect(commandBuffer, buffer, offset, maxDrawCount);
+    return;
+  }
+  vkCmdDrawIndexedIndirectCount(commandBuffer, buffer, offset, countBuffer,
+                                countOffset, maxDrawCount,
+                                sizeof(VkDrawIndexedIndirectCommand));
+}
+
 void HeliosModel::bind(VkCommandBuffer commandBuffer) {
-  VkBuffer buffers[] = {vertexBuffer};
+  VkBuffer buffers[] = {geometry.positionBuffer, geometry.attributeBuffer};
+  VkDeviceSize offsets[] = {0, 0};
+  vkCmdBindVertexBuffers(commandBuffer, 0, 2, buffers, offsets);
+
+  if (hasIndexBuffer) {
+    vkCmdBindIndexBuffer(commandBuffer, geometry.indexBuffer, 0, indexType);
+  }
+}
+
+void HeliosModel::bindPositions(VkCommandBuffer commandBuffer) {
+  VkBuffer buffers[] = {geometry.positionBuffer};
   VkDeviceSize offsets[] = {0};
   vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
 
   if (hasIndexBuffer) {
-    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    vkCmdBindIndexBuffer(commandBuffer, geometry.indexBuffer, 0, indexType);
   }
 }
 
+uint32_t HeliosModel::positionStrideFor(VertexFormat format) {
+  return format == VertexFormat::Packed ? sizeof(PackedVertex::position)
+                                        : sizeof(Vertex::position);
+}
+
+uint32_t HeliosModel::attributeStrideFor(VertexFormat format) {
+  return format == VertexFormat::Packed
+             ? sizeof(PackedVertex) - sizeof(PackedVertex::position)
+             : sizeof(Vertex) - sizeof(Vertex::position);
+}
+
 std::vector<VkVertexInputBindingDescription>
 HeliosModel::Vertex::getBindingDescriptions() {
-  std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
+  std::vector<VkVertexInputBindingDescription> bindingDescriptions(2);
   bindingDescriptions[0].binding = 0;
-  bindingDescriptions[0].stride = sizeof(Vertex);
+  bindingDescriptions[0].stride = positionStrideFor(VertexFormat::Float);
   bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  bindingDescriptions[1].binding = 1;
+  bindingDescriptions[1].stride = attributeStrideFor(VertexFormat::Float);
+  bindingDescriptions[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
   return bindingDescriptions;
 }
 
@@ -147,20 +635,226 @@ std::vector<VkVertexInputAttributeDescription>
 HeliosModel::Vertex::getAttributeDescriptions() {
   std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
 
+  // offsets in the attribute stream, which starts after the position
+  constexpr uint32_t base = sizeof(Vertex::position);
+  attributeDescriptions.push_back({0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0});
+  attributeDescriptions.push_back(
+      {1, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color) - base});
+
+  attributeDescriptions.push_back(
+      {2, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal) - base});
   attributeDescriptions.push_back(
-      {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position)});
+      {3, 1, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv) - base});
+
+  return attributeDescriptions;
+}
+
+std::vector<VkVertexInputBindingDescription>
+HeliosModel::PackedVertex::getBindingDescriptions() {
+  std::vector<VkVertexInputBindingDescription> bindingDescriptions(2);
+  bindingDescriptions[0].binding = 0;
+  bindingDescriptions[0].stride = positionStrideFor(VertexFormat::Packed);
+  bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  bindingDescriptions[1].binding = 1;
+  bindingDescriptions[1].stride = attributeStrideFor(VertexFormat::Packed);
+  bindingDescriptions[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  return bindingDescriptions;
+}
+
+std::vector<VkVertexInputAttributeDescription>
+HeliosModel::PackedVertex::getAttributeDescriptions() {
+  std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
+
+  // same locations as Vertex so both formats share simple_shader.vert
+  constexpr uint32_t base = sizeof(PackedVertex::position);
+  attributeDescriptions.push_back({0, 0, VK_FORMAT_R16G16B16A16_SNORM, 0});
   attributeDescriptions.push_back(
-      {1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color)});
+      {1, 1, VK_FORMAT_R8G8B8A8_UNORM, offsetof(PackedVertex, color) - base});
 
   attributeDescriptions.push_back(
-      {2, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal)});
+      {2, 1, VK_FORMAT_R16G16_SNORM, offsetof(PackedVertex, normal) - base});
   attributeDescriptions.push_back(
-      {3, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv)});
+      {3, 1, VK_FORMAT_R16G16_SFLOAT, offsetof(PackedVertex, uv) - base});
 
   return attributeDescriptions;
 }
 
-void HeliosModel::Builder::loadModel(const std::string &filepath) {
+void HeliosModel::Builder::loadModel(const std::string &filepath,
+                                     ObjLoader loader) {
+  vertices.clear();
+  indices.clear();
+  meshlets.clear();
+  lods.clear();
+  submeshes.clear();
+  submeshRanges.clear();
+
+  switch (loader) {
+  case ObjLoader::TinyObj:
+    loadModelTinyObj(filepath);
+    break;
+  case ObjLoader::Native:
+    loadModelNative(filepath);
+    break;
+  }
+}
+
+void HeliosModel::Builder::optimize() {
+  addDefaultSubmesh();
+  // triangles are only reordered within their submesh
+  for (size_t i = 0; i < submeshes.size(); i++) {
+    const SubmeshRange &range = submeshRanges[i];
+    auto first = indices.begin() + range.firstIndex;
+    std::vector<uint32_t> part{first, first + range.indexCount};
+    HeliosMeshOptimizer::optimizeVertexCache(part, vertices.size());
+    HeliosMeshOptimizer::optimizeOverdraw(part, vertices);
+    std::copy(part.begin(), part.end(), first);
+  }
+  HeliosMeshOptimizer::optimizeVertexFetch(vertices, indices);
+}
+
+void HeliosModel::Builder::buildLods(uint32_t maxLevels) {
+  addDefaultSubmesh();
+  // drop the levels of an earlier call
+  if (!lods.empty()) {
+    indices.resize(lods[0].indexCount);
+    submeshRanges.resize(submeshes.size());
+  }
+  lods.clear();
+  lods.push_back({0, static_cast<uint32_t>(indices.size()), 0.f});
+  if (indices.empty()) {
+    return;
+  }
+
+  Bounds bounds = computeBounds();
+  const float maxError =
+      MAX_LOD_RELATIVE_ERROR * glm::length(bounds.max - bounds.min);
+
+  // every level is simplified from the full mesh, halving the triangles of
+  // each submesh separately so none of them disappears or bleeds into another
+  const std::vector<uint32_t> base{indices};
+  const std::vector<SubmeshRange> baseRanges{submeshRanges};
+  for (uint32_t level = 1; level < maxLevels; level++) {
+    std::vector<uint32_t> levelIndices{};
+    std::vector<SubmeshRange> levelRanges{};
+    float levelError = 0.f;
+    for (const SubmeshRange &range : baseRanges) {
+      auto first = base.begin() + range.firstIndex;
+      const std::vector<uint32_t> part{first, first + range.indexCount};
+      size_t target = std::max<size_t>(3, (part.size() / 3 >> level) * 3);
+      float error = 0.f;
+      auto simplified = HeliosMeshOptimizer::simplify(vertices, part, target,
+                                                      maxError, error);
+      HeliosMeshOptimizer::optimizeVertexCache(simplified, vertices.size());
+      levelRanges.push_back(
+          {static_cast<uint32_t>(indices.size() + levelIndices.size()),
+           static_cast<uint32_t>(simplified.size())});
+      levelIndices.insert(levelIndices.end(), simplified.begin(),
+                          simplified.end());
+      levelError = std::max(levelError, error);
+    }
+    // stop once the error bound keeps simplification from making progress
+    if (levelIndices.empty() ||
+        levelIndices.size() > lods.back().indexCount * 3 / 4) {
+      break;
+    }
+
+    lods.push_back({static_cast<uint32_t>(indices.size()),
+                    static_cast<uint32_t>(levelIndices.size()), levelError});
+    indices.insert(indices.end(), levelIndices.begin(), levelIndices.end());
+    submeshRanges.insert(submeshRanges.end(), levelRanges.begin(),
+                         levelRanges.end());
+  }
+}
+
+void HeliosModel::Builder::buildMeshlets() {
+  addDefaultSubmesh();
+  // meshlets never span submeshes, so culled draws keep their material
+  meshlets.clear();
+  for (size_t i = 0; i < submeshes.size(); i++) {
+    const SubmeshRange &range = submeshRanges[i];
+    auto first = indices.begin() + range.firstIndex;
+    const std::vector<uint32_t> part{first, first + range.indexCount};
+    for (Meshlet meshlet : HeliosMeshOptimizer::buildMeshlets(vertices, part)) {
+      meshlet.firstIndex += range.firstIndex;
+      meshlets.push_back(meshlet);
+    }
+  }
+}
+
+void HeliosModel::Builder::addDefaultSubmesh() {
+  if (!submeshes.empty() || indices.empty()) {
+    return;
+  }
+  submeshes.push_back({});
+  submeshRanges.clear();
+  if (lods.empty()) {
+    submeshRanges.push_back({0, static_cast<uint32_t>(indices.size())});
+  }
+  for (const Lod &lod : lods) {
+    submeshRanges.push_back({lod.firstIndex, lod.indexCount});
+  }
+}
+
+HeliosModel::Bounds HeliosModel::Builder::computeBounds() const {
+  if (vertices.empty()) {
+    return {};
+  }
+  Bounds result{};
+  positionBox(vertices.data(), vertices.size(), result.min, result.max);
+  result.center = (result.min + result.max) * 0.5f;
+  result.radius = std::sqrt(
+      maxDistanceSquared(vertices.data(), vertices.size(), result.center));
+  return result;
+}
+
+std::vector<HeliosModel::PackedVertex>
+HeliosModel::Builder::packVertices(const Bounds &bounds) const {
+  glm::vec3 center;
+  glm::vec3 halfExtent;
+  quantizationBox(bounds, center, halfExtent);
+
+  std::vector<PackedVertex> packed(vertices.size());
+  for (size_t i = 0; i < vertices.size(); i++) {
+    const Vertex &vertex = vertices[i];
+    glm::vec3 position = (vertex.position - center) / halfExtent;
+    packed[i].position[0] = quantizeSnorm16(position.x);
+    packed[i].position[1] = quantizeSnorm16(position.y);
+    packed[i].position[2] = quantizeSnorm16(position.z);
+    packed[i].normal = glm::packSnorm2x16(octahedralEncode(vertex.normal));
+    packed[i].color = glm::packUnorm4x8(glm::vec4{vertex.color, 1.f});
+    packed[i].uv = glm::packHalf2x16(vertex.uv);
+  }
+  return packed;
+}
+
+void HeliosModel::Builder::writeVertexStreams(
+    const Bounds &bounds, std::vector<uint8_t> &positions,
+    std::vector<uint8_t> &attributes) const {
+  static_assert(offsetof(Vertex, position) == 0 &&
+                    offsetof(PackedVertex, position) == 0,
+                "the position stream is the leading member of a vertex");
+
+  std::vector<PackedVertex> packed{};
+  auto interleaved = reinterpret_cast<const uint8_t *>(vertices.data());
+  if (vertexFormat == VertexFormat::Packed) {
+    packed = packVertices(bounds);
+    interleaved = reinterpret_cast<const uint8_t *>(packed.data());
+  }
+
+  const size_t positionStride = positionStrideFor(vertexFormat);
+  const size_t attributeStride = attributeStrideFor(vertexFormat);
+  const size_t stride = positionStride + attributeStride;
+  positions.resize(vertices.size() * positionStride);
+  attributes.resize(vertices.size() * attributeStride);
+  for (size_t i = 0; i < vertices.size(); i++) {
+    memcpy(positions.data() + i * positionStride, interleaved + i * stride,
+           positionStride);
+    memcpy(attributes.data() + i * attributeStride,
+           interleaved + i * stride + positionStride, attributeStride);
+  }
+}
+
+void HeliosModel::Builder::loadModelTinyObj(const std::string &filepath) {
   tinyobj::attrib_t attrib;
   std::vector<tinyobj::shape_t> shapes;
   std::vector<tinyobj::material_t> materials;
@@ -173,46 +867,40 @@ void HeliosModel::Builder::loadModel(const std::string &filepath) {
     throw std::runtime_error(warn + err);
   }
 
-  vertices.clear();
-  indices.clear();
-
-  std::unordered_map<Vertex, uint32_t> uniqueVertices{};
-
+  // a group per run of faces with the same material within each shape,
+  // matching what HeliosObjParser reports for o, g and usemtl records
+  std::vector<tinyobj::index_t> cornerIndices{};
+  std::vector<HeliosObjParser::Group> groups{};
   for (const auto &shape : shapes) {
-    for (const auto &index : shape.mesh.indices) {
-      Vertex vertex{};
-      if (index.vertex_index >= 0) {
-        vertex.position = {
-            attrib.vertices[3 * index.vertex_index + 0],
-            attrib.vertices[3 * index.vertex_index + 1],
-            attrib.vertices[3 * index.vertex_index + 2],
-        };
-        vertex.color = {
-            attrib.colors[3 * index.vertex_index + 0],
-            attrib.colors[3 * index.vertex_index + 1],
-            attrib.colors[3 * index.vertex_index + 2],
-        };
-      }
-      if (index.normal_index >= 0) {
-        vertex.normal = {
-            attrib.normals[3 * index.normal_index + 0],
-            attrib.normals[3 * index.normal_index + 1],
-            attrib.normals[3 * index.normal_index + 2],
-        };
-      }
-      if (index.texcoord_index >= 0) {
-        vertex.uv = {
-            attrib.texcoords[2 * index.texcoord_index + 0],
-            attrib.texcoords[2 * index.texcoord_index + 1],
-        };
+    const auto &mesh = shape.mesh;
+    size_t firstCorner = cornerIndices.size();
+    for (size_t face = 0; face < mesh.material_ids.size(); face++) {
+      int materialId = mesh.material_ids[face];
+      if (face == 0 || materialId != mesh.material_ids[face - 1]) {
+        HeliosObjParser::Group group{};
+        group.name = shape.name;
+        if (materialId >= 0 &&
+            static_cast<size_t>(materialId) < materials.size()) {
+          group.material = materials[materialId].name;
+        }
+        group.firstIndex = firstCorner + 3 * face;
+        groups.push_back(group);
       }
-      if (uniqueVertices.count(vertex) == 0) {
-        uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-        vertices.push_back(vertex);
-      }
-      indices.push_back(uniqueVertices[vertex]);
+      groups.back().indexCount += 3;
     }
+    cornerIndices.insert(cornerIndices.end(), mesh.indices.begin(),
+                         mesh.indices.end());
   }
+
+  buildVertices(attrib.vertices, attrib.colors, attrib.normals,
+                attrib.texcoords, cornerIndices, groups, *this);
+}
+
+void HeliosModel::Builder::loadModelNative(const std::string &filepath) {
+  auto obj = HeliosObjParser::parse(filepath);
+
+  buildVertices(obj.vertices, obj.colors, obj.normals, obj.texcoords,
+                obj.indices, obj.groups, *this);
 }
 
 } // namespace helios
@@ -1,6 +1,8 @@
 #pragma once
 
+#include "helios_buffer.hpp"
 #include "helios_device.hpp"
+#include "helios_geometry_arena.hpp"
 #include "vulkan/vulkan_core.h"
 
 #define GLM_FORCE_RADIANS
@@ -8,11 +10,17 @@
 #include <glm/glm.hpp>
 
 // std
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace helios {
 
+class HeliosMeshCache;
+class HeliosUploadBatch;
+
 class HeliosModel {
 
 public:
@@ -33,14 +41,146 @@ public:
     }
   };
 
+  // Quantized vertex, 20 bytes instead of 44. Positions are snorm16 relative
+  // to the model bounds and expanded by getDequantizeMatrix(), normals are
+  // octahedral snorm16 decoded in simple_shader.vert.
+  struct PackedVertex {
+    int16_t position[4]{};
+    uint32_t normal = 0;
+    uint32_t color = 0;
+    uint32_t uv = 0;
+
+    static std::vector<VkVertexInputBindingDescription>
+    getBindingDescriptions();
+    static std::vector<VkVertexInputAttributeDescription>
+    getAttributeDescriptions();
+  };
+
+  // The GPU buffers hold a vertex as two streams: the leading position
+  // member at binding 0 and the remaining attributes at binding 1, so depth
+  // only passes fetch just the positions.
+  enum class VertexFormat { Float, Packed };
+
+  static uint32_t positionStrideFor(VertexFormat format);
+  static uint32_t attributeStrideFor(VertexFormat format);
+
+  // Contiguous range of the index buffer with bounded vertex and triangle
+  // counts, culled as a unit by MeshletCullSystem. Layout matches the std430
+  // struct in meshlet_cull.comp.
+  struct Meshlet {
+    // model space center and radius
+    glm::vec4 boundingSphere{};
+    // axis and cutoff of the normal cone, the meshlet faces away from every
+    // eye with dot(center - eye, axis) >= cutoff * |center - eye| + radius.
+    // A cutoff of 1 never culls.
+    glm::vec4 cone{0.f, 0.f, 0.f, 1.f};
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    uint32_t padding[2]{};
+  };
+
+  // Index range of one level of detail. Level 0 is the full mesh, coarser
+  // levels follow it in the same index buffer and reuse its vertices.
+  struct Lod {
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    // model space distance the level may deviate from the full mesh by
+    float error = 0.f;
+  };
+
+  static constexpr uint32_t MAX_LODS = 4;
+
+  // Part of the mesh with its own name and material, e.g. one OBJ object,
+  // group or usemtl run. Every level of detail keeps the indices of a
+  // submesh contiguous so it can be drawn on its own.
+  struct Submesh {
+    std::string name{};
+    std::string material{};
+  };
+
+  struct SubmeshRange {
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+  };
+
+  // axis aligned box and bounding sphere
+  struct Bounds {
+    glm::vec3 min{};
+    glm::vec3 max{};
+    glm::vec3 center{};
+    float radius = 0.f;
+  };
+
+  enum class ObjLoader { TinyObj, Native };
+
+  struct LoadOptions {
+    ObjLoader loader = ObjLoader::TinyObj;
+    // read from / write to the binary .hmesh cache next to the source file
+    bool useCache = true;
+    // reorder for vertex cache, overdraw and vertex fetch after loading
+    bool optimize = false;
+    VertexFormat vertexFormat = VertexFormat::Float;
+    // split into meshlets for per cluster GPU culling
+    bool meshlets = false;
+    // append simplified levels of detail to the index buffer
+    bool lods = false;
+    // import through HeliosObjStreamer within memoryBudget bytes of host
+    // memory, for files too large to load whole; always goes through the
+    // cache and ignores loader, optimize, meshlets and lods
+    bool streaming = false;
+    size_t memoryBudget = size_t{256} << 20;
+  };
+
   struct Builder {
     std::vector<Vertex> vertices{};
     std::vector<uint32_t> indices{};
+    // format of the vertex buffer a HeliosModel built from this gets
+    VertexFormat vertexFormat = VertexFormat::Float;
+    // empty unless buildMeshlets() ran, drawn as one range otherwise
+    std::vector<Meshlet> meshlets{};
+    // empty unless buildLods() ran, then lods[0] covers the original indices
+    std::vector<Lod> lods{};
+    // in index order, submeshRanges holds submeshes.size() ranges per level
+    // of detail, level 0 first
+    std::vector<Submesh> submeshes{};
+    std::vector<SubmeshRange> submeshRanges{};
 
-    void loadModel(const std::string &filepath);
+    void loadModel(const std::string &filepath,
+                   ObjLoader loader = ObjLoader::TinyObj);
+    // runs the HeliosMeshOptimizer passes over vertices and indices
+    void optimize();
+    // simplifies the mesh into up to maxLevels levels of detail, call after
+    // optimize() since reordering afterwards would mix the levels up
+    void buildLods(uint32_t maxLevels = MAX_LODS);
+    // partitions the (level 0) indices into meshlets, call after any
+    // reordering
+    void buildMeshlets();
+    Bounds computeBounds() const;
+    // quantizes vertices relative to bounds, see PackedVertex
+    std::vector<PackedVertex> packVertices(const Bounds &bounds) const;
+    // de-interleaves the vertices, packed when vertexFormat says so, into
+    // the position and attribute streams of the GPU buffers
+    void writeVertexStreams(const Bounds &bounds,
+                            std::vector<uint8_t> &positions,
+                            std::vector<uint8_t> &attributes) const;
+
+  private:
+    // treats the whole mesh as one unnamed submesh when none were loaded
+    void addDefaultSubmesh();
+    void loadModelTinyObj(const std::string &filepath);
+    void loadModelNative(const std::string &filepath);
   };
 
-  HeliosModel(HeliosDevice &device, const HeliosModel::Builder &builder);
+  // Immediate copies the data to the GPU and waits for it in the
+  // constructor. Deferred only fills staging memory, which is safe off the
+  // main thread; the owner then adds the copies to a batch with addUploads()
+  // and calls finishUpload() once they have executed.
+  enum class Upload { Immediate, Deferred };
+
+  HeliosModel(HeliosDevice &device, const HeliosModel::Builder &builder,
+              Upload upload = Upload::Immediate);
+  HeliosModel(HeliosDevice &device, const HeliosMeshCache &cache,
+              Upload upload = Upload::Immediate);
   ~HeliosModel();
 
   HeliosModel(const HeliosModel &) = delete;
@@ -48,24 +188,128 @@ public:
 
   static std::unique_ptr<HeliosModel>
   createModelFromFile(HeliosDevice &device, const std::string &filepath);
+  static std::unique_ptr<HeliosModel>
+  createModelFromFile(HeliosDevice &device, const std::string &filepath,
+                      const LoadOptions &options,
+                      Upload upload = Upload::Immediate);
+
+  // false until the upload finished, models must not be drawn before
+  bool isReady() const { return ready.load(std::memory_order_acquire); }
+  void addUploads(HeliosUploadBatch &batch) const;
+  // releases the staging memory and marks the model ready
+  void finishUpload();
 
+  // Binds the geometry arena block holding the model. Models with equal
+  // sharesBindingWith() can be drawn after each other without rebinding.
   void bind(VkCommandBuffer commandBuffer);
+  // binds only the position stream (and indices), for pipelines from
+  // HeliosPipeline::positionOnlyPipelineConfigInfo
+  void bindPositions(VkCommandBuffer commandBuffer);
+  bool sharesBindingWith(const HeliosModel &other) const {
+    return geometry.positionBuffer == other.geometry.positionBuffer &&
+           indexType == other.indexType;
+  }
+  // draws level of detail 0
   void draw(VkCommandBuffer commandBuffer);
+  void drawLod(VkCommandBuffer commandBuffer, uint32_t level,
+               uint32_t instanceCount = 1);
+  void drawSubmesh(VkCommandBuffer commandBuffer, uint32_t submesh,
+                   uint32_t level = 0);
+  // draws drawCount VkDrawIndexedIndirectCommands from buffer, e.g. the
+  // per meshlet commands written by MeshletCullSystem
+  void drawIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer,
+                    VkDeviceSize offset, uint32_t drawCount);
+  // Draws as many commands as the uint32_t at countOffset in countBuffer
+  // says, at most maxDrawCount. Without the drawIndirectCount feature all
+  // maxDrawCount commands are drawn, unused ones must have no instances.
+  void drawIndirectCount(VkCommandBuffer commandBuffer, VkBuffer buffer,
+                         VkDeviceSize offset, VkBuffer countBuffer,
+                         VkDeviceSize countOffset, uint32_t maxDrawCount);
+
+  const Bounds &getBounds() const { return bounds; }
+  bool isIndexed() const { return hasIndexBuffer; }
+  // VK_INDEX_TYPE_UINT16 whenever every vertex can be indexed with it
+  VkIndexType getIndexType() const { return indexType; }
+  // where the model starts in the bound arena block, to be added to the
+  // firstIndex and vertexOffset of draws that don't go through the model
+  uint32_t getFirstIndex() const {
+    return static_cast<uint32_t>(
+        geometry.indexOffset /
+        (indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t)
+                                           : sizeof(uint32_t)));
+  }
+  int32_t getVertexOffset() const {
+    return static_cast<int32_t>(geometry.firstVertex);
+  }
+  VertexFormat getVertexFormat() const { return vertexFormat; }
+  // maps vertex positions to model space, identity unless packed
+  const glm::mat4 &getDequantizeMatrix() const { return dequantizeMatrix; }
+
+  static glm::mat4 dequantizeMatrixFor(const Bounds &bounds);
+
+  uint32_t getLodCount() const { return static_cast<uint32_t>(lods.size()); }
+  const Lod &getLod(uint32_t level) const { return lods[level]; }
+
+  uint32_t getSubmeshCount() const {
+    return static_cast<uint32_t>(submeshes.size());
+  }
+  const Submesh &getSubmesh(uint32_t submesh) const {
+    return submeshes[submesh];
+  }
+  const SubmeshRange &getSubmeshRange(uint32_t submesh,
+                                      uint32_t level = 0) const {
+    return submeshRanges[level * submeshes.size() + submesh];
+  }
+
+  bool hasMeshlets() const { return meshletCount > 0; }
+  uint32_t getMeshletCount() const { return meshletCount; }
+  VkDescriptorBufferInfo meshletBufferInfo() const {
+    return meshletBuffer->descriptorInfo();
+  }
 
 private:
-  void createVertexBuffers(const std::vector<Vertex> &vertices);
-  void createIndexBuffer(const std::vector<uint32_t> &indices);
+  struct PendingUpload {
+    HeliosStagingRing::Region staging;
+    VkBuffer dstBuffer;
+    VkDeviceSize dstOffset;
+    VkDeviceSize size;
+  };
+
+  void stageUpload(const void *data, VkDeviceSize size, VkBuffer dstBuffer,
+                   VkDeviceSize dstOffset = 0);
+  void uploadImmediately();
+  // allocates the vertices and indices from the geometry arena of
+  // vertexFormat and stages their upload
+  void createGeometry(const void *positions, const void *attributes,
+                      uint32_t vertices, const uint32_t *indices,
+                      uint32_t indexTotal);
+  void createMeshletBuffer(const Meshlet *meshlets, uint32_t count);
+  void createLods(const Lod *levels, uint32_t count);
+  // ranges holds count ranges per level of detail, call after createLods
+  void createSubmeshes(const Submesh *parts, uint32_t count,
+                       const SubmeshRange *ranges);
 
   HeliosDevice &heliosDevice;
+  Bounds bounds{};
+  VertexFormat vertexFormat;
+  glm::mat4 dequantizeMatrix{1.f};
 
-  VkBuffer vertexBuffer;
-  VkDeviceMemory vertexBufferMemory;
+  HeliosGeometryArena &geometryArena;
+  HeliosGeometryArena::Range geometry{};
   uint32_t vertexCount;
 
   bool hasIndexBuffer = false;
-  VkBuffer indexBuffer;
-  VkDeviceMemory indexBufferMemory;
   uint32_t indexCount;
+  VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+  std::vector<Lod> lods;
+  std::vector<Submesh> submeshes;
+  std::vector<SubmeshRange> submeshRanges;
+
+  std::unique_ptr<HeliosBuffer> meshletBuffer;
+  uint32_t meshletCount = 0;
+
+  std::vector<PendingUpload> pendingUploads;
+  std::atomic<bool> ready{false};
 };
 
 } // namespace helios
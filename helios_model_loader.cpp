@@ -0,0 +1,74 @@
+#include "helios_model_loader.hpp"
+
+namespace helios {
+
+HeliosModelLoader::HeliosModelLoader(HeliosDevice &device,
+                                     HeliosModelRegistry *registry,
+                                     unsigned threadCount)
+    : heliosDevice{device}, registry{registry}, workers{threadCount} {}
+
+HeliosModelLoader::~HeliosModelLoader() {
+  if (!uploadBatches.empty()) {
+    heliosDevice.waitForUpload(uploadBatches.back().value);
+  }
+}
+
+std::shared_future<std::shared_ptr<HeliosModel>>
+HeliosModelLoader::loadAsync(const std::string &filepath) {
+  return loadAsync(filepath, HeliosModel::LoadOptions{});
+}
+
+std::shared_future<std::shared_ptr<HeliosModel>>
+HeliosModelLoader::loadAsync(const std::string &filepath,
+                             const HeliosModel::LoadOptions &options) {
+  auto load = [this, filepath, options]() {
+    std::shared_ptr<HeliosModel> model = HeliosModel::createModelFromFile(
+        heliosDevice, filepath, options, HeliosModel::Upload::Deferred);
+    std::lock_guard<std::mutex> lock{stagedMutex};
+    stagedModels.push_back(model);
+    return model;
+  };
+  return workers
+      .submit([this, filepath, options, load]() {
+        return registry ? registry->acquire(filepath, options, load) : load();
+      })
+      .share();
+}
+
+void HeliosModelLoader::update() {
+  UploadBatch batch{};
+  {
+    std::lock_guard<std::mutex> lock{stagedMutex};
+    batch.models.swap(stagedModels);
+  }
+  if (batch.models.empty()) {
+    return;
+  }
+
+  // a single submission for every model
+  batch.uploads = std::make_unique<HeliosUploadBatch>(heliosDevice);
+  for (auto &model : batch.models) {
+    model->addUploads(*batch.uploads);
+  }
+  batch.value = batch.uploads->submit();
+  uploadBatches.push_back(std::move(batch));
+}
+
+uint64_t HeliosModelLoader::acquireUploads(VkCommandBuffer commandBuffer) {
+  // only uploads that already completed, so the frame never stalls on one
+  uint64_t completed = heliosDevice.completedUploadValue();
+  uint64_t waitValue = 0;
+  auto it = uploadBatches.begin();
+  while (it != uploadBatches.end() && it->value <= completed) {
+    it->uploads->recordAcquire(commandBuffer);
+    for (auto &model : it->models) {
+      model->finishUpload();
+    }
+    waitValue = it->value;
+    ++it;
+  }
+  uploadBatches.erase(uploadBatches.begin(), it);
+  return waitValue;
+}
+
+} // namespace helios
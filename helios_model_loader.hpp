@@ -0,0 +1,78 @@
+#pragma once
+
+#include "helios_device.hpp"
+#include "helios_model.hpp"
+#include "helios_model_registry.hpp"
+#include "helios_thread_pool.hpp"
+#include "helios_upload_batch.hpp"
+
+// std
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace helios {
+
+// Loads models on a pool of worker threads. A worker parses and processes the
+// file (or maps its mesh cache) and copies the model's data into the
+// device's staging ring; update() then submits the copies of all models
+// staged since the last call to the device's transfer queue in one command
+// buffer. Once that upload completed, acquireUploads() releases their
+// staging memory and marks them ready, and the frame drawing them first
+// waits for the upload semaphore. Render systems skip models that are not
+// ready yet.
+class HeliosModelLoader {
+public:
+  // Loads go through registry when given, so a model that is resident or
+  // already loading is shared. threadCount of 0 uses
+  // std::thread::hardware_concurrency().
+  HeliosModelLoader(HeliosDevice &device,
+                    HeliosModelRegistry *registry = nullptr,
+                    unsigned threadCount = 0);
+  // waits for submitted uploads; loads still queued finish but are never
+  // uploaded, and models not acquired yet never become ready
+  ~HeliosModelLoader();
+
+  HeliosModelLoader(const HeliosModelLoader &) = delete;
+  HeliosModelLoader &operator=(const HeliosModelLoader &) = delete;
+
+  // The future holds the model once it is staged, which can be assigned to
+  // game objects right away. get() rethrows load errors.
+  std::shared_future<std::shared_ptr<HeliosModel>>
+  loadAsync(const std::string &filepath);
+  std::shared_future<std::shared_ptr<HeliosModel>>
+  loadAsync(const std::string &filepath,
+            const HeliosModel::LoadOptions &options);
+
+  // Submits the uploads staged since the last call, without waiting for
+  // them. Call once a frame from the render thread.
+  void update();
+  // Marks the models whose upload completed ready, recording any image
+  // ownership acquisitions into a graphics command buffer outside a render
+  // pass. Returns the upload semaphore value the submission
+  // of commandBuffer has to wait for, 0 when none.
+  uint64_t acquireUploads(VkCommandBuffer commandBuffer);
+
+private:
+  struct UploadBatch {
+    std::unique_ptr<HeliosUploadBatch> uploads;
+    // of HeliosDevice::uploadSemaphore()
+    uint64_t value;
+    std::vector<std::shared_ptr<HeliosModel>> models;
+  };
+
+  HeliosDevice &heliosDevice;
+  HeliosModelRegistry *registry;
+
+  std::mutex stagedMutex;
+  std::vector<std::shared_ptr<HeliosModel>> stagedModels;
+  std::vector<UploadBatch> uploadBatches;
+
+  // declared last so the workers are joined before the state they use is
+  // destroyed
+  HeliosThreadPool workers;
+};
+
+} // namespace helios
@@ -0,0 +1,135 @@
+#include "helios_model_registry.hpp"
+#include "helios_utils.hpp"
+
+// std
+#include <filesystem>
+
+namespace helios {
+
+size_t HeliosModelRegistry::KeyHash::operator()(const Key &key) const {
+  size_t seed = 0;
+  hashCombine(seed, key.path, key.options);
+  return seed;
+}
+
+HeliosModelRegistry::Key
+HeliosModelRegistry::makeKey(const std::string &filepath,
+                             const HeliosModel::LoadOptions &options) {
+  std::error_code error;
+  auto canonical = std::filesystem::weakly_canonical(filepath, error);
+
+  // useCache is left out, it only changes how fast the same model loads
+  uint32_t bits = 0;
+  bits |= (options.loader == HeliosModel::ObjLoader::Native) << 0;
+  bits |= options.optimize << 1;
+  bits |= (options.vertexFormat == HeliosModel::VertexFormat::Packed) << 2;
+  bits |= options.meshlets << 3;
+  bits |= options.lods << 4;
+  // the budget only changes how the same model is imported
+  bits |= options.streaming << 5;
+  return {error ? filepath : canonical.string(), bits};
+}
+
+std::shared_ptr<HeliosModel>
+HeliosModelRegistry::acquire(const std::string &filepath,
+                             const HeliosModel::LoadOptions &options,
+                             const LoadFunction &load) {
+  Key key = makeKey(filepath, options);
+  std::promise<std::shared_ptr<HeliosModel>> promise;
+  std::shared_future<std::shared_ptr<HeliosModel>> pending;
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+      if (auto model = it->second.model.lock()) {
+        hits++;
+        return model;
+      }
+      if (it->second.loading.valid()) {
+        hits++;
+        pending = it->second.loading;
+      }
+    }
+    if (!pending.valid()) {
+      // misses are rare and cost a load, sweeping on them keeps the map
+      // bounded by the resident models without a sweep per frame
+      misses++;
+      evictExpiredLocked();
+      entries[key].loading = promise.get_future().share();
+    }
+  }
+  if (pending.valid()) {
+    return pending.get();
+  }
+
+  std::shared_ptr<HeliosModel> model;
+  try {
+    model = load();
+  } catch (...) {
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      entries.erase(key);
+    }
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    Entry &entry = entries[key];
+    entry.model = model;
+    entry.loading = {};
+  }
+  promise.set_value(model);
+  return model;
+}
+
+std::shared_ptr<HeliosModel>
+HeliosModelRegistry::getModel(HeliosDevice &device,
+                              const std::string &filepath) {
+  return getModel(device, filepath, HeliosModel::LoadOptions{});
+}
+
+std::shared_ptr<HeliosModel>
+HeliosModelRegistry::getModel(HeliosDevice &device,
+                              const std::string &filepath,
+                              const HeliosModel::LoadOptions &options) {
+  return acquire(filepath, options, [&device, &filepath, &options]() {
+    return HeliosModel::createModelFromFile(device, filepath, options);
+  });
+}
+
+size_t HeliosModelRegistry::evictExpired() {
+  std::lock_guard<std::mutex> lock{mutex};
+  return evictExpiredLocked();
+}
+
+size_t HeliosModelRegistry::evictExpiredLocked() {
+  size_t evicted = 0;
+  for (auto it = entries.begin(); it != entries.end();) {
+    if (it->second.model.expired() && !it->second.loading.valid()) {
+      it = entries.erase(it);
+      evicted++;
+    } else {
+      ++it;
+    }
+  }
+  evictions += evicted;
+  return evicted;
+}
+
+HeliosModelRegistry::Stats HeliosModelRegistry::getStats() const {
+  std::lock_guard<std::mutex> lock{mutex};
+  Stats stats{};
+  stats.hits = hits;
+  stats.misses = misses;
+  stats.evictions = evictions;
+  for (const auto &[key, entry] : entries) {
+    if (!entry.model.expired()) {
+      stats.residentModels++;
+    }
+  }
+  return stats;
+}
+
+} // namespace helios
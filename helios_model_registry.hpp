@@ -0,0 +1,89 @@
+#pragma once
+
+#include "helios_device.hpp"
+#include "helios_model.hpp"
+
+// std
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace helios {
+
+// Shares models between everything that loads the same file with the same
+// options. Entries are keyed by canonical path and hold only weak
+// references, so a model is destroyed with its last user and its entry is
+// evicted by the next miss. Thread safe.
+class HeliosModelRegistry {
+public:
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t residentModels = 0;
+  };
+
+  using LoadFunction = std::function<std::shared_ptr<HeliosModel>()>;
+
+  HeliosModelRegistry() = default;
+
+  HeliosModelRegistry(const HeliosModelRegistry &) = delete;
+  HeliosModelRegistry &operator=(const HeliosModelRegistry &) = delete;
+
+  // Returns the resident model for filepath and options or calls load to
+  // create it. Concurrent requests for a model that is still loading wait
+  // for that load instead of starting another; its errors are rethrown.
+  std::shared_ptr<HeliosModel> acquire(const std::string &filepath,
+                                       const HeliosModel::LoadOptions &options,
+                                       const LoadFunction &load);
+
+  // acquire() with a blocking HeliosModel::createModelFromFile
+  std::shared_ptr<HeliosModel> getModel(HeliosDevice &device,
+                                        const std::string &filepath);
+  std::shared_ptr<HeliosModel>
+  getModel(HeliosDevice &device, const std::string &filepath,
+           const HeliosModel::LoadOptions &options);
+
+  // drops the entries of destroyed models, returns how many; acquire() does
+  // this on every miss
+  size_t evictExpired();
+
+  Stats getStats() const;
+
+private:
+  struct Key {
+    std::string path;
+    uint32_t options;
+
+    bool operator==(const Key &other) const {
+      return options == other.options && path == other.path;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key &key) const;
+  };
+
+  struct Entry {
+    std::weak_ptr<HeliosModel> model;
+    // valid while the first request is loading the model
+    std::shared_future<std::shared_ptr<HeliosModel>> loading;
+  };
+
+  static Key makeKey(const std::string &filepath,
+                     const HeliosModel::LoadOptions &options);
+  // with mutex held
+  size_t evictExpiredLocked();
+
+  mutable std::mutex mutex;
+  std::unordered_map<Key, Entry, KeyHash> entries;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+};
+
+} // namespace helios
@@ -0,0 +1,612 @@
+#include "helios_obj_parser.hpp"
+#include "helios_mapped_file.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace helios {
+
+namespace {
+
+// below this size per chunk the thread start up cost outweighs the parsing
+constexpr size_t MIN_CHUNK_SIZE = 64 * 1024;
+
+enum class RecordType {
+  Vertex,
+  Normal,
+  Texcoord,
+  Face,
+  // o and g, both name the faces that follow
+  Name,
+  Material,
+  Other
+};
+
+// a name or usemtl record, applying from index offset on within its chunk
+struct GroupMarker {
+  size_t offset;
+  RecordType type;
+  std::string value;
+};
+
+// which records a parsing pass fills in, the others are only counted
+enum class Records { All, Attributes, Faces };
+
+// where a parsing pass writes vertex attributes: the arrays of the whole
+// file, or arrays holding just the chunk's own records
+enum class AttributeSlots { Global, ChunkLocal };
+
+// records of each attribute type in the whole file
+struct RecordCounts {
+  size_t vertices = 0;
+  size_t normals = 0;
+  size_t texcoords = 0;
+};
+
+struct Chunk {
+  const char *begin;
+  const char *end;
+
+  size_t vertexCount = 0;
+  size_t normalCount = 0;
+  size_t texcoordCount = 0;
+  size_t faceCount = 0;
+
+  // global element offsets of the first record in this chunk
+  size_t vertexBase = 0;
+  size_t normalBase = 0;
+  size_t texcoordBase = 0;
+
+  std::vector<HeliosObjParser::Index> indices{};
+  std::vector<GroupMarker> markers{};
+};
+
+inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+inline const char *skipSpace(const char *p, const char *end) {
+  while (p < end && isSpace(*p)) {
+    p++;
+  }
+  return p;
+}
+
+inline const char *lineEnd(const char *p, const char *end) {
+  auto newline =
+      static_cast<const char *>(memchr(p, '\n', static_cast<size_t>(end - p)));
+  return newline == nullptr ? end : newline;
+}
+
+// Classifies the line starting at p and advances p past the keyword.
+RecordType readRecordType(const char *&p, const char *end) {
+  p = skipSpace(p, end);
+  if (end - p < 2) {
+    return RecordType::Other;
+  }
+  if (p[0] == 'v') {
+    if (isSpace(p[1])) {
+      p += 1;
+      return RecordType::Vertex;
+    }
+    if (end - p >= 3 && isSpace(p[2])) {
+      if (p[1] == 'n') {
+        p += 2;
+        return RecordType::Normal;
+      }
+      if (p[1] == 't') {
+        p += 2;
+        return RecordType::Texcoord;
+      }
+    }
+  } else if (p[0] == 'f' && isSpace(p[1])) {
+    p += 1;
+    return RecordType::Face;
+  } else if ((p[0] == 'o' || p[0] == 'g') && isSpace(p[1])) {
+    p += 1;
+    return RecordType::Name;
+  } else if (end - p >= 7 && memcmp(p, "usemtl", 6) == 0 && isSpace(p[6])) {
+    p += 6;
+    return RecordType::Material;
+  }
+  return RecordType::Other;
+}
+
+// Decimal float parser for the plain notation OBJ exporters write. The
+// mantissa is accumulated as an integer and scaled once by an exact power of
+// ten, which is both faster than strtof and free of locale lookups.
+bool parseFloat(const char *&p, const char *end, float &out) {
+  static constexpr double POWERS_OF_TEN[] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  constexpr int MAX_EXACT_POWER = 22;
+  constexpr int MAX_MANTISSA_DIGITS = 19;
+
+  const char *s = skipSpace(p, end);
+
+  bool negative = false;
+  if (s < end && (*s == '-' || *s == '+')) {
+    negative = *s == '-';
+    s++;
+  }
+
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool anyDigits = false;
+
+  while (s < end && isDigit(*s)) {
+    if (digits < MAX_MANTISSA_DIGITS) {
+      mantissa = mantissa * 10 + static_cast<uint64_t>(*s - '0');
+      if (mantissa != 0) {
+        digits++;
+      }
+    } else {
+      exponent++;
+    }
+    anyDigits = true;
+    s++;
+  }
+
+  if (s < end && *s == '.') {
+    s++;
+    while (s < end && isDigit(*s)) {
+      if (digits < MAX_MANTISSA_DIGITS) {
+        mantissa = mantissa * 10 + static_cast<uint64_t>(*s - '0');
+        if (mantissa != 0) {
+          digits++;
+        }
+        exponent--;
+      }
+      anyDigits = true;
+      s++;
+    }
+  }
+
+  if (!anyDigits) {
+    return false;
+  }
+
+  if (s < end && (*s == 'e' || *s == 'E')) {
+    const char *e = s + 1;
+    bool negativeExponent = false;
+    if (e < end && (*e == '-' || *e == '+')) {
+      negativeExponent = *e == '-';
+      e++;
+    }
+    if (e < end && isDigit(*e)) {
+      int value = 0;
+      while (e < end && isDigit(*e)) {
+        if (value < 10000) {
+          value = value * 10 + (*e - '0');
+        }
+        e++;
+      }
+      exponent += negativeExponent ? -value : value;
+      s = e;
+    }
+  }
+
+  double value = static_cast<double>(mantissa);
+  if (exponent < 0) {
+    value = -exponent <= MAX_EXACT_POWER ? value / POWERS_OF_TEN[-exponent]
+                                         : value * std::pow(10.0, exponent);
+  } else if (exponent > 0) {
+    value = exponent <= MAX_EXACT_POWER ? value * POWERS_OF_TEN[exponent]
+                                        : value * std::pow(10.0, exponent);
+  }
+
+  out = static_cast<float>(negative ? -value : value);
+  p = s;
+  return true;
+}
+
+bool parseInt(const char *&p, const char *end, int &out) {
+  const char *s = p;
+  bool negative = false;
+  if (s < end && (*s == '-' || *s == '+')) {
+    negative = *s == '-';
+    s++;
+  }
+  if (s >= end || !isDigit(*s)) {
+    return false;
+  }
+  int value = 0;
+  while (s < end && isDigit(*s)) {
+    value = value * 10 + (*s - '0');
+    s++;
+  }
+  out = negative ? -value : value;
+  p = s;
+  return true;
+}
+
+// OBJ indices are 1-based, negative values are relative to the number of
+// elements declared so far. Returns -1 for an absent element.
+int resolveIndex(int index, size_t declared, size_t total) {
+  if (index == 0) {
+    throw std::runtime_error("invalid OBJ face index 0");
+  }
+  long resolved = index > 0 ? static_cast<long>(index) - 1
+                            : static_cast<long>(declared) + index;
+  if (resolved < 0 || static_cast<size_t>(resolved) >= total) {
+    throw std::runtime_error("OBJ face index out of range");
+  }
+  return static_cast<int>(resolved);
+}
+
+void countRecords(Chunk &chunk) {
+  const char *p = chunk.begin;
+  while (p < chunk.end) {
+    const char *end = lineEnd(p, chunk.end);
+    switch (readRecordType(p, end)) {
+    case RecordType::Vertex:
+      chunk.vertexCount++;
+      break;
+    case RecordType::Normal:
+      chunk.normalCount++;
+      break;
+    case RecordType::Texcoord:
+      chunk.texcoordCount++;
+      break;
+    case RecordType::Face:
+      chunk.faceCount++;
+      break;
+    case RecordType::Name:
+    case RecordType::Material:
+    case RecordType::Other:
+      break;
+    }
+    p = end < chunk.end ? end + 1 : end;
+  }
+}
+
+void parseRecords(Chunk &chunk, HeliosObjParser::Result &result,
+                  const RecordCounts &totals, Records records = Records::All,
+                  AttributeSlots slots = AttributeSlots::Global) {
+  const bool parseAttributes = records != Records::Faces;
+  const bool parseFaces = records != Records::Attributes;
+  const size_t totalVertices = totals.vertices;
+  const size_t totalNormals = totals.normals;
+  const size_t totalTexcoords = totals.texcoords;
+
+  size_t vertexCount = chunk.vertexBase;
+  size_t normalCount = chunk.normalBase;
+  size_t texcoordCount = chunk.texcoordBase;
+  // subtracted from the counts to get the slot of an attribute
+  const bool local = slots == AttributeSlots::ChunkLocal;
+  const size_t vertexSlotBase = local ? chunk.vertexBase : 0;
+  const size_t normalSlotBase = local ? chunk.normalBase : 0;
+  const size_t texcoordSlotBase = local ? chunk.texcoordBase : 0;
+
+  std::vector<HeliosObjParser::Index> polygon;
+  if (parseFaces) {
+    chunk.indices.reserve(chunk.faceCount * 3);
+  }
+
+  const char *p = chunk.begin;
+  while (p < chunk.end) {
+    const char *end = lineEnd(p, chunk.end);
+
+    RecordType type = readRecordType(p, end);
+    if (!parseAttributes &&
+        (type == RecordType::Vertex || type == RecordType::Normal ||
+         type == RecordType::Texcoord)) {
+      // still counted, relative face indices depend on them
+      vertexCount += type == RecordType::Vertex;
+      normalCount += type == RecordType::Normal;
+      texcoordCount += type == RecordType::Texcoord;
+      type = RecordType::Other;
+    } else if (!parseFaces && type != RecordType::Vertex &&
+               type != RecordType::Normal && type != RecordType::Texcoord) {
+      type = RecordType::Other;
+    }
+    switch (type) {
+    case RecordType::Vertex: {
+      float *position = &result.vertices[3 * (vertexCount - vertexSlotBase)];
+      float *color = &result.colors[3 * (vertexCount - vertexSlotBase)];
+      if (!parseFloat(p, end, position[0]) ||
+          !parseFloat(p, end, position[1]) ||
+          !parseFloat(p, end, position[2])) {
+        throw std::runtime_error("malformed OBJ vertex record");
+      }
+      // optional per vertex color extension, white when absent
+      float rgb[3];
+      if (parseFloat(p, end, rgb[0]) && parseFloat(p, end, rgb[1]) &&
+          parseFloat(p, end, rgb[2])) {
+        color[0] = rgb[0];
+        color[1] = rgb[1];
+        color[2] = rgb[2];
+      } else {
+        color[0] = color[1] = color[2] = 1.0f;
+      }
+      vertexCount++;
+      break;
+    }
+    case RecordType::Normal: {
+      float *normal = &result.normals[3 * (normalCount - normalSlotBase)];
+      if (!parseFloat(p, end, normal[0]) || !parseFloat(p, end, normal[1]) ||
+          !parseFloat(p, end, normal[2])) {
+        throw std::runtime_error("malformed OBJ normal record");
+      }
+      normalCount++;
+      break;
+    }
+    case RecordType::Texcoord: {
+      float *texcoord =
+          &result.texcoords[2 * (texcoordCount - texcoordSlotBase)];
+      if (!parseFloat(p, end, texcoord[0])) {
+        throw std::runtime_error("malformed OBJ texcoord record");
+      }
+      if (!parseFloat(p, end, texcoord[1])) {
+        texcoord[1] = 0.0f;
+      }
+      texcoordCount++;
+      break;
+    }
+    case RecordType::Face: {
+      polygon.clear();
+      while (true) {
+        p = skipSpace(p, end);
+        if (p >= end) {
+          break;
+        }
+
+        int value;
+        HeliosObjParser::Index index{};
+        if (!parseInt(p, end, value)) {
+          throw std::runtime_error("malformed OBJ face record");
+        }
+        index.vertex_index = resolveIndex(value, vertexCount, totalVertices);
+        if (p < end && *p == '/') {
+          p++;
+          if (parseInt(p, end, value)) {
+            index.texcoord_index =
+                resolveIndex(value, texcoordCount, totalTexcoords);
+          }
+          if (p < end && *p == '/') {
+            p++;
+            if (parseInt(p, end, value)) {
+              index.normal_index =
+                  resolveIndex(value, normalCount, totalNormals);
+            }
+          }
+        }
+        polygon.push_back(index);
+
+        while (p < end && !isSpace(*p)) {
+          p++;
+        }
+      }
+
+      // fan triangulation, matching tinyobj for convex polygons
+      for (size_t i = 1; i + 1 < polygon.size(); i++) {
+        chunk.indices.push_back(polygon[0]);
+        chunk.indices.push_back(polygon[i]);
+        chunk.indices.push_back(polygon[i + 1]);
+      }
+      break;
+    }
+    case RecordType::Name:
+    case RecordType::Material: {
+      const char *valueBegin = skipSpace(p, end);
+      const char *valueEnd = end;
+      while (valueEnd > valueBegin && isSpace(valueEnd[-1])) {
+        valueEnd--;
+      }
+      chunk.markers.push_back(
+          {chunk.indices.size(), type, std::string{valueBegin, valueEnd}});
+      break;
+    }
+    case RecordType::Other:
+      break;
+    }
+
+    p = end < chunk.end ? end + 1 : end;
+  }
+}
+
+// Splits [data, data + size) into chunkCount roughly equal chunks, moving
+// every split point to the start of the following line so no record
+// straddles two chunks.
+std::vector<Chunk> splitChunks(const char *data, size_t size,
+                               size_t chunkCount) {
+  std::vector<Chunk> chunks(chunkCount);
+  const char *begin = data;
+  for (size_t i = 0; i < chunkCount; i++) {
+    const char *end = data + size;
+    if (i + 1 < chunkCount) {
+      end = std::max(begin, data + size * (i + 1) / chunkCount);
+      end = std::min(lineEnd(end, data + size) + 1, data + size);
+    }
+    chunks[i].begin = begin;
+    chunks[i].end = end;
+    begin = end;
+  }
+  return chunks;
+}
+
+// Runs work on chunks [first, first + count), one per thread.
+template <typename Work>
+void forEachChunk(Chunk *first, size_t count, Work &&work) {
+  std::vector<std::future<void>> tasks;
+  tasks.reserve(count - 1);
+  for (size_t i = 1; i < count; i++) {
+    tasks.push_back(
+        std::async(std::launch::async, [&work, first, i] { work(first[i]); }));
+  }
+  work(first[0]);
+  // get() rethrows parse errors from the workers
+  for (auto &task : tasks) {
+    task.get();
+  }
+}
+
+// first pass: counts records so every chunk knows where its vertex
+// attributes land in the output and can resolve relative indices
+RecordCounts countAllRecords(std::vector<Chunk> &chunks,
+                             unsigned threadCount) {
+  for (size_t i = 0; i < chunks.size(); i += threadCount) {
+    forEachChunk(&chunks[i], std::min<size_t>(threadCount, chunks.size() - i),
+                 [](Chunk &chunk) { countRecords(chunk); });
+  }
+
+  RecordCounts totals{};
+  for (auto &chunk : chunks) {
+    chunk.vertexBase = totals.vertices;
+    chunk.normalBase = totals.normals;
+    chunk.texcoordBase = totals.texcoords;
+    totals.vertices += chunk.vertexCount;
+    totals.normals += chunk.normalCount;
+    totals.texcoords += chunk.texcoordCount;
+  }
+  return totals;
+}
+
+void resizeAttributes(HeliosObjParser::Result &result, size_t vertices,
+                      size_t normals, size_t texcoords) {
+  result.vertices.resize(3 * vertices);
+  result.colors.resize(3 * vertices);
+  result.normals.resize(3 * normals);
+  result.texcoords.resize(2 * texcoords);
+}
+
+void closeGroup(HeliosObjParser::Result &result,
+                HeliosObjParser::Group &current) {
+  current.indexCount = result.indices.size() - current.firstIndex;
+  if (current.indexCount > 0) {
+    result.groups.push_back(current);
+  }
+  current.firstIndex = result.indices.size();
+}
+
+// Appends the faces of chunk to result. A new group starts at every marker,
+// current is the group left open by the previous chunk.
+void appendFaces(const Chunk &chunk, HeliosObjParser::Result &result,
+                 HeliosObjParser::Group &current) {
+  size_t copied = 0;
+  for (const auto &marker : chunk.markers) {
+    result.indices.insert(result.indices.end(), chunk.indices.begin() + copied,
+                          chunk.indices.begin() + marker.offset);
+    copied = marker.offset;
+    closeGroup(result, current);
+    if (marker.type == RecordType::Name) {
+      current.name = marker.value;
+    } else {
+      current.material = marker.value;
+    }
+  }
+  result.indices.insert(result.indices.end(), chunk.indices.begin() + copied,
+                        chunk.indices.end());
+}
+
+} // namespace
+
+HeliosObjParser::Result HeliosObjParser::parse(const std::string &filepath,
+                                               unsigned threadCount) {
+  HeliosMappedFile file{filepath};
+  const char *data = file.data();
+  const size_t size = file.size();
+
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  size_t chunkCount = std::min<size_t>(threadCount, size / MIN_CHUNK_SIZE);
+  chunkCount = std::max<size_t>(chunkCount, 1);
+  std::vector<Chunk> chunks = splitChunks(data, size, chunkCount);
+
+  Result result{};
+  RecordCounts totals = countAllRecords(chunks, threadCount);
+  resizeAttributes(result, totals.vertices, totals.normals, totals.texcoords);
+
+  // second pass writes attributes straight into their final slots
+  forEachChunk(chunks.data(), chunkCount, [&](Chunk &chunk) {
+    parseRecords(chunk, result, totals);
+  });
+
+  size_t indexCount = 0;
+  for (const auto &chunk : chunks) {
+    indexCount += chunk.indices.size();
+  }
+  result.indices.reserve(indexCount);
+
+  // faces before the first marker form an unnamed group
+  Group current{};
+  for (const auto &chunk : chunks) {
+    appendFaces(chunk, result, current);
+  }
+  closeGroup(result, current);
+
+  return result;
+}
+
+void HeliosObjParser::stream(const std::string &filepath, size_t batchSize,
+                             const BatchFunction &onAttributes,
+                             const BatchFunction &onFaces,
+                             unsigned threadCount) {
+  HeliosMappedFile file{filepath};
+  const char *data = file.data();
+  const size_t size = file.size();
+
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  // threadCount chunks are in flight at once and make up one batch
+  size_t chunkSize = std::max<size_t>(batchSize / threadCount, MIN_CHUNK_SIZE);
+  size_t chunkCount = std::max<size_t>((size + chunkSize - 1) / chunkSize, 1);
+  std::vector<Chunk> chunks = splitChunks(data, size, chunkCount);
+  RecordCounts totals = countAllRecords(chunks, threadCount);
+
+  // every chunk of a window parses its attributes into its own arrays
+  std::vector<Result> attributes(threadCount);
+  for (size_t i = 0; i < chunkCount; i += threadCount) {
+    size_t count = std::min<size_t>(threadCount, chunkCount - i);
+    Chunk *first = &chunks[i];
+    forEachChunk(first, count, [&](Chunk &chunk) {
+      Result &local = attributes[&chunk - first];
+      resizeAttributes(local, chunk.vertexCount, chunk.normalCount,
+                       chunk.texcoordCount);
+      parseRecords(chunk, local, totals, Records::Attributes,
+                   AttributeSlots::ChunkLocal);
+    });
+    for (size_t j = 0; j < count; j++) {
+      if (!attributes[j].vertices.empty() || !attributes[j].normals.empty() ||
+          !attributes[j].texcoords.empty()) {
+        onAttributes(attributes[j]);
+      }
+      attributes[j] = {};
+    }
+  }
+
+  Result result{};
+  Group current{};
+  for (size_t i = 0; i < chunkCount; i += threadCount) {
+    size_t count = std::min<size_t>(threadCount, chunkCount - i);
+    forEachChunk(&chunks[i], count, [&](Chunk &chunk) {
+      parseRecords(chunk, result, totals, Records::Faces);
+    });
+
+    for (size_t j = i; j < i + count; j++) {
+      result.indices.clear();
+      result.groups.clear();
+      current.firstIndex = 0;
+      appendFaces(chunks[j], result, current);
+      closeGroup(result, current);
+      // release the chunk's faces before the next window is parsed
+      chunks[j].indices = {};
+      chunks[j].markers = {};
+      if (!result.indices.empty()) {
+        onFaces(result);
+      }
+    }
+  }
+}
+
+} // namespace helios
@@ -0,0 +1,61 @@
+#pragma once
+
+// std
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace helios {
+
+// Parses the geometry records (v, vn, vt, f) and grouping records (o, g,
+// usemtl) of a Wavefront OBJ file. The file is memory mapped and split into
+// line aligned chunks that are parsed on all available cores. The output
+// mirrors the layout of tinyobj's attrib_t so both loaders can feed the same
+// vertex assembly code.
+class HeliosObjParser {
+public:
+  struct Index {
+    int vertex_index = -1;
+    int normal_index = -1;
+    int texcoord_index = -1;
+  };
+
+  struct Group {
+    std::string name{};
+    std::string material{};
+    size_t firstIndex = 0;
+    size_t indexCount = 0;
+  };
+
+  struct Result {
+    std::vector<float> vertices{};
+    std::vector<float> colors{};
+    std::vector<float> normals{};
+    std::vector<float> texcoords{};
+
+    // triangulated faces, three indices per triangle in file order
+    std::vector<Index> indices{};
+    // consecutive runs of indices sharing object or group name and
+    // material, in file order; empty runs are left out
+    std::vector<Group> groups{};
+  };
+
+  using BatchFunction = std::function<void(const Result &batch)>;
+
+  // threadCount of 0 uses std::thread::hardware_concurrency()
+  static Result parse(const std::string &filepath, unsigned threadCount = 0);
+
+  // Like parse(), but nothing is held for the whole file. The file is
+  // parsed about batchSize bytes at a time, twice. The first pass hands the
+  // vertex attributes to onAttributes in file order, only the attribute
+  // arrays are filled. The second hands the faces to onFaces in file order,
+  // with indices and groups holding just that batch (group offsets relative
+  // to it) and indices resolved against the whole file. A group split
+  // across batches is reported once per batch under the same name and
+  // material.
+  static void stream(const std::string &filepath, size_t batchSize,
+                     const BatchFunction &onAttributes,
+                     const BatchFunction &onFaces, unsigned threadCount = 0);
+};
+
+} // namespace helios
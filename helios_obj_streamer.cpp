@@ -0,0 +1,537 @@
+#include "helios_obj_streamer.hpp"
+#include "helios_mapped_file.hpp"
+#include "helios_mesh_cache.hpp"
+#include "helios_obj_parser.hpp"
+#include "helios_vertex_table.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace helios {
+
+namespace {
+
+using Vertex = HeliosModel::Vertex;
+
+// share of the budget the parser's batch in flight may use
+constexpr size_t BATCH_BUDGET_DIVISOR = 4;
+// Host bytes a batch takes per byte of face records: the parsed corners and
+// their copy in the batch. Short records like "f 1 2 3" come close to this.
+constexpr size_t BATCH_BYTES_PER_FILE_BYTE = 16;
+// every open spill file buffers this much, less when the budget is tight
+constexpr size_t MAX_SPILL_BUFFER = 64 * 1024;
+constexpr size_t MIN_SPILL_BUFFER = 4 * 1024;
+// partitions and index ranges each keep a spill file open while written
+constexpr size_t MAX_SPILL_FILES = 256;
+
+// a corner waiting for its vertex index, in the partition files
+struct CornerRecord {
+  Vertex vertex;
+  uint32_t corner;
+};
+
+// a corner's vertex index, in the index range files
+struct IndexRecord {
+  uint32_t corner;
+  uint32_t index;
+};
+
+// Temporary file written once and then read back sequentially, through a
+// buffer owned by the import so its memory is accounted for. Removed on
+// destruction, however the import ends.
+class SpillFile {
+public:
+  SpillFile(std::string path, size_t bufferSize)
+      : path{std::move(path)}, bufferSize{bufferSize} {
+    open("wb");
+  }
+  ~SpillFile() {
+    closeFile();
+    std::remove(path.c_str());
+  }
+
+  SpillFile(const SpillFile &) = delete;
+  SpillFile &operator=(const SpillFile &) = delete;
+
+  void write(const void *data, size_t size) {
+    if (std::fwrite(data, 1, size, file) != size) {
+      throw std::runtime_error("failed to write spill file: " + path);
+    }
+  }
+  // flushes and releases the buffer, the file stays until destruction
+  void finishWriting() {
+    if (std::fflush(file) != 0 || std::ferror(file)) {
+      throw std::runtime_error("failed to write spill file: " + path);
+    }
+    closeFile();
+  }
+  void startReading() { open("rb"); }
+  // returns false at the end of the file
+  bool read(void *data, size_t size) {
+    size_t read = std::fread(data, 1, size, file);
+    if (read != size && (read != 0 || std::ferror(file))) {
+      throw std::runtime_error("failed to read spill file: " + path);
+    }
+    return read == size;
+  }
+
+  const std::string &getPath() const { return path; }
+  size_t memoryUsage() const { return buffer.capacity(); }
+
+private:
+  void open(const char *mode) {
+    closeFile();
+    file = std::fopen(path.c_str(), mode);
+    if (file == nullptr) {
+      throw std::runtime_error("failed to open file: " + path);
+    }
+    buffer.resize(bufferSize);
+    std::setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+  }
+  void closeFile() {
+    if (file != nullptr) {
+      std::fclose(file);
+      file = nullptr;
+    }
+    buffer = {};
+  }
+
+  std::string path;
+  size_t bufferSize;
+  std::FILE *file = nullptr;
+  std::vector<char> buffer;
+};
+
+// Open addressing map from a vertex to its index. Unlike HeliosVertexTable
+// it keeps the vertices in its slots, since earlier vertices have already
+// been spilled. Vertices compare bitwise, like in Builder::loadModel.
+class VertexSlotTable {
+  static constexpr uint32_t EMPTY = UINT32_MAX;
+
+  struct Slot {
+    Vertex vertex{};
+    uint32_t index = EMPTY;
+  };
+
+public:
+  // at most half full, and while growing the old slots sit next to twice as
+  // many new ones
+  static constexpr size_t PEAK_BYTES_PER_VERTEX = 6 * sizeof(Slot);
+
+  VertexSlotTable() : slots(16), mask{15} {}
+
+  // Returns the index of vertex, assigning it nextIndex if new.
+  uint32_t insert(const Vertex &vertex, uint64_t hash, uint32_t nextIndex,
+                  bool &inserted) {
+    if ((count + 1) * 2 > slots.size()) {
+      grow();
+    }
+    size_t position = static_cast<size_t>(hash) & mask;
+    while (true) {
+      Slot &slot = slots[position];
+      if (slot.index == EMPTY) {
+        slot = {vertex, nextIndex};
+        count++;
+        inserted = true;
+        return nextIndex;
+      }
+      if (memcmp(&slot.vertex, &vertex, sizeof(Vertex)) == 0) {
+        inserted = false;
+        return slot.index;
+      }
+      position = (position + 1) & mask;
+    }
+  }
+
+  // including the old slots while growing
+  size_t peakMemoryUsage() const {
+    return slots.capacity() * sizeof(Slot) * 3 / 2;
+  }
+
+private:
+  void grow() {
+    std::vector<Slot> oldSlots = std::move(slots);
+    slots.assign(oldSlots.size() * 2, Slot{});
+    mask = slots.size() - 1;
+    for (const auto &old : oldSlots) {
+      if (old.index == EMPTY) {
+        continue;
+      }
+      size_t position =
+          static_cast<size_t>(HeliosVertexTable::hash(old.vertex)) & mask;
+      while (slots[position].index != EMPTY) {
+        position = (position + 1) & mask;
+      }
+      slots[position] = old;
+    }
+  }
+
+  std::vector<Slot> slots;
+  size_t mask;
+  size_t count = 0;
+};
+
+// splits count items into parts of at most partBytes, bytesPerItem each
+size_t partCount(uint64_t count, size_t bytesPerItem, size_t partBytes,
+                 const std::string &sourcePath) {
+  uint64_t parts =
+      (count * bytesPerItem + partBytes - 1) / std::max<size_t>(partBytes, 1);
+  if (parts > MAX_SPILL_FILES) {
+    throw std::runtime_error("memory budget too small to stream " +
+                             sourcePath);
+  }
+  return std::max<size_t>(static_cast<size_t>(parts), 1);
+}
+
+size_t spillBufferSize(size_t budget, size_t fileCount) {
+  return std::clamp(budget / fileCount, MIN_SPILL_BUFFER, MAX_SPILL_BUFFER);
+}
+
+template <typename T> size_t capacityBytes(const std::vector<T> &vector) {
+  return vector.capacity() * sizeof(T);
+}
+
+// spilled vertex attributes, mapped for random access by the faces
+struct Attributes {
+  // position and color of every v record
+  std::unique_ptr<HeliosMappedFile> vertices;
+  std::unique_ptr<HeliosMappedFile> normals;
+  std::unique_ptr<HeliosMappedFile> texcoords;
+
+  Vertex makeVertex(const HeliosObjParser::Index &index) const {
+    Vertex vertex{};
+    if (index.vertex_index >= 0) {
+      const float *v = floats(*vertices) + 6 * index.vertex_index;
+      vertex.position = {v[0], v[1], v[2]};
+      vertex.color = {v[3], v[4], v[5]};
+    }
+    if (index.normal_index >= 0) {
+      const float *n = floats(*normals) + 3 * index.normal_index;
+      vertex.normal = {n[0], n[1], n[2]};
+    }
+    if (index.texcoord_index >= 0) {
+      const float *t = floats(*texcoords) + 2 * index.texcoord_index;
+      vertex.uv = {t[0], t[1]};
+    }
+    return vertex;
+  }
+
+  static const float *floats(const HeliosMappedFile &file) {
+    return reinterpret_cast<const float *>(file.data());
+  }
+};
+
+// Bounds of every declared position, a superset of the referenced ones.
+// They are needed before the first vertex is spilled, packed vertices are
+// quantized against them.
+HeliosModel::Bounds declaredBounds(const HeliosMappedFile &vertices,
+                                   const glm::vec3 &min,
+                                   const glm::vec3 &max) {
+  HeliosModel::Bounds bounds{};
+  size_t count = vertices.size() / (6 * sizeof(float));
+  if (count == 0) {
+    return bounds;
+  }
+  bounds.min = min;
+  bounds.max = max;
+  bounds.center = (min + max) * 0.5f;
+  const float *v = Attributes::floats(vertices);
+  float radiusSquared = 0.f;
+  for (size_t i = 0; i < count; i++) {
+    glm::vec3 d = glm::vec3{v[6 * i], v[6 * i + 1], v[6 * i + 2]} -
+                  bounds.center;
+    radiusSquared = std::max(radiusSquared, glm::dot(d, d));
+  }
+  bounds.radius = std::sqrt(radiusSquared);
+  return bounds;
+}
+
+} // namespace
+
+HeliosObjStreamer::Stats
+HeliosObjStreamer::streamToCache(const std::string &sourcePath,
+                                 const std::string &cachePath,
+                                 size_t memoryBudget,
+                                 HeliosModel::VertexFormat vertexFormat) {
+  const size_t batchBudget = memoryBudget / BATCH_BUDGET_DIVISOR;
+  const size_t batchSize = batchBudget / BATCH_BYTES_PER_FILE_BYTE;
+  const size_t buffer = spillBufferSize(memoryBudget / 16, 1);
+
+  Stats stats{};
+  auto trackMemory = [&](size_t memory) {
+    stats.peakMemory = std::max(stats.peakMemory, memory);
+  };
+
+  // 1. vertex attributes go to disk as they are parsed
+  SpillFile vertexSpill{cachePath + ".v.tmp", buffer};
+  SpillFile normalSpill{cachePath + ".vn.tmp", buffer};
+  SpillFile texcoordSpill{cachePath + ".vt.tmp", buffer};
+  auto spillBuffers = [&] {
+    return vertexSpill.memoryUsage() + normalSpill.memoryUsage() +
+           texcoordSpill.memoryUsage();
+  };
+  glm::vec3 positionMin{std::numeric_limits<float>::max()};
+  glm::vec3 positionMax{std::numeric_limits<float>::lowest()};
+
+  // 2. faces become one record per corner, with the vertex it refers to
+  std::unique_ptr<SpillFile> cornerSpill;
+  Attributes attributes{};
+  HeliosModel::Bounds bounds{};
+  HeliosMeshCache::SpilledMesh mesh{};
+  uint64_t cornerCount = 0;
+
+  HeliosObjParser::stream(
+      sourcePath, batchSize,
+      [&](const HeliosObjParser::Result &batch) {
+        size_t count = batch.vertices.size() / 3;
+        for (size_t i = 0; i < count; i++) {
+          glm::vec3 p{batch.vertices[3 * i], batch.vertices[3 * i + 1],
+                      batch.vertices[3 * i + 2]};
+          positionMin = glm::min(positionMin, p);
+          positionMax = glm::max(positionMax, p);
+          vertexSpill.write(&batch.vertices[3 * i], 3 * sizeof(float));
+          vertexSpill.write(&batch.colors[3 * i], 3 * sizeof(float));
+        }
+        normalSpill.write(batch.normals.data(),
+                          batch.normals.size() * sizeof(float));
+        texcoordSpill.write(batch.texcoords.data(),
+                            batch.texcoords.size() * sizeof(float));
+        trackMemory(capacityBytes(batch.vertices) +
+                    capacityBytes(batch.colors) +
+                    capacityBytes(batch.normals) +
+                    capacityBytes(batch.texcoords) + spillBuffers());
+      },
+      [&](const HeliosObjParser::Result &batch) {
+        if (!cornerSpill) {
+          vertexSpill.finishWriting();
+          normalSpill.finishWriting();
+          texcoordSpill.finishWriting();
+          attributes.vertices =
+              std::make_unique<HeliosMappedFile>(vertexSpill.getPath());
+          attributes.normals =
+              std::make_unique<HeliosMappedFile>(normalSpill.getPath());
+          attributes.texcoords =
+              std::make_unique<HeliosMappedFile>(texcoordSpill.getPath());
+          bounds = declaredBounds(*attributes.vertices, positionMin,
+                                  positionMax);
+          cornerSpill = std::make_unique<SpillFile>(
+              cachePath + ".corners.tmp", buffer);
+        }
+
+        // consecutive groups with equal names continue the last submesh
+        for (const auto &group : batch.groups) {
+          uint32_t firstIndex = static_cast<uint32_t>(cornerCount) +
+                                static_cast<uint32_t>(group.firstIndex);
+          uint32_t indexCount = static_cast<uint32_t>(group.indexCount);
+          if (!mesh.submeshes.empty() &&
+              mesh.submeshes.back().name == group.name &&
+              mesh.submeshes.back().material == group.material) {
+            mesh.submeshRanges.back().indexCount += indexCount;
+          } else {
+            mesh.submeshes.push_back({group.name, group.material});
+            mesh.submeshRanges.push_back({firstIndex, indexCount});
+          }
+        }
+
+        CornerRecord record{};
+        record.corner = static_cast<uint32_t>(cornerCount);
+        for (const auto &corner : batch.indices) {
+          record.vertex = attributes.makeVertex(corner);
+          cornerSpill->write(&record, sizeof(record));
+          record.corner++;
+        }
+        cornerCount += batch.indices.size();
+        if (cornerCount >= std::numeric_limits<uint32_t>::max()) {
+          throw std::runtime_error("too many indices in " + sourcePath);
+        }
+        trackMemory(capacityBytes(batch.indices) + cornerSpill->memoryUsage());
+        stats.batchCount++;
+      });
+
+  if (cornerCount == 0) {
+    throw std::runtime_error("no faces in " + sourcePath);
+  }
+  attributes = {};
+  cornerSpill->finishWriting();
+
+  // 3. new vertices are written out in blocks, every corner's index goes
+  // to the file of its range
+  const size_t tableBudget = memoryBudget / 2;
+  const size_t rangeBudget = memoryBudget / 2;
+  const size_t ranges =
+      partCount(cornerCount, sizeof(uint32_t), rangeBudget, sourcePath);
+  const uint64_t rangeSize = (cornerCount + ranges - 1) / ranges;
+  const size_t rangeBuffer = spillBufferSize(memoryBudget / 8, ranges);
+  const size_t blockSize =
+      std::max<size_t>(memoryBudget / 16 / (2 * sizeof(Vertex)), 1024);
+
+  std::vector<std::unique_ptr<SpillFile>> rangeSpills(ranges);
+  std::unique_ptr<SpillFile> positionOut;
+  std::unique_ptr<SpillFile> attributeOut;
+  HeliosModel::Builder block{};
+  block.vertexFormat = vertexFormat;
+  std::vector<uint8_t> positions{};
+  std::vector<uint8_t> attributeBytes{};
+  auto startOutput = [&] {
+    // the old files go first, they share their paths with the new ones
+    positionOut.reset();
+    attributeOut.reset();
+    for (size_t r = 0; r < ranges; r++) {
+      rangeSpills[r].reset();
+      rangeSpills[r] = std::make_unique<SpillFile>(
+          cachePath + ".range" + std::to_string(r) + ".tmp", rangeBuffer);
+    }
+    positionOut =
+        std::make_unique<SpillFile>(cachePath + ".positions.tmp", buffer);
+    attributeOut =
+        std::make_unique<SpillFile>(cachePath + ".attributes.tmp", buffer);
+    block.vertices.clear();
+    stats.vertexCount = 0;
+  };
+  auto flushBlock = [&] {
+    block.writeVertexStreams(bounds, positions, attributeBytes);
+    positionOut->write(positions.data(), positions.size());
+    attributeOut->write(attributeBytes.data(), attributeBytes.size());
+    block.vertices.clear();
+  };
+
+  // Deduplicates the corners of input, returns false once the table would
+  // outgrow tableLimit. Then corners and unique say how far it got.
+  uint64_t corners = 0;
+  uint64_t unique = 0;
+  auto deduplicate = [&](SpillFile &input, size_t tableLimit) {
+    VertexSlotTable table{};
+    auto trackTable = [&] {
+      trackMemory(table.peakMemoryUsage() + input.memoryUsage() +
+                  ranges * rangeBuffer + capacityBytes(block.vertices) +
+                  capacityBytes(positions) + capacityBytes(attributeBytes) +
+                  positionOut->memoryUsage() + attributeOut->memoryUsage());
+    };
+    CornerRecord record{};
+    corners = 0;
+    unique = 0;
+    input.startReading();
+    while (input.read(&record, sizeof(record))) {
+      bool inserted;
+      uint32_t index = table.insert(
+          record.vertex, HeliosVertexTable::hash(record.vertex),
+          stats.vertexCount, inserted);
+      if (inserted) {
+        if (table.peakMemoryUsage() > tableLimit) {
+          trackTable();
+          return false;
+        }
+        block.vertices.push_back(record.vertex);
+        stats.vertexCount++;
+        unique++;
+        if (block.vertices.size() == blockSize) {
+          flushBlock();
+        }
+      }
+      IndexRecord indexRecord{record.corner, index};
+      rangeSpills[record.corner / rangeSize]->write(&indexRecord,
+                                                    sizeof(indexRecord));
+      corners++;
+    }
+    trackTable();
+    return true;
+  };
+
+  // Most meshes have few enough distinct vertices for one table, which
+  // keeps them in first use order like Builder::loadModel.
+  startOutput();
+  stats.partitionCount = 1;
+  if (!deduplicate(*cornerSpill, tableBudget)) {
+    // Otherwise the corners are split by vertex hash into partitions whose
+    // vertices fit the budget, so equal vertices meet in the same partition.
+    // Their number is estimated from the share of distinct vertices so far,
+    // with room for later parts of the file to be more varied.
+    double share = static_cast<double>(unique) / std::max<uint64_t>(corners, 1);
+    uint64_t estimate = std::min(
+        cornerCount, static_cast<uint64_t>(2 * share * cornerCount) + 1);
+    const size_t partitions =
+        partCount(estimate, VertexSlotTable::PEAK_BYTES_PER_VERTEX,
+                  tableBudget, sourcePath);
+    stats.partitionCount = static_cast<uint32_t>(partitions);
+    const size_t partitionBuffer =
+        spillBufferSize(memoryBudget / 4, partitions);
+    std::vector<std::unique_ptr<SpillFile>> partitionSpills(partitions);
+    for (size_t p = 0; p < partitions; p++) {
+      partitionSpills[p] = std::make_unique<SpillFile>(
+          cachePath + ".part" + std::to_string(p) + ".tmp", partitionBuffer);
+    }
+    trackMemory(partitions * partitionBuffer + buffer);
+
+    cornerSpill->startReading();
+    CornerRecord record{};
+    while (cornerSpill->read(&record, sizeof(record))) {
+      // the table indexes with the low bits, partitions take the high ones
+      uint64_t hash = HeliosVertexTable::hash(record.vertex);
+      partitionSpills[(hash >> 32) % partitions]->write(&record,
+                                                        sizeof(record));
+    }
+    cornerSpill.reset();
+    for (auto &spill : partitionSpills) {
+      spill->finishWriting();
+    }
+
+    startOutput();
+    for (auto &partition : partitionSpills) {
+      deduplicate(*partition, std::numeric_limits<size_t>::max());
+      partition.reset();
+    }
+  }
+  cornerSpill.reset();
+  flushBlock();
+  block.vertices = {};
+  positions = {};
+  attributeBytes = {};
+  positionOut->finishWriting();
+  attributeOut->finishWriting();
+  for (auto &spill : rangeSpills) {
+    spill->finishWriting();
+  }
+
+  // 5. the ranges put the indices back in corner order
+  SpillFile indexOut{cachePath + ".indices.tmp", buffer};
+  std::vector<uint32_t> indices;
+  for (size_t r = 0; r < ranges; r++) {
+    uint64_t first = r * rangeSize;
+    indices.assign(std::min(rangeSize, cornerCount - first), 0);
+    rangeSpills[r]->startReading();
+    IndexRecord indexRecord{};
+    while (rangeSpills[r]->read(&indexRecord, sizeof(indexRecord))) {
+      indices[indexRecord.corner - first] = indexRecord.index;
+    }
+    trackMemory(capacityBytes(indices) + rangeSpills[r]->memoryUsage() +
+                indexOut.memoryUsage());
+    rangeSpills[r].reset();
+    indexOut.write(indices.data(), indices.size() * sizeof(uint32_t));
+  }
+  indices = {};
+  indexOut.finishWriting();
+
+  stats.indexCount = static_cast<uint32_t>(cornerCount);
+  mesh.positionPath = positionOut->getPath();
+  mesh.attributePath = attributeOut->getPath();
+  mesh.indexPath = indexOut.getPath();
+  mesh.vertexCount = stats.vertexCount;
+  mesh.indexCount = stats.indexCount;
+  mesh.bounds = bounds;
+  uint32_t buildFlags = HeliosMeshCache::BUILD_STREAMED;
+  if (vertexFormat == HeliosModel::VertexFormat::Packed) {
+    buildFlags |= HeliosMeshCache::BUILD_PACKED;
+  }
+  HeliosMeshCache::write(cachePath, sourcePath, mesh, buildFlags);
+  return stats;
+}
+
+} // namespace helios
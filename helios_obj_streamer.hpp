@@ -0,0 +1,50 @@
+#pragma once
+
+#include "helios_model.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace helios {
+
+// Imports OBJ files too large to go through HeliosModel::Builder, which holds
+// the parsed corners, the deduplicated vertices and the final buffers at
+// once. HeliosObjParser::stream hands over the file in batches: the vertex
+// attributes are spilled to disk and mapped back for the faces, whose
+// corners are spilled with the vertex they refer to. The corners are then
+// split by vertex hash into partitions small enough to deduplicate in
+// memory, and the indices are put back in file order one range at a time.
+// The spilled blocks are assembled into a .hmesh cache that HeliosModel
+// copies straight from its mapping into staging memory.
+//
+// Vertices are merged by value like in Builder::loadModel, so both produce
+// the same vertices; with more than one partition they are ordered by
+// partition rather than by first use. The buffers of the import stay within
+// the memory budget, the mapped attributes are left to the page cache.
+// Disk use is about 100 bytes per corner. Optimization, meshlets and levels
+// of detail need the whole mesh in memory and are not built.
+class HeliosObjStreamer {
+public:
+  struct Stats {
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+    uint32_t batchCount = 0;
+    // deduplicated one after another, 1 when all vertices fit the budget
+    uint32_t partitionCount = 0;
+    // most host memory held by the import's buffers at any one time
+    size_t peakMemory = 0;
+  };
+
+  // Writes the cache for sourcePath to cachePath with buildFlags
+  // BUILD_STREAMED, plus BUILD_PACKED for the packed format. Throws when
+  // memoryBudget is too small to split the file into at most 256
+  // partitions.
+  static Stats streamToCache(const std::string &sourcePath,
+                             const std::string &cachePath, size_t memoryBudget,
+                             HeliosModel::VertexFormat vertexFormat =
+                                 HeliosModel::VertexFormat::Float);
+};
+
+} // namespace helios
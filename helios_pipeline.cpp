@@ -4,6 +4,8 @@
 
 // std
 #include <cassert>
+#include <chrono>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <stdexcept>
@@ -19,10 +21,18 @@ HeliosPipeline::HeliosPipeline(HeliosDevice &device,
   createGraphicsPipeline(vertFilepath, fragFilepath, configInfo);
 }
 
+HeliosPipeline::HeliosPipeline(HeliosDevice &device,
+                               const std::string &compFilepath,
+                               VkPipelineLayout pipelineLayout)
+    : heliosDevice{device}, bindPoint{VK_PIPELINE_BIND_POINT_COMPUTE} {
+  createComputePipeline(compFilepath, pipelineLayout);
+}
+
 HeliosPipeline::~HeliosPipeline() {
   vkDestroyShaderModule(heliosDevice.device(), vertShaderModule, nullptr);
   vkDestroyShaderModule(heliosDevice.device(), fragShaderModule, nullptr);
-  vkDestroyPipeline(heliosDevice.device(), graphicsPipeline, nullptr);
+  vkDestroyShaderModule(heliosDevice.device(), compShaderModule, nullptr);
+  vkDestroyPipeline(heliosDevice.device(), pipeline, nullptr);
 }
 
 std::vector<char> HeliosPipeline::readFile(const std::string &filepath) {
@@ -53,10 +63,21 @@ void HeliosPipeline::createGraphicsPipeline(
          "configInfo");
 
   auto vertCode = readFile(vertFilepath);
-  auto fragCode = readFile(fragFilepath);
-
   createShaderModule(vertCode, &vertShaderModule);
-  createShaderModule(fragCode, &fragShaderModule);
+
+  const bool hasFragmentStage = !fragFilepath.empty();
+  if (hasFragmentStage) {
+    auto fragCode = readFile(fragFilepath);
+    createShaderModule(fragCode, &fragShaderModule);
+  }
+
+  VkSpecializationInfo vertSpecializationInfo{};
+  vertSpecializationInfo.mapEntryCount =
+      static_cast<uint32_t>(configInfo.vertSpecializationEntries.size());
+  vertSpecializationInfo.pMapEntries =
+      configInfo.vertSpecializationEntries.data();
+  vertSpecializationInfo.dataSize = configInfo.vertSpecializationData.size();
+  vertSpecializationInfo.pData = configInfo.vertSpecializationData.data();
 
   VkPipelineShaderStageCreateInfo shaderStages[2];
   shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -65,7 +86,9 @@ void HeliosPipeline::createGraphicsPipeline(
   shaderStages[0].pName = "main";
   shaderStages[0].flags = 0;
   shaderStages[0].pNext = nullptr;
-  shaderStages[0].pSpecializationInfo = nullptr;
+  shaderStages[0].pSpecializationInfo =
+      configInfo.vertSpecializationEntries.empty() ? nullptr
+                                                   : &vertSpecializationInfo;
   shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
   shaderStages[1].module = fragShaderModule;
@@ -88,7 +111,7 @@ void HeliosPipeline::createGraphicsPipeline(
 
   VkGraphicsPipelineCreateInfo pipelineInfo{};
   pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-  pipelineInfo.stageCount = 2;
+  pipelineInfo.stageCount = hasFragmentStage ? 2 : 1;
   pipelineInfo.pStages = shaderStages;
   pipelineInfo.pVertexInputState = &vertexInputInfo;
   pipelineInfo.pInputAssemblyState = &configInfo.inputAssemblyInfo;
@@ -106,11 +129,45 @@ void HeliosPipeline::createGraphicsPipeline(
   pipelineInfo.basePipelineIndex = -1;
   pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-  if (vkCreateGraphicsPipelines(heliosDevice.device(), VK_NULL_HANDLE, 1,
+  auto start = std::chrono::steady_clock::now();
+  if (vkCreateGraphicsPipelines(heliosDevice.device(),
+                                heliosDevice.pipelineCache().getCache(), 1,
                                 &pipelineInfo, nullptr,
-                                &graphicsPipeline) != VK_SUCCESS) {
+                                &pipeline) != VK_SUCCESS) {
     throw std::runtime_error("failed to create graphics pipeline");
   }
+  heliosDevice.pipelineCache().recordCreation(
+      std::chrono::steady_clock::now() - start);
+}
+
+void HeliosPipeline::createComputePipeline(const std::string &compFilepath,
+                                           VkPipelineLayout pipelineLayout) {
+  assert(pipelineLayout != VK_NULL_HANDLE &&
+         "Cannot create compute pipeline:: no pipelineLayout provided");
+
+  auto compCode = readFile(compFilepath);
+  createShaderModule(compCode, &compShaderModule);
+
+  VkComputePipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.stage.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipelineInfo.stage.module = compShaderModule;
+  pipelineInfo.stage.pName = "main";
+  pipelineInfo.layout = pipelineLayout;
+  pipelineInfo.basePipelineIndex = -1;
+  pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+  auto start = std::chrono::steady_clock::now();
+  if (vkCreateComputePipelines(heliosDevice.device(),
+                               heliosDevice.pipelineCache().getCache(), 1,
+                               &pipelineInfo, nullptr,
+                               &pipeline) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create compute pipeline");
+  }
+  heliosDevice.pipelineCache().recordCreation(
+      std::chrono::steady_clock::now() - start);
 }
 
 void HeliosPipeline::createShaderModule(const std::vector<char> &code,
@@ -127,8 +184,7 @@ void HeliosPipeline::createShaderModule(const std::vector<char> &code,
 }
 
 void HeliosPipeline::bind(VkCommandBuffer commandBuffer) {
-  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    graphicsPipeline);
+  vkCmdBindPipeline(commandBuffer, bindPoint, pipeline);
 }
 
 void HeliosPipeline::defaultPipelineConfigInfo(PipelineConfigInfo &configInfo) {
@@ -220,4 +276,35 @@ void HeliosPipeline::defaultPipelineConfigInfo(PipelineConfigInfo &configInfo) {
       HeliosModel::Vertex::getAttributeDescriptions();
 }
 
+void HeliosPipeline::packedPipelineConfigInfo(PipelineConfigInfo &configInfo) {
+  defaultPipelineConfigInfo(configInfo);
+  configInfo.bindingDescriptions =
+      HeliosModel::PackedVertex::getBindingDescriptions();
+  configInfo.attributeDescriptions =
+      HeliosModel::PackedVertex::getAttributeDescriptions();
+
+  // constant_id 0 in simple_shader.vert: PACKED_VERTICES
+  VkBool32 packedVertices = VK_TRUE;
+  configInfo.vertSpecializationEntries = {{0, 0, sizeof(VkBool32)}};
+  configInfo.vertSpecializationData.resize(sizeof(VkBool32));
+  memcpy(configInfo.vertSpecializationData.data(), &packedVertices,
+         sizeof(VkBool32));
+}
+
+void HeliosPipeline::positionOnlyPipelineConfigInfo(
+    PipelineConfigInfo &configInfo, HeliosModel::VertexFormat format) {
+  defaultPipelineConfigInfo(configInfo);
+  bool packed = format == HeliosModel::VertexFormat::Packed;
+  auto bindings = packed ? HeliosModel::PackedVertex::getBindingDescriptions()
+                         : HeliosModel::Vertex::getBindingDescriptions();
+  auto attributes = packed
+                        ? HeliosModel::PackedVertex::getAttributeDescriptions()
+                        : HeliosModel::Vertex::getAttributeDescriptions();
+  // binding and location 0 are the position stream
+  configInfo.bindingDescriptions = {bindings[0]};
+  configInfo.attributeDescriptions = {attributes[0]};
+
+  configInfo.colorBlendAttachment.colorWriteMask = 0;
+}
+
 } // namespace helios
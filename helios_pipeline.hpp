@@ -1,5 +1,6 @@
 #pragma once
 #include "helios_device.hpp"
+#include "helios_model.hpp"
 #include "vulkan/vulkan_core.h"
 
 #include <string>
@@ -23,6 +24,9 @@ struct PipelineConfigInfo {
   VkPipelineDepthStencilStateCreateInfo depthStencilInfo;
   std::vector<VkDynamicState> dynamicStateEnables;
   VkPipelineDynamicStateCreateInfo dynamicStateInfo;
+  // vertex shader specialization constants, entries point into the data
+  std::vector<VkSpecializationMapEntry> vertSpecializationEntries{};
+  std::vector<uint8_t> vertSpecializationData{};
   VkPipelineLayout pipelineLayout = nullptr;
   VkRenderPass renderPass = nullptr;
   uint32_t subpass = 0;
@@ -31,9 +35,13 @@ struct PipelineConfigInfo {
 class HeliosPipeline {
 
 public:
+  // fragFilepath may be empty for depth only pipelines
   HeliosPipeline(HeliosDevice &device, const std::string &vertFilepath,
                  const std::string &fragFilepath,
                  const PipelineConfigInfo &configInfo);
+  // compute pipeline
+  HeliosPipeline(HeliosDevice &device, const std::string &compFilepath,
+                 VkPipelineLayout pipelineLayout);
 
   ~HeliosPipeline();
 
@@ -42,6 +50,14 @@ public:
 
   void bind(VkCommandBuffer commandBuffer);
   static void defaultPipelineConfigInfo(PipelineConfigInfo &configInfo);
+  // default config reading HeliosModel::PackedVertex
+  static void packedPipelineConfigInfo(PipelineConfigInfo &configInfo);
+  // default config reading only the position stream of format and writing
+  // only depth, for depth and shadow passes with depth_only.vert and the
+  // SimpleRenderSystem pipeline layout
+  static void positionOnlyPipelineConfigInfo(
+      PipelineConfigInfo &configInfo,
+      HeliosModel::VertexFormat format = HeliosModel::VertexFormat::Float);
 
 private:
   static std::vector<char> readFile(const std::string &filepath);
@@ -49,14 +65,18 @@ private:
   void createGraphicsPipeline(const std::string &vertFilepath,
                               const std::string &fragFilepath,
                               const PipelineConfigInfo &configInfo);
+  void createComputePipeline(const std::string &compFilepath,
+                             VkPipelineLayout pipelineLayout);
 
   void createShaderModule(const std::vector<char> &code,
                           VkShaderModule *shaderModule);
 
   HeliosDevice &heliosDevice;
-  VkPipeline graphicsPipeline;
-  VkShaderModule vertShaderModule;
-  VkShaderModule fragShaderModule;
+  VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  VkPipeline pipeline;
+  VkShaderModule vertShaderModule = VK_NULL_HANDLE;
+  VkShaderModule fragShaderModule = VK_NULL_HANDLE;
+  VkShaderModule compShaderModule = VK_NULL_HANDLE;
 };
 
 } // namespace helios
@@ -0,0 +1,146 @@
+#include "helios_pipeline_cache.hpp"
+#include "helios_utils.hpp"
+
+// std
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+namespace helios {
+
+HeliosPipelineCache::HeliosPipelineCache(
+    VkDevice device, const VkPhysicalDeviceProperties &properties,
+    std::string path)
+    : device{device}, properties{properties}, path{std::move(path)} {
+  std::vector<char> data = loadData();
+
+  VkPipelineCacheCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  createInfo.initialDataSize = data.size();
+  createInfo.pInitialData = data.empty() ? nullptr : data.data();
+  if (vkCreatePipelineCache(device, &createInfo, nullptr, &cache) ==
+      VK_SUCCESS) {
+    loadedBytes = data.size();
+    return;
+  }
+
+  // drivers may still refuse data that passed validation, start cold then
+  createInfo.initialDataSize = 0;
+  createInfo.pInitialData = nullptr;
+  if (vkCreatePipelineCache(device, &createInfo, nullptr, &cache) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to create pipeline cache");
+  }
+}
+
+HeliosPipelineCache::~HeliosPipelineCache() {
+  try {
+    save();
+  } catch (const std::exception &e) {
+    std::cerr << "failed to save pipeline cache: " << e.what() << std::endl;
+  }
+  vkDestroyPipelineCache(device, cache, nullptr);
+}
+
+HeliosPipelineCache::Header HeliosPipelineCache::currentHeader() const {
+  Header h{};
+  memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.version = VERSION;
+  h.vendorID = properties.vendorID;
+  h.deviceID = properties.deviceID;
+  h.driverVersion = properties.driverVersion;
+  memcpy(h.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+  return h;
+}
+
+std::vector<char> HeliosPipelineCache::loadData() const {
+  std::ifstream file{path, std::ios::binary};
+  Header h{};
+  if (!file.read(reinterpret_cast<char *>(&h), sizeof(h))) {
+    return {};
+  }
+
+  Header expected = currentHeader();
+  if (memcmp(h.magic, expected.magic, sizeof(MAGIC)) != 0 ||
+      h.version != expected.version || h.vendorID != expected.vendorID ||
+      h.deviceID != expected.deviceID ||
+      h.driverVersion != expected.driverVersion ||
+      memcmp(h.pipelineCacheUUID, expected.pipelineCacheUUID,
+             VK_UUID_SIZE) != 0) {
+    std::cout << "pipeline cache " << path
+              << " was written for another device or driver, ignoring it"
+              << std::endl;
+    return {};
+  }
+
+  std::error_code error;
+  uint64_t fileSize = std::filesystem::file_size(path, error);
+  if (error || fileSize != sizeof(Header) + h.dataSize ||
+      h.dataSize < sizeof(VkPipelineCacheHeaderVersionOne)) {
+    return {};
+  }
+  std::vector<char> data(h.dataSize);
+  if (!file.read(data.data(), static_cast<std::streamsize>(data.size())) ||
+      hashBytes(data.data(), data.size()) != h.dataHash) {
+    return {};
+  }
+
+  // the driver's own header has to agree with ours
+  VkPipelineCacheHeaderVersionOne driverHeader{};
+  memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+  if (driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+      driverHeader.vendorID != expected.vendorID ||
+      driverHeader.deviceID != expected.deviceID ||
+      memcmp(driverHeader.pipelineCacheUUID, expected.pipelineCacheUUID,
+             VK_UUID_SIZE) != 0) {
+    return {};
+  }
+  return data;
+}
+
+void HeliosPipelineCache::save() {
+  size_t size = 0;
+  if (vkGetPipelineCacheData(device, cache, &size, nullptr) != VK_SUCCESS) {
+    throw std::runtime_error("failed to get pipeline cache size");
+  }
+  std::vector<char> data(size);
+  if (vkGetPipelineCacheData(device, cache, &size, data.data()) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to get pipeline cache data");
+  }
+  data.resize(size);
+
+  Header h = currentHeader();
+  h.dataSize = data.size();
+  h.dataHash = hashBytes(data.data(), data.size());
+
+  const std::string tempPath = path + ".tmp";
+  {
+    std::ofstream out{tempPath, std::ios::binary | std::ios::trunc};
+    out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!out) {
+      throw std::runtime_error("failed to write pipeline cache: " + tempPath);
+    }
+  }
+  std::filesystem::rename(tempPath, path);
+}
+
+void HeliosPipelineCache::recordCreation(std::chrono::nanoseconds duration) {
+  pipelineCount.fetch_add(1, std::memory_order_relaxed);
+  creationNanoseconds.fetch_add(duration.count(), std::memory_order_relaxed);
+}
+
+HeliosPipelineCache::Stats HeliosPipelineCache::getStats() const {
+  Stats stats{};
+  stats.loadedBytes = loadedBytes;
+  stats.pipelineCount = pipelineCount.load(std::memory_order_relaxed);
+  stats.creationMilliseconds =
+      creationNanoseconds.load(std::memory_order_relaxed) / 1e6;
+  return stats;
+}
+
+} // namespace helios
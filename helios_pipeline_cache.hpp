@@ -0,0 +1,81 @@
+#pragma once
+
+#include "vulkan/vulkan_core.h"
+
+// std
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace helios {
+
+// VkPipelineCache shared by every pipeline, persisted to a file so shaders
+// compiled by the driver in one run are reused by the next. The file is
+//
+//   Header
+//   cache data   (dataSize bytes as returned by vkGetPipelineCacheData)
+//
+// and is discarded when it was written for another vendor, device, driver
+// version or cache UUID, or when its data does not match the recorded hash.
+class HeliosPipelineCache {
+public:
+  static constexpr char MAGIC[4] = {'H', 'P', 'S', 'O'};
+  static constexpr uint32_t VERSION = 1;
+  static constexpr const char *DEFAULT_PATH = "pipeline_cache.bin";
+
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t dataSize;
+    uint64_t dataHash;
+  };
+
+  struct Stats {
+    // bytes of cache data loaded from disk, 0 for a cold start
+    uint64_t loadedBytes = 0;
+    uint32_t pipelineCount = 0;
+    // spent in vkCreate*Pipelines
+    double creationMilliseconds = 0.0;
+  };
+
+  HeliosPipelineCache(VkDevice device,
+                      const VkPhysicalDeviceProperties &properties,
+                      std::string path = DEFAULT_PATH);
+  // saves the cache
+  ~HeliosPipelineCache();
+
+  HeliosPipelineCache(const HeliosPipelineCache &) = delete;
+  HeliosPipelineCache &operator=(const HeliosPipelineCache &) = delete;
+
+  VkPipelineCache getCache() const { return cache; }
+
+  // Writes the cache under a temporary name and renames it, a failure only
+  // costs the next start its warm cache.
+  void save();
+
+  // called by HeliosPipeline for every pipeline it creates, thread safe
+  void recordCreation(std::chrono::nanoseconds duration);
+  Stats getStats() const;
+
+private:
+  // the cache data of the file at path when it is valid for this device
+  std::vector<char> loadData() const;
+  Header currentHeader() const;
+
+  VkDevice device;
+  VkPhysicalDeviceProperties properties;
+  std::string path;
+  VkPipelineCache cache = VK_NULL_HANDLE;
+  uint64_t loadedBytes = 0;
+
+  std::atomic<uint32_t> pipelineCount{0};
+  std::atomic<int64_t> creationNanoseconds{0};
+};
+
+} // namespace helios
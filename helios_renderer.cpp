@@ -3,6 +3,8 @@
 // std
 #include <array>
 #include <cassert>
+#include <exception>
+#include <future>
 #include <stdexcept>
 
 namespace helios {
@@ -11,9 +13,13 @@ HeliosRenderer::HeliosRenderer(HeliosWindow &window, HeliosDevice &device)
     : heliosWindow{window}, heliosDevice{device} {
   recreateSwapChain();
   createCommandBuffers();
+  createRecordingContexts();
 }
 
-HeliosRenderer::~HeliosRenderer() { freeCommandBuffers(); }
+HeliosRenderer::~HeliosRenderer() {
+  destroyRecordingContexts();
+  freeCommandBuffers();
+}
 
 void HeliosRenderer::recreateSwapChain() {
   auto extent = heliosWindow.getExtent();
@@ -59,6 +65,71 @@ void HeliosRenderer::freeCommandBuffers() {
   commandBuffers.clear();
 }
 
+void HeliosRenderer::createRecordingContexts() {
+  recordingContexts.resize(HeliosSwapChain::MAX_FRAMES_IN_FLIGHT);
+  for (auto &contexts : recordingContexts) {
+    contexts.resize(recordingWorkers.getThreadCount());
+    for (auto &context : contexts) {
+      VkCommandPoolCreateInfo poolInfo{};
+      poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+      poolInfo.queueFamilyIndex = heliosDevice.graphicsQueueFamily();
+      poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+      if (vkCreateCommandPool(heliosDevice.device(), &poolInfo, nullptr,
+                              &context.commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create recording command pool!");
+      }
+    }
+  }
+}
+
+void HeliosRenderer::destroyRecordingContexts() {
+  for (auto &contexts : recordingContexts) {
+    for (auto &context : contexts) {
+      // frees the pool's command buffers as well
+      vkDestroyCommandPool(heliosDevice.device(), context.commandPool,
+                           nullptr);
+    }
+  }
+  recordingContexts.clear();
+}
+
+VkCommandBuffer
+HeliosRenderer::beginSecondaryCommandBuffer(RecordingContext &context) {
+  if (context.used == context.commandBuffers.size()) {
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    allocInfo.commandPool = context.commandPool;
+    allocInfo.commandBufferCount = 1;
+    VkCommandBuffer commandBuffer;
+    if (vkAllocateCommandBuffers(heliosDevice.device(), &allocInfo,
+                                 &commandBuffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate secondary command buffer!");
+    }
+    context.commandBuffers.push_back(commandBuffer);
+  }
+  VkCommandBuffer commandBuffer = context.commandBuffers[context.used++];
+
+  VkCommandBufferInheritanceInfo inheritanceInfo{};
+  inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  inheritanceInfo.renderPass = heliosSwapChain->getRenderPass();
+  inheritanceInfo.subpass = 0;
+  inheritanceInfo.framebuffer =
+      heliosSwapChain->getFrameBuffer(currentImageIndex);
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT |
+                    VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  beginInfo.pInheritanceInfo = &inheritanceInfo;
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("failed to begin secondary command buffer!");
+  }
+  // dynamic state is not inherited from the primary command buffer
+  setViewportAndScissor(commandBuffer);
+  return commandBuffer;
+}
+
 VkCommandBuffer HeliosRenderer::beginFrame() {
   assert(!isFrameStarted && "Can't call beginFrame while already in progress");
 
@@ -74,6 +145,15 @@ VkCommandBuffer HeliosRenderer::beginFrame() {
 
   isFrameStarted = true;
 
+  // the fence waited for by acquireNextImage guarantees this frame's
+  // previous secondary command buffers have finished executing
+  for (auto &context : recordingContexts[currentFrameIndex]) {
+    if (context.used > 0) {
+      vkResetCommandPool(heliosDevice.device(), context.commandPool, 0);
+      context.used = 0;
+    }
+  }
+
   auto commandBuffer = getCurrentCommandBuffer();
   VkCommandBufferBeginInfo beginInfo{};
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -92,8 +172,9 @@ void HeliosRenderer::endFrame() {
     throw std::runtime_error("failed to record command buffer!");
   }
 
-  auto result =
-      heliosSwapChain->submitCommandBuffers(&commandBuffer, &currentImageIndex);
+  auto result = heliosSwapChain->submitCommandBuffers(
+      &commandBuffer, &currentImageIndex, uploadWaitValue);
+  uploadWaitValue = 0;
   if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
       heliosWindow.wasWindowResized()) {
     heliosWindow.resetWindowResizedFlag();
@@ -107,7 +188,8 @@ void HeliosRenderer::endFrame() {
       (currentFrameIndex + 1) % HeliosSwapChain::MAX_FRAMES_IN_FLIGHT;
 }
 
-void HeliosRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer) {
+void HeliosRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer,
+                                              VkSubpassContents contents) {
   assert(isFrameStarted &&
          "Can't call beginSwapChainRenderPass if frame is not in progress");
   assert(commandBuffer == getCurrentCommandBuffer() &&
@@ -128,9 +210,13 @@ void HeliosRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer) {
   renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
   renderPassInfo.pClearValues = clearValues.data();
 
-  vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
-                       VK_SUBPASS_CONTENTS_INLINE);
+  vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
+  if (contents == VK_SUBPASS_CONTENTS_INLINE) {
+    setViewportAndScissor(commandBuffer);
+  }
+}
 
+void HeliosRenderer::setViewportAndScissor(VkCommandBuffer commandBuffer) {
   VkViewport viewport{};
   viewport.x = 0.0f;
   viewport.y = 0.0f;
@@ -153,4 +239,51 @@ void HeliosRenderer::endSwapChainRenderPass(VkCommandBuffer commandBuffer) {
   vkCmdEndRenderPass(commandBuffer);
 }
 
+void HeliosRenderer::recordInParallel(
+    VkCommandBuffer commandBuffer, size_t count,
+    const std::function<void(VkCommandBuffer, size_t, size_t)> &record) {
+  assert(isFrameStarted &&
+         "Can't call recordInParallel if frame is not in progress");
+  assert(commandBuffer == getCurrentCommandBuffer() &&
+         "Can't record into command buffer from a different frame");
+  auto &contexts = recordingContexts[currentFrameIndex];
+  size_t rangeCount = std::min(count, contexts.size());
+  if (rangeCount == 0) {
+    return;
+  }
+
+  std::vector<VkCommandBuffer> secondaryBuffers(rangeCount);
+  std::vector<std::future<void>> recorded;
+  recorded.reserve(rangeCount);
+  for (size_t i = 0; i < rangeCount; i++) {
+    size_t begin = count * i / rangeCount;
+    size_t end = count * (i + 1) / rangeCount;
+    recorded.push_back(recordingWorkers.submit([&, i, begin, end]() {
+      VkCommandBuffer secondary = beginSecondaryCommandBuffer(contexts[i]);
+      secondaryBuffers[i] = secondary;
+      record(secondary, begin, end);
+      if (vkEndCommandBuffer(secondary) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record secondary command buffer!");
+      }
+    }));
+  }
+  // wait for every range before rethrowing, the tasks reference locals
+  std::exception_ptr error;
+  for (auto &future : recorded) {
+    try {
+      future.get();
+    } catch (...) {
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(rangeCount),
+                       secondaryBuffers.data());
+}
+
 } // namespace helios
@@ -1,11 +1,14 @@
 #pragma once
 #include "helios_device.hpp"
 #include "helios_swap_chain.hpp"
+#include "helios_thread_pool.hpp"
 #include "helios_window.hpp"
 #include "vulkan/vulkan_core.h"
 
 // std
+#include <algorithm>
 #include <cassert>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <vector>
@@ -39,13 +42,49 @@ public:
   }
 
   VkCommandBuffer beginFrame();
+  // makes the submission of the current frame wait for the device's upload
+  // semaphore to reach value
+  void waitForUpload(uint64_t value) {
+    uploadWaitValue = std::max(uploadWaitValue, value);
+  }
   void endFrame();
-  void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
+  void beginSwapChainRenderPass(
+      VkCommandBuffer commandBuffer,
+      VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
   void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
 
+  // Splits [0, count) into one range per recording thread and calls record
+  // for the ranges concurrently, each with a secondary command buffer that
+  // continues the swap chain render pass with viewport and scissor set. The
+  // buffers are executed in range order, so the result matches recording
+  // the ranges one after another. The render pass must have been begun with
+  // VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, and record has to bind
+  // its own pipeline, descriptor sets and push constants.
+  void recordInParallel(
+      VkCommandBuffer commandBuffer, size_t count,
+      const std::function<void(VkCommandBuffer, size_t begin, size_t end)>
+          &record);
+  unsigned getRecordingThreadCount() const {
+    return recordingWorkers.getThreadCount();
+  }
+
 private:
+  // command pools must not be used by two threads at once, so every range of
+  // recordInParallel records from its own pool, one per frame in flight so a
+  // pool is only reset after its frame has finished executing
+  struct RecordingContext {
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> commandBuffers;
+    // buffers handed out in the current frame
+    size_t used = 0;
+  };
+
   void createCommandBuffers();
   void freeCommandBuffers();
+  void createRecordingContexts();
+  void destroyRecordingContexts();
+  VkCommandBuffer beginSecondaryCommandBuffer(RecordingContext &context);
+  void setViewportAndScissor(VkCommandBuffer commandBuffer);
   void recreateSwapChain();
 
   HeliosWindow &heliosWindow;
@@ -53,10 +92,15 @@ private:
   std::unique_ptr<HeliosSwapChain> heliosSwapChain;
   std::vector<VkCommandBuffer> commandBuffers;
 
+  HeliosThreadPool recordingWorkers;
+  // [frameIndex][range]
+  std::vector<std::vector<RecordingContext>> recordingContexts;
+
   uint32_t currentImageIndex;
   int currentFrameIndex{0};
 
   bool isFrameStarted{false};
+  uint64_t uploadWaitValue{0};
 };
 
 } // namespace helios
@@ -0,0 +1,15 @@
+#pragma once
+
+// Selects the vector instruction set for hand vectorized loops. Exactly one
+// of HELIOS_SIMD_SSE2, HELIOS_SIMD_NEON or HELIOS_SIMD_SCALAR is defined to
+// 1; SSE2 is baseline on x86-64 and NEON on AArch64.
+#if defined(__SSE2__) || defined(_M_X64) ||                                   \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HELIOS_SIMD_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define HELIOS_SIMD_NEON 1
+#include <arm_neon.h>
+#else
+#define HELIOS_SIMD_SCALAR 1
+#endif
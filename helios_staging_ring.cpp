@@ -0,0 +1,128 @@
+#include "helios_staging_ring.hpp"
+#include "helios_device.hpp"
+
+// std
+#include <cassert>
+
+namespace helios {
+
+HeliosStagingRing::Region &
+HeliosStagingRing::Region::operator=(Region &&other) noexcept {
+  if (this != &other) {
+    release();
+    ring = other.ring;
+    buffer = other.buffer;
+    offset = other.offset;
+    size = other.size;
+    mapped = other.mapped;
+    id = other.id;
+    temporary = other.temporary;
+    other.ring = nullptr;
+  }
+  return *this;
+}
+
+void HeliosStagingRing::Region::release() {
+  if (ring) {
+    ring->release(*this);
+    ring = nullptr;
+  }
+}
+
+HeliosStagingRing::HeliosStagingRing(HeliosDevice &device, VkDeviceSize size)
+    : heliosDevice{device}, capacity{size} {
+  // read by immediate uploads on the graphics queue as well
+  heliosDevice.createBuffer(capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            buffer, allocation, true);
+}
+
+HeliosStagingRing::~HeliosStagingRing() {
+  assert(entries.empty() && "staging regions outlive their ring");
+  heliosDevice.destroyBuffer(buffer, allocation);
+}
+
+bool HeliosStagingRing::allocateFromRing(VkDeviceSize size,
+                                         VkDeviceSize &offset) {
+  if (head == tail && !entries.empty()) {
+    return false;
+  }
+  VkDeviceSize start = (head + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  if (head >= tail) {
+    // free space is [head, capacity) followed by [0, tail)
+    if (start + size <= capacity) {
+      offset = start;
+    } else if (size <= tail) {
+      offset = 0;
+    } else {
+      return false;
+    }
+  } else if (start + size <= tail) {
+    offset = start;
+  } else {
+    return false;
+  }
+  head = offset + size;
+  entries.push_back({head, false});
+  return true;
+}
+
+HeliosStagingRing::Region HeliosStagingRing::allocate(VkDeviceSize size) {
+  Region region{};
+  region.size = size;
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    if (size <= capacity / 4 && allocateFromRing(size, region.offset)) {
+      region.ring = this;
+      region.buffer = buffer;
+      region.mapped = static_cast<char *>(allocation.mapped) + region.offset;
+      region.id = firstId + entries.size() - 1;
+      ringAllocations++;
+      return region;
+    }
+    temporaryAllocations++;
+  }
+
+  heliosDevice.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            region.buffer, region.temporary, true);
+  region.ring = this;
+  region.mapped = region.temporary.mapped;
+  return region;
+}
+
+void HeliosStagingRing::release(Region &region) {
+  if (region.isTemporary()) {
+    heliosDevice.destroyBuffer(region.buffer, region.temporary);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock{mutex};
+  entries[region.id - firstId].released = true;
+  while (!entries.empty() && entries.front().released) {
+    tail = entries.front().end;
+    entries.pop_front();
+    firstId++;
+  }
+  if (entries.empty()) {
+    // start over at the beginning so large regions don't need to wrap
+    head = tail = 0;
+  }
+}
+
+HeliosStagingRing::Stats HeliosStagingRing::getStats() const {
+  std::lock_guard<std::mutex> lock{mutex};
+
+  Stats stats{};
+  stats.capacity = capacity;
+  if (!entries.empty()) {
+    stats.usedBytes = head > tail ? head - tail : capacity - tail + head;
+  }
+  stats.ringAllocations = ringAllocations;
+  stats.temporaryAllocations = temporaryAllocations;
+  return stats;
+}
+
+} // namespace helios
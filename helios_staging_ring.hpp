@@ -0,0 +1,103 @@
+#pragma once
+
+#include "helios_allocator.hpp"
+#include "vulkan/vulkan_core.h"
+
+// std
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+namespace helios {
+
+class HeliosDevice;
+
+// Persistently mapped host visible buffer that upload data is staged in
+// instead of a buffer of its own per upload. Regions are handed out in ring
+// order and recycled once released, which their owner does after the fence
+// of the submission reading them signaled; the ring's tail only moves past
+// released regions, so one slow upload holds back the ones staged after it.
+// Uploads larger than a quarter of the ring, or staged while it is full, get
+// a temporary buffer instead.
+class HeliosStagingRing {
+public:
+  static constexpr VkDeviceSize DEFAULT_SIZE = VkDeviceSize{32} << 20;
+  // keeps every region aligned for any vector type copied into it
+  static constexpr VkDeviceSize ALIGNMENT = 16;
+
+  // Move only handle of staging memory, released when destroyed.
+  class Region {
+  public:
+    Region() = default;
+    ~Region() { release(); }
+    Region(Region &&other) noexcept { *this = std::move(other); }
+    Region &operator=(Region &&other) noexcept;
+
+    Region(const Region &) = delete;
+    Region &operator=(const Region &) = delete;
+
+    VkBuffer getBuffer() const { return buffer; }
+    VkDeviceSize getOffset() const { return offset; }
+    VkDeviceSize getSize() const { return size; }
+    void *getMappedMemory() const { return mapped; }
+    bool isTemporary() const { return temporary.memory != VK_NULL_HANDLE; }
+
+  private:
+    friend class HeliosStagingRing;
+    void release();
+
+    HeliosStagingRing *ring = nullptr;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void *mapped = nullptr;
+    uint64_t id = 0;
+    HeliosAllocator::Allocation temporary{};
+  };
+
+  struct Stats {
+    VkDeviceSize capacity = 0;
+    // bytes between tail and head, alignment and wrap padding included
+    VkDeviceSize usedBytes = 0;
+    uint64_t ringAllocations = 0;
+    uint64_t temporaryAllocations = 0;
+  };
+
+  HeliosStagingRing(HeliosDevice &device, VkDeviceSize size = DEFAULT_SIZE);
+  ~HeliosStagingRing();
+
+  HeliosStagingRing(const HeliosStagingRing &) = delete;
+  HeliosStagingRing &operator=(const HeliosStagingRing &) = delete;
+
+  // thread safe, like releasing regions
+  Region allocate(VkDeviceSize size);
+
+  Stats getStats() const;
+
+private:
+  struct Entry {
+    // ring offset right after the region
+    VkDeviceSize end = 0;
+    bool released = false;
+  };
+
+  bool allocateFromRing(VkDeviceSize size, VkDeviceSize &offset);
+  void release(Region &region);
+
+  HeliosDevice &heliosDevice;
+  VkBuffer buffer = VK_NULL_HANDLE;
+  HeliosAllocator::Allocation allocation{};
+  VkDeviceSize capacity;
+
+  mutable std::mutex mutex;
+  VkDeviceSize head = 0;
+  VkDeviceSize tail = 0;
+  // live regions in ring order, entries[i] has id firstId + i
+  std::deque<Entry> entries;
+  uint64_t firstId = 0;
+  uint64_t ringAllocations = 0;
+  uint64_t temporaryAllocations = 0;
+};
+
+} // namespace helios
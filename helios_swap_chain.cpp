@@ -48,8 +48,7 @@ HeliosSwapChain::~HeliosSwapChain() {
 
   for (int i = 0; i < depthImages.size(); i++) {
     vkDestroyImageView(device.device(), depthImageViews[i], nullptr);
-    vkDestroyImage(device.device(), depthImages[i], nullptr);
-    vkFreeMemory(device.device(), depthImageMemorys[i], nullptr);
+    device.destroyImage(depthImages[i], depthImageAllocations[i]);
   }
 
   for (auto framebuffer : swapChainFramebuffers) {
@@ -80,7 +79,8 @@ VkResult HeliosSwapChain::acquireNextImage(uint32_t *imageIndex) {
 }
 
 VkResult HeliosSwapChain::submitCommandBuffers(const VkCommandBuffer *buffers,
-                                               uint32_t *imageIndex) {
+                                               uint32_t *imageIndex,
+                                               uint64_t uploadValue) {
   if (imagesInFlight[*imageIndex] != VK_NULL_HANDLE) {
     vkWaitForFences(device.device(), 1, &imagesInFlight[*imageIndex], VK_TRUE,
                     UINT64_MAX);
@@ -90,10 +90,13 @@ VkResult HeliosSwapChain::submitCommandBuffers(const VkCommandBuffer *buffers,
   VkSubmitInfo submitInfo = {};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-  VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
+  VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame],
+                                  device.uploadSemaphore()};
   VkPipelineStageFlags waitStages[] = {
-      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-  submitInfo.waitSemaphoreCount = 1;
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+      VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT};
+  submitInfo.waitSemaphoreCount = uploadValue > 0 ? 2 : 1;
   submitInfo.pWaitSemaphores = waitSemaphores;
   submitInfo.pWaitDstStageMask = waitStages;
 
@@ -104,6 +107,19 @@ VkResult HeliosSwapChain::submitCommandBuffers(const VkCommandBuffer *buffers,
   submitInfo.signalSemaphoreCount = 1;
   submitInfo.pSignalSemaphores = signalSemaphores;
 
+  // binary semaphores ignore their values
+  uint64_t waitValues[] = {0, uploadValue};
+  uint64_t signalValue = 0;
+  VkTimelineSemaphoreSubmitInfo timelineInfo{};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timelineInfo.waitSemaphoreValueCount = submitInfo.waitSemaphoreCount;
+  timelineInfo.pWaitSemaphoreValues = waitValues;
+  timelineInfo.signalSemaphoreValueCount = 1;
+  timelineInfo.pSignalSemaphoreValues = &signalValue;
+  if (uploadValue > 0) {
+    submitInfo.pNext = &timelineInfo;
+  }
+
   vkResetFences(device.device(), 1, &inFlightFences[currentFrame]);
   if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo,
                     inFlightFences[currentFrame]) != VK_SUCCESS) {
@@ -311,7 +327,7 @@ void HeliosSwapChain::createDepthResources() {
   VkExtent2D swapChainExtent = getSwapChainExtent();
 
   depthImages.resize(imageCount());
-  depthImageMemorys.resize(imageCount());
+  depthImageAllocations.resize(imageCount());
   depthImageViews.resize(imageCount());
 
   for (int i = 0; i < depthImages.size(); i++) {
@@ -332,7 +348,7 @@ void HeliosSwapChain::createDepthResources() {
     imageInfo.flags = 0;
 
     device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                               depthImages[i], depthImageMemorys[i]);
+                               depthImages[i], depthImageAllocations[i]);
 
     VkImageViewCreateInfo viewInfo{};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -43,8 +43,11 @@ public:
   VkFormat findDepthFormat();
 
   VkResult acquireNextImage(uint32_t *imageIndex);
+  // waits for the device's upload semaphore to reach uploadValue before
+  // vertex input and compute shaders, unless it is 0
   VkResult submitCommandBuffers(const VkCommandBuffer *buffers,
-                                uint32_t *imageIndex);
+                                uint32_t *imageIndex,
+                                uint64_t uploadValue = 0);
 
   bool compareSwapFormats(const HeliosSwapChain &swapChain) const {
     return swapChain.swapChainDepthFormat == swapChainDepthFormat &&
@@ -75,7 +78,7 @@ private:
   VkRenderPass renderPass;
 
   std::vector<VkImage> depthImages;
-  std::vector<VkDeviceMemory> depthImageMemorys;
+  std::vector<HeliosAllocator::Allocation> depthImageAllocations;
   std::vector<VkImageView> depthImageViews;
   std::vector<VkImage> swapChainImages;
   std::vector<VkImageView> swapChainImageViews;
@@ -0,0 +1,45 @@
+#include "helios_thread_pool.hpp"
+
+// std
+#include <algorithm>
+
+namespace helios {
+
+HeliosThreadPool::HeliosThreadPool(unsigned threadCount) {
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  workers.reserve(threadCount);
+  for (unsigned i = 0; i < threadCount; i++) {
+    workers.emplace_back(&HeliosThreadPool::workerLoop, this);
+  }
+}
+
+HeliosThreadPool::~HeliosThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    stopping = true;
+  }
+  taskAvailable.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+void HeliosThreadPool::workerLoop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock{mutex};
+      taskAvailable.wait(lock, [this]() { return stopping || !tasks.empty(); });
+      if (tasks.empty()) {
+        return;
+      }
+      task = std::move(tasks.front());
+      tasks.pop();
+    }
+    task();
+  }
+}
+
+} // namespace helios
@@ -0,0 +1,57 @@
+#pragma once
+
+// std
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace helios {
+
+// Fixed set of worker threads running submitted tasks in FIFO order. Results
+// and exceptions are delivered through the returned future.
+class HeliosThreadPool {
+public:
+  // threadCount of 0 uses std::thread::hardware_concurrency()
+  explicit HeliosThreadPool(unsigned threadCount = 0);
+  // finishes the queued tasks before joining the workers
+  ~HeliosThreadPool();
+
+  HeliosThreadPool(const HeliosThreadPool &) = delete;
+  HeliosThreadPool &operator=(const HeliosThreadPool &) = delete;
+
+  template <typename F>
+  std::future<std::invoke_result_t<F>> submit(F &&function) {
+    using Result = std::invoke_result_t<F>;
+    // std::function needs a copyable target, packaged_task is move only
+    auto task = std::make_shared<std::packaged_task<Result()>>(
+        std::forward<F>(function));
+    std::future<Result> result = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      tasks.emplace([task]() { (*task)(); });
+    }
+    taskAvailable.notify_one();
+    return result;
+  }
+
+  unsigned getThreadCount() const {
+    return static_cast<unsigned>(workers.size());
+  }
+
+private:
+  void workerLoop();
+
+  std::vector<std::thread> workers;
+  std::queue<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable taskAvailable;
+  bool stopping = false;
+};
+
+} // namespace helios
@@ -0,0 +1,138 @@
+#include "helios_upload_batch.hpp"
+
+// std
+#include <algorithm>
+#include <functional>
+
+namespace helios {
+
+namespace {
+
+// read by the draws and culling dispatches using uploaded data
+constexpr VkPipelineStageFlags UPLOAD_READ_STAGES =
+    VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+constexpr VkAccessFlags UPLOAD_READ_ACCESS =
+    VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+    VK_ACCESS_SHADER_READ_BIT;
+
+} // namespace
+
+HeliosUploadBatch::HeliosUploadBatch(HeliosDevice &device)
+    : heliosDevice{device} {}
+
+void HeliosUploadBatch::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer,
+                                   const VkBufferCopy &region) {
+  bufferCopies.push_back({srcBuffer, dstBuffer, region});
+}
+
+void HeliosUploadBatch::copyBufferToImage(VkBuffer srcBuffer,
+                                          VkImage dstImage,
+                                          const VkBufferImageCopy &region) {
+  imageCopies.push_back({srcBuffer, dstImage, region});
+}
+
+void HeliosUploadBatch::record(VkCommandBuffer commandBuffer,
+                               bool releaseOwnership) {
+  // grouped by resources, the order of copies to disjoint ranges is free
+  std::stable_sort(bufferCopies.begin(), bufferCopies.end(),
+                   [](const BufferCopy &a, const BufferCopy &b) {
+                     std::less<VkBuffer> less{};
+                     if (a.srcBuffer != b.srcBuffer) {
+                       return less(a.srcBuffer, b.srcBuffer);
+                     }
+                     return less(a.dstBuffer, b.dstBuffer);
+                   });
+  std::vector<VkBufferCopy> regions{};
+  for (size_t i = 0; i < bufferCopies.size(); i++) {
+    regions.push_back(bufferCopies[i].region);
+    bool last = i + 1 == bufferCopies.size() ||
+                bufferCopies[i + 1].srcBuffer != bufferCopies[i].srcBuffer ||
+                bufferCopies[i + 1].dstBuffer != bufferCopies[i].dstBuffer;
+    if (last) {
+      vkCmdCopyBuffer(commandBuffer, bufferCopies[i].srcBuffer,
+                      bufferCopies[i].dstBuffer,
+                      static_cast<uint32_t>(regions.size()), regions.data());
+      regions.clear();
+    }
+  }
+  for (const auto &copy : imageCopies) {
+    vkCmdCopyBufferToImage(commandBuffer, copy.srcBuffer, copy.dstImage,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                           &copy.region);
+  }
+
+  if (releaseOwnership) {
+    if (!imageCopies.empty()) {
+      recordOwnershipBarriers(commandBuffer, true);
+    }
+    return;
+  }
+
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = UPLOAD_READ_ACCESS;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       UPLOAD_READ_STAGES, 0, 1, &barrier, 0, nullptr, 0,
+                       nullptr);
+}
+
+void HeliosUploadBatch::recordOwnershipBarriers(VkCommandBuffer commandBuffer,
+                                                bool release) const {
+  // Only images change owner, buffers are shared by both families and the
+  // upload semaphore alone orders their copies before the reads. Layouts stay
+  // as they are, the caller transitions the images.
+  std::vector<VkImageMemoryBarrier> imageBarriers{};
+  for (const auto &copy : imageCopies) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask =
+        release ? VkAccessFlags{VK_ACCESS_TRANSFER_WRITE_BIT} : VkAccessFlags{};
+    barrier.dstAccessMask =
+        release ? VkAccessFlags{} : VkAccessFlags{VK_ACCESS_SHADER_READ_BIT};
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = heliosDevice.transferQueueFamily();
+    barrier.dstQueueFamilyIndex = heliosDevice.graphicsQueueFamily();
+    barrier.image = copy.dstImage;
+    const auto &subresource = copy.region.imageSubresource;
+    barrier.subresourceRange.aspectMask = subresource.aspectMask;
+    barrier.subresourceRange.baseMipLevel = subresource.mipLevel;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = subresource.baseArrayLayer;
+    barrier.subresourceRange.layerCount = subresource.layerCount;
+    imageBarriers.push_back(barrier);
+  }
+
+  // the acquisition waits for the upload semaphore at UPLOAD_READ_STAGES
+  VkPipelineStageFlags srcStages =
+      release ? VkPipelineStageFlags{VK_PIPELINE_STAGE_TRANSFER_BIT}
+              : UPLOAD_READ_STAGES;
+  VkPipelineStageFlags dstStages =
+      release ? VkPipelineStageFlags{VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT}
+              : UPLOAD_READ_STAGES;
+  vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr, 0,
+                       nullptr, static_cast<uint32_t>(imageBarriers.size()),
+                       imageBarriers.data());
+}
+
+uint64_t HeliosUploadBatch::submit() {
+  bool releaseOwnership = heliosDevice.hasTransferQueue();
+  return heliosDevice.submitUpload([&](VkCommandBuffer commandBuffer) {
+    record(commandBuffer, releaseOwnership);
+  });
+}
+
+void HeliosUploadBatch::recordAcquire(VkCommandBuffer commandBuffer) const {
+  if (heliosDevice.hasTransferQueue() && !imageCopies.empty()) {
+    recordOwnershipBarriers(commandBuffer, false);
+  }
+}
+
+void HeliosUploadBatch::submitAndWait() {
+  VkCommandBuffer commandBuffer = heliosDevice.beginSingleTimeCommands();
+  record(commandBuffer);
+  heliosDevice.endSingleTimeCommands(commandBuffer);
+}
+
+} // namespace helios
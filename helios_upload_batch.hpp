@@ -0,0 +1,71 @@
+#pragma once
+
+#include "helios_device.hpp"
+#include "vulkan/vulkan_core.h"
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace helios {
+
+// Collects buffer and buffer to image copies and records all of them into a
+// single command buffer, so any number of uploads costs one submission.
+// Copies between the same pair of resources go into one copy command.
+// Images must be in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, transitioning them
+// afterwards is left to the caller.
+class HeliosUploadBatch {
+public:
+  explicit HeliosUploadBatch(HeliosDevice &device);
+
+  HeliosUploadBatch(const HeliosUploadBatch &) = delete;
+  HeliosUploadBatch &operator=(const HeliosUploadBatch &) = delete;
+
+  void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer,
+                  const VkBufferCopy &region);
+  void copyBufferToImage(VkBuffer srcBuffer, VkImage dstImage,
+                         const VkBufferImageCopy &region);
+
+  bool empty() const { return bufferCopies.empty() && imageCopies.empty(); }
+  size_t getCopyCount() const {
+    return bufferCopies.size() + imageCopies.size();
+  }
+
+  // Records the copies followed by a barrier making them visible to
+  // vertex input and shader reads, or with releaseOwnership the release of
+  // the written images from the transfer to the graphics family.
+  void record(VkCommandBuffer commandBuffer, bool releaseOwnership = false);
+  // Submits to the device's upload queue without waiting, see
+  // HeliosDevice::submitUpload. Destination buffers must be created with
+  // sharedWithTransferQueue, so waiting for the upload semaphore is enough.
+  // With a separate transfer family images are released and recordAcquire()
+  // has to be recorded on the graphics queue before they are used.
+  uint64_t submit();
+  // Records the matching image acquisitions, nothing without a transfer
+  // family.
+  void recordAcquire(VkCommandBuffer commandBuffer) const;
+  // records on the graphics queue and waits for the copies to complete
+  void submitAndWait();
+
+private:
+  struct BufferCopy {
+    VkBuffer srcBuffer;
+    VkBuffer dstBuffer;
+    VkBufferCopy region;
+  };
+
+  struct ImageCopy {
+    VkBuffer srcBuffer;
+    VkImage dstImage;
+    VkBufferImageCopy region;
+  };
+
+  void recordOwnershipBarriers(VkCommandBuffer commandBuffer,
+                               bool release) const;
+
+  HeliosDevice &heliosDevice;
+  std::vector<BufferCopy> bufferCopies;
+  std::vector<ImageCopy> imageCopies;
+};
+
+} // namespace helios
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <functional>
 
 namespace helios {
@@ -11,4 +13,36 @@ void hashCombine(std::size_t &seed, const T &v, const Rest &...rest) {
   (hashCombine(seed, rest), ...);
 };
 
+// 64-bit finalizer from MurmurHash3, every input bit affects every output bit
+inline uint64_t mix64(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+// Non-cryptographic hash of raw bytes, consumed eight at a time.
+inline uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 0) {
+  constexpr uint64_t MULTIPLIER = 0x9e3779b97f4a7c15ULL;
+  auto bytes = static_cast<const unsigned char *>(data);
+  uint64_t h = seed ^ (size * MULTIPLIER);
+
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, bytes + i, sizeof(word));
+    h = (h ^ mix64(word)) * MULTIPLIER;
+  }
+
+  if (i < size) {
+    uint64_t tail = 0;
+    memcpy(&tail, bytes + i, size - i);
+    h = (h ^ mix64(tail)) * MULTIPLIER;
+  }
+
+  return mix64(h);
+}
+
 } // namespace helios
@@ -0,0 +1,70 @@
+#include "helios_vertex_table.hpp"
+
+// std
+#include <cstring>
+
+namespace helios {
+
+namespace {
+
+size_t slotCountFor(size_t expectedCount) {
+  // keep the load factor at or below one half
+  size_t slotCount = 16;
+  while (slotCount < expectedCount * 2) {
+    slotCount *= 2;
+  }
+  return slotCount;
+}
+
+} // namespace
+
+HeliosVertexTable::HeliosVertexTable(
+    std::vector<HeliosModel::Vertex> &vertices, size_t expectedCount)
+    : vertices{vertices} {
+  slots.assign(slotCountFor(expectedCount), Slot{0, EMPTY});
+  mask = slots.size() - 1;
+}
+
+uint32_t HeliosVertexTable::insert(const HeliosModel::Vertex &vertex,
+                                   uint64_t vertexHash) {
+  const uint32_t tag = static_cast<uint32_t>(vertexHash >> 32);
+  size_t position = static_cast<size_t>(vertexHash) & mask;
+
+  while (true) {
+    Slot &slot = slots[position];
+    if (slot.index == EMPTY) {
+      if ((count + 1) * 2 > slots.size()) {
+        grow();
+        return insert(vertex, vertexHash);
+      }
+      slot = {tag, static_cast<uint32_t>(vertices.size())};
+      vertices.push_back(vertex);
+      count++;
+      return slot.index;
+    }
+    if (slot.tag == tag &&
+        memcmp(&vertices[slot.index], &vertex, sizeof(vertex)) == 0) {
+      return slot.index;
+    }
+    position = (position + 1) & mask;
+  }
+}
+
+void HeliosVertexTable::grow() {
+  std::vector<Slot> oldSlots = std::move(slots);
+  slots.assign(oldSlots.size() * 2, Slot{0, EMPTY});
+  mask = slots.size() - 1;
+
+  for (const auto &old : oldSlots) {
+    if (old.index == EMPTY) {
+      continue;
+    }
+    size_t position = static_cast<size_t>(hash(vertices[old.index])) & mask;
+    while (slots[position].index != EMPTY) {
+      position = (position + 1) & mask;
+    }
+    slots[position] = old;
+  }
+}
+
+} // namespace helios
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "helios_model.hpp"
+#include "helios_utils.hpp"
+
+// std
+#include <algorithm>
+#include <cstdint>
+#include <future>
+#include <thread>
+#include <vector>
+
+namespace helios {
+
+// Open addressing hash set of HeliosModel::Vertex used to merge duplicate
+// vertices. Keys are compared bitwise and live in the caller's vertex array,
+// slots only hold the vertex index plus a hash tag to skip most compares.
+class HeliosVertexTable {
+public:
+  HeliosVertexTable(std::vector<HeliosModel::Vertex> &vertices,
+                    size_t expectedCount);
+
+  HeliosVertexTable(const HeliosVertexTable &) = delete;
+  HeliosVertexTable &operator=(const HeliosVertexTable &) = delete;
+
+  // Returns the index of a bitwise equal vertex, appending it first if absent.
+  uint32_t insert(const HeliosModel::Vertex &vertex) {
+    return insert(vertex, hash(vertex));
+  }
+  uint32_t insert(const HeliosModel::Vertex &vertex, uint64_t vertexHash);
+
+  static uint64_t hash(const HeliosModel::Vertex &vertex) {
+    return hashBytes(&vertex, sizeof(vertex));
+  }
+
+  // Builds unique vertices (in first seen order) and one index per corner,
+  // where makeVertex(i) returns the vertex of corner i and must be safe to
+  // call concurrently. Large inputs are split into shards deduplicated on
+  // separate threads; the shard results are merged in order, so the output
+  // is identical to a single threaded pass.
+  template <typename MakeVertex>
+  static void deduplicate(size_t cornerCount, MakeVertex makeVertex,
+                          std::vector<HeliosModel::Vertex> &vertices,
+                          std::vector<uint32_t> &indices,
+                          unsigned threadCount = 0);
+
+private:
+  struct Slot {
+    uint32_t tag;
+    uint32_t index;
+  };
+
+  static constexpr uint32_t EMPTY = UINT32_MAX;
+  // below this many corners per shard a thread costs more than it saves
+  static constexpr size_t MIN_SHARD_SIZE = 64 * 1024;
+
+  void grow();
+
+  std::vector<HeliosModel::Vertex> &vertices;
+  std::vector<Slot> slots;
+  size_t mask;
+  size_t count = 0;
+};
+
+template <typename MakeVertex>
+void HeliosVertexTable::deduplicate(size_t cornerCount, MakeVertex makeVertex,
+                                    std::vector<HeliosModel::Vertex> &vertices,
+                                    std::vector<uint32_t> &indices,
+                                    unsigned threadCount) {
+  vertices.clear();
+  indices.clear();
+
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  size_t shardCount =
+      std::min<size_t>(threadCount, cornerCount / MIN_SHARD_SIZE);
+
+  // triangle meshes typically reference each vertex about six times, so a
+  // table sized for every corner would be mostly empty and miss the cache
+  if (shardCount <= 1) {
+    HeliosVertexTable table{vertices, cornerCount / 8};
+    indices.reserve(cornerCount);
+    for (size_t i = 0; i < cornerCount; i++) {
+      indices.push_back(table.insert(makeVertex(i)));
+    }
+    return;
+  }
+
+  struct Shard {
+    size_t begin;
+    size_t end;
+    std::vector<HeliosModel::Vertex> vertices{};
+    std::vector<uint32_t> indices{};
+  };
+
+  std::vector<Shard> shards(shardCount);
+  for (size_t s = 0; s < shardCount; s++) {
+    shards[s].begin = cornerCount * s / shardCount;
+    shards[s].end = cornerCount * (s + 1) / shardCount;
+  }
+
+  auto forEachShard = [&shards](auto &&work) {
+    std::vector<std::future<void>> tasks;
+    for (size_t s = 1; s < shards.size(); s++) {
+      tasks.push_back(
+          std::async(std::launch::async, [&, s] { work(shards[s]); }));
+    }
+    work(shards[0]);
+    for (auto &task : tasks) {
+      task.get();
+    }
+  };
+
+  // local dedup, indices refer to the shard's own vertex array
+  forEachShard([&makeVertex](Shard &shard) {
+    HeliosVertexTable table{shard.vertices, (shard.end - shard.begin) / 8};
+    shard.indices.reserve(shard.end - shard.begin);
+    for (size_t i = shard.begin; i < shard.end; i++) {
+      shard.indices.push_back(table.insert(makeVertex(i)));
+    }
+  });
+
+  // merge in shard order so first seen order matches a sequential pass, this
+  // only touches the shards' unique vertices rather than every corner
+  std::vector<std::vector<uint32_t>> remaps(shardCount);
+  size_t uniqueCount = 0;
+  for (const auto &shard : shards) {
+    uniqueCount += shard.vertices.size();
+  }
+  HeliosVertexTable table{vertices, uniqueCount};
+  for (size_t s = 0; s < shardCount; s++) {
+    remaps[s].reserve(shards[s].vertices.size());
+    for (const auto &vertex : shards[s].vertices) {
+      remaps[s].push_back(table.insert(vertex));
+    }
+    shards[s].vertices = {};
+  }
+
+  indices.resize(cornerCount);
+  forEachShard([&](Shard &shard) {
+    const auto &remap = remaps[&shard - shards.data()];
+    for (size_t i = shard.begin; i < shard.end; i++) {
+      indices[i] = remap[shard.indices[i - shard.begin]];
+    }
+  });
+}
+
+} // namespace helios
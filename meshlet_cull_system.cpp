@@ -0,0 +1,205 @@
+#include "meshlet_cull_system.hpp"
+#include "helios_swap_chain.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_FORCE_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace helios {
+
+namespace {
+
+struct MeshletCullPushConstantData {
+  glm::vec4 frustumPlanes[6];
+  glm::vec4 cameraPosition;
+  uint32_t meshletCount;
+  // where the model starts in its geometry arena block
+  uint32_t firstIndex;
+  int32_t vertexOffset;
+};
+
+constexpr uint32_t WORKGROUP_SIZE = 64;
+// culled objects per frame, the rest are drawn whole
+constexpr uint32_t MAX_CULLED_OBJECTS = 1024;
+
+} // namespace
+
+MeshletCullSystem::MeshletCullSystem(HeliosDevice &device)
+    : heliosDevice{device} {
+  createDescriptorSetLayout();
+  createPipelineLayout();
+  createPipeline();
+
+  descriptorPools.resize(HeliosSwapChain::MAX_FRAMES_IN_FLIGHT);
+  drawBuffers.resize(HeliosSwapChain::MAX_FRAMES_IN_FLIGHT);
+  for (auto &pool : descriptorPools) {
+    pool = HeliosDescriptorPool::Builder(heliosDevice)
+               .setMaxSets(MAX_CULLED_OBJECTS)
+               .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                            2 * MAX_CULLED_OBJECTS)
+               .build();
+  }
+}
+
+MeshletCullSystem::~MeshletCullSystem() {
+  vkDestroyPipelineLayout(heliosDevice.device(), pipelineLayout, nullptr);
+}
+
+void MeshletCullSystem::createDescriptorSetLayout() {
+  setLayout = HeliosDescriptorSetLayout::Builder(heliosDevice)
+                  .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                              VK_SHADER_STAGE_COMPUTE_BIT)
+                  .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                              VK_SHADER_STAGE_COMPUTE_BIT)
+                  .build();
+}
+
+void MeshletCullSystem::createPipelineLayout() {
+  VkPushConstantRange pushConstantRange{};
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = sizeof(MeshletCullPushConstantData);
+
+  VkDescriptorSetLayout descriptorSetLayout =
+      setLayout->getDescriptorSetLayout();
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+  if (vkCreatePipelineLayout(heliosDevice.device(), &pipelineLayoutInfo,
+                             nullptr, &pipelineLayout) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create pipeline layout");
+  }
+}
+
+void MeshletCullSystem::createPipeline() {
+  assert(pipelineLayout != nullptr &&
+         "cannot create pipeline before pipeline layout");
+
+  heliosPipeline = std::make_unique<HeliosPipeline>(
+      heliosDevice, "shaders/meshlet_cull.comp.spv", pipelineLayout);
+}
+
+void MeshletCullSystem::reserveDrawCommands(int frameIndex,
+                                            VkDeviceSize size) {
+  auto &buffer = drawBuffers[frameIndex];
+  if (buffer && buffer->getBufferSize() >= size) {
+    return;
+  }
+
+  // the frame's previous submission has completed, so replacing is safe
+  VkDeviceSize capacity =
+      buffer ? std::max(size, 2 * buffer->getBufferSize()) : size;
+  buffer = std::make_unique<HeliosBuffer>(
+      heliosDevice, capacity, 1,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+void MeshletCullSystem::cullGameObjects(
+    FrameInfo &frameInfo, std::vector<HeliosGameObject> &gameObjects) {
+  drawRanges.assign(gameObjects.size(), DrawRange{});
+
+  // every culled object gets its own range of commands, aligned so it can
+  // be bound as a storage buffer
+  const VkDeviceSize alignment =
+      heliosDevice.properties.limits.minStorageBufferOffsetAlignment;
+  VkDeviceSize size = 0;
+  uint32_t culledObjects = 0;
+  for (size_t i = 0; i < gameObjects.size(); i++) {
+    auto &model = gameObjects[i].model;
+    if (!model || !model->isReady() || !model->hasMeshlets() ||
+        culledObjects == MAX_CULLED_OBJECTS) {
+      continue;
+    }
+    drawRanges[i] = {size, model->getMeshletCount()};
+    size += drawRanges[i].count * sizeof(VkDrawIndexedIndirectCommand);
+    size = (size + alignment - 1) / alignment * alignment;
+    culledObjects++;
+  }
+  if (size == 0) {
+    return;
+  }
+
+  reserveDrawCommands(frameInfo.frameIndex, size);
+  auto &drawBuffer = *drawBuffers[frameInfo.frameIndex];
+  auto &descriptorPool = *descriptorPools[frameInfo.frameIndex];
+  descriptorPool.resetPool();
+
+  heliosPipeline->bind(frameInfo.commandBuffer);
+
+  auto projectionView =
+      frameInfo.camera.getProjection() * frameInfo.camera.getView();
+  glm::vec4 cameraPosition = glm::inverse(frameInfo.camera.getView())[3];
+
+  for (size_t i = 0; i < gameObjects.size(); i++) {
+    auto &range = drawRanges[i];
+    if (range.count == 0) {
+      continue;
+    }
+    auto &obj = gameObjects[i];
+
+    auto meshletInfo = obj.model->meshletBufferInfo();
+    auto drawInfo = drawBuffer.descriptorInfo(
+        range.count * sizeof(VkDrawIndexedIndirectCommand), range.offset);
+    VkDescriptorSet descriptorSet;
+    if (!HeliosDescriptorWriter(*setLayout, descriptorPool)
+             .writeBuffer(0, &meshletInfo)
+             .writeBuffer(1, &drawInfo)
+             .build(descriptorSet)) {
+      range.count = 0;
+      continue;
+    }
+
+    MeshletCullPushConstantData push{};
+    auto modelMatrix = obj.transform.mat4();
+    HeliosCamera::extractFrustumPlanes(projectionView * modelMatrix,
+                                       push.frustumPlanes);
+    push.cameraPosition = glm::inverse(modelMatrix) * cameraPosition;
+    push.meshletCount = range.count;
+    push.firstIndex = obj.model->getFirstIndex();
+    push.vertexOffset = obj.model->getVertexOffset();
+
+    vkCmdBindDescriptorSets(frameInfo.commandBuffer,
+                            VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0,
+                            1, &descriptorSet, 0, nullptr);
+    vkCmdPushConstants(frameInfo.commandBuffer, pipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(MeshletCullPushConstantData), &push);
+    vkCmdDispatch(frameInfo.commandBuffer,
+                  (range.count + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+  }
+
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+  vkCmdPipelineBarrier(frameInfo.commandBuffer,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0,
+                       nullptr, 0, nullptr);
+}
+
+bool MeshletCullSystem::drawGameObject(FrameInfo &frameInfo,
+                                       size_t objectIndex,
+                                       HeliosModel &model) const {
+  if (!hasDrawCommands(objectIndex)) {
+    return false;
+  }
+  const auto &range = drawRanges[objectIndex];
+  model.drawIndirect(frameInfo.commandBuffer,
+                     drawBuffers[frameInfo.frameIndex]->getBuffer(),
+                     range.offset, range.count);
+  return true;
+}
+
+} // namespace helios
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "helios_buffer.hpp"
+#include "helios_descriptors.hpp"
+#include "helios_device.hpp"
+#include "helios_frame_info.hpp"
+#include "helios_game_object.hpp"
+#include "helios_pipeline.hpp"
+
+// std
+#include <memory>
+#include <vector>
+
+namespace helios {
+
+// Culls the meshlets of every game object against the camera frustum and
+// normal cones on the GPU. Each meshlet gets an indirect draw command that is
+// empty when culled; SimpleRenderSystem draws them through drawGameObject.
+class MeshletCullSystem {
+public:
+  MeshletCullSystem(HeliosDevice &device);
+  ~MeshletCullSystem();
+
+  MeshletCullSystem(const MeshletCullSystem &) = delete;
+  MeshletCullSystem &operator=(const MeshletCullSystem &) = delete;
+
+  // Records the culling dispatches, must be called outside a render pass
+  // and before drawing the same gameObjects in this frame.
+  void cullGameObjects(FrameInfo &frameInfo,
+                       std::vector<HeliosGameObject> &gameObjects);
+
+  // Draws gameObjects[objectIndex] from its culled commands. Returns false
+  // when the object was not culled, the caller then draws it whole.
+  bool drawGameObject(FrameInfo &frameInfo, size_t objectIndex,
+                      HeliosModel &model) const;
+  // whether drawGameObject would draw gameObjects[objectIndex]
+  bool hasDrawCommands(size_t objectIndex) const {
+    return objectIndex < drawRanges.size() &&
+           drawRanges[objectIndex].count > 0;
+  }
+
+private:
+  struct DrawRange {
+    VkDeviceSize offset = 0;
+    uint32_t count = 0;
+  };
+
+  void createDescriptorSetLayout();
+  void createPipelineLayout();
+  void createPipeline();
+  void reserveDrawCommands(int frameIndex, VkDeviceSize size);
+
+  HeliosDevice &heliosDevice;
+
+  std::unique_ptr<HeliosPipeline> heliosPipeline;
+  VkPipelineLayout pipelineLayout;
+  std::unique_ptr<HeliosDescriptorSetLayout> setLayout;
+
+  // per frame in flight, sets are reallocated every frame
+  std::vector<std::unique_ptr<HeliosDescriptorPool>> descriptorPools;
+  std::vector<std::unique_ptr<HeliosBuffer>> drawBuffers;
+
+  // indexed like the gameObjects of the last cullGameObjects call
+  std::vector<DrawRange> drawRanges;
+};
+
+} // namespace helios
@@ -0,0 +1,33 @@
+#version 450
+
+// Position stream only, see HeliosPipeline::positionOnlyPipelineConfigInfo.
+// Shares the SimpleRenderSystem pipeline layout; packed positions are expanded
+// by the dequantize matrix folded into the model matrix.
+layout(location = 0) in vec3 position;
+
+struct Instance {
+  mat4 modelMatrix;
+  mat4 normalMatrix;
+};
+
+// GlobalUbo in helios_frame_info.hpp
+layout(set = 0, binding = 0) uniform GlobalUbo {
+  mat4 projection;
+  mat4 view;
+  vec4 ambientLightColor; // w is intensity
+  vec4 directionToLight;
+} ubo;
+
+layout(std430, set = 1, binding = 0) readonly buffer Instances {
+  Instance instances[];
+};
+
+layout(push_constant) uniform Push {
+  uint firstInstance; // added to gl_InstanceIndex
+} push;
+
+void main() {
+  Instance instance = instances[push.firstInstance + gl_InstanceIndex];
+  vec4 positionWorld = instance.modelMatrix * vec4(position, 1.0);
+  gl_Position = ubo.projection * (ubo.view * positionWorld);
+}
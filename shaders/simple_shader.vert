@@ -7,19 +7,48 @@ layout(location = 3) in vec2 uv;
 
 layout(location = 0) out vec3 fragColor;
 
-layout(push_constant) uniform Push {
-  mat4 transform; // projection * view * model
+// HeliosModel::PackedVertex input: positions arrive as snorm and are expanded
+// by the dequantize matrix folded into the model matrix, normals are
+// octahedral
+layout(constant_id = 0) const bool PACKED_VERTICES = false;
+
+struct Instance {
+  mat4 modelMatrix;
   mat4 normalMatrix;
+};
+
+// GlobalUbo in helios_frame_info.hpp
+layout(set = 0, binding = 0) uniform GlobalUbo {
+  mat4 projection;
+  mat4 view;
+  vec4 ambientLightColor; // w is intensity
+  vec4 directionToLight;
+} ubo;
+
+layout(std430, set = 1, binding = 0) readonly buffer Instances {
+  Instance instances[];
+};
+
+layout(push_constant) uniform Push {
+  uint firstInstance; // added to gl_InstanceIndex
 } push;
 
-const vec3 DIRECTION_TO_LIGHT = normalize(vec3(1.0, -3.0, -1.0));
-const float AMBIENT = 0.02;
+vec3 octahedralDecode(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0);
+  n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+  return normalize(n);
+}
 
 void main() {
-  gl_Position = push.transform * vec4(position, 1.0);
+  Instance instance = instances[push.firstInstance + gl_InstanceIndex];
+  vec4 positionWorld = instance.modelMatrix * vec4(position, 1.0);
+  gl_Position = ubo.projection * (ubo.view * positionWorld);
 
-  vec3 normalWorldSpace = normalize(mat3(push.normalMatrix) * normal);
+  vec3 modelNormal = PACKED_VERTICES ? octahedralDecode(normal.xy) : normal;
+  vec3 normalWorldSpace = normalize(mat3(instance.normalMatrix) * modelNormal);
 
-  float lightIntensity = AMBIENT + max(dot(normalWorldSpace, DIRECTION_TO_LIGHT), 0);
-  fragColor = lightIntensity * color;
+  vec3 ambient = ubo.ambientLightColor.xyz * ubo.ambientLightColor.w;
+  float diffuse = max(dot(normalWorldSpace, ubo.directionToLight.xyz), 0);
+  fragColor = (ambient + diffuse) * color;
 }
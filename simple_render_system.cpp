@@ -12,41 +12,91 @@
 #include <vulkan/vulkan_core.h>
 
 // std
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
 
 namespace helios {
 
+namespace {
+
+// projection and view come from the global set, instances from set 1
 struct SimplePushConstantData {
-  glm::mat4 transform{1.0f};
+  // index of the draw's first instance in the instance buffer
+  uint32_t firstInstance = 0;
+};
+
+// matches Instance in simple_shader.vert
+struct InstanceData {
+  // dequantize matrix of packed models folded in
+  glm::mat4 modelMatrix{1.0f};
   glm::mat4 normalMatrix{1.0f};
 };
 
+// instances per frame the buffers start with, they grow on demand
+constexpr uint32_t INITIAL_INSTANCE_CAPACITY = 1024;
+
+} // namespace
+
 SimpleRenderSystem::SimpleRenderSystem(HeliosDevice &device,
-                                       VkRenderPass renderPass)
+                                       VkRenderPass renderPass,
+                                       VkDescriptorSetLayout globalSetLayout)
     : heliosDevice{device} {
-  createPipelineLayout();
+  createDescriptorSetLayout();
+  createPipelineLayout(globalSetLayout);
   createPipeline(renderPass);
+
+  descriptorPool = HeliosDescriptorPool::Builder(heliosDevice)
+                       .setMaxSets(2 * HeliosSwapChain::MAX_FRAMES_IN_FLIGHT)
+                       .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                    2 * HeliosSwapChain::MAX_FRAMES_IN_FLIGHT)
+                       .build();
+  instanceBuffers.resize(HeliosSwapChain::MAX_FRAMES_IN_FLIGHT);
+  instanceSets.resize(HeliosSwapChain::MAX_FRAMES_IN_FLIGHT);
+  culledInstanceSets.resize(HeliosSwapChain::MAX_FRAMES_IN_FLIGHT);
+  culledInstanceBuffers.resize(HeliosSwapChain::MAX_FRAMES_IN_FLIGHT,
+                               VK_NULL_HANDLE);
+  auto layout = instanceSetLayout->getDescriptorSetLayout();
+  for (int i = 0; i < HeliosSwapChain::MAX_FRAMES_IN_FLIGHT; i++) {
+    if (!descriptorPool->allocateDescriptor(layout, instanceSets[i]) ||
+        !descriptorPool->allocateDescriptor(layout, culledInstanceSets[i])) {
+      throw std::runtime_error("failed to allocate instance descriptor set");
+    }
+    reserveInstances(i, INITIAL_INSTANCE_CAPACITY);
+  }
 }
 
 SimpleRenderSystem::~SimpleRenderSystem() {
   vkDestroyPipelineLayout(heliosDevice.device(), pipelineLayout, nullptr);
 }
 
-void SimpleRenderSystem::createPipelineLayout() {
+void SimpleRenderSystem::createDescriptorSetLayout() {
+  instanceSetLayout = HeliosDescriptorSetLayout::Builder(heliosDevice)
+                          .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                      VK_SHADER_STAGE_VERTEX_BIT)
+                          .build();
+}
+
+void SimpleRenderSystem::createPipelineLayout(
+    VkDescriptorSetLayout globalSetLayout) {
 
   VkPushConstantRange pushConstantRange{};
-  pushConstantRange.stageFlags =
-      VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
   pushConstantRange.offset = 0;
   pushConstantRange.size = sizeof(SimplePushConstantData);
 
+  std::array<VkDescriptorSetLayout, 2> descriptorSetLayouts{
+      globalSetLayout, instanceSetLayout->getDescriptorSetLayout()};
+
   VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
   pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipelineLayoutInfo.pSetLayouts = 0;
-  pipelineLayoutInfo.pSetLayouts = nullptr;
+  pipelineLayoutInfo.setLayoutCount =
+      static_cast<uint32_t>(descriptorSetLayouts.size());
+  pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
   pipelineLayoutInfo.pushConstantRangeCount = 1;
   pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
@@ -68,31 +118,285 @@ void SimpleRenderSystem::createPipeline(VkRenderPass renderPass) {
   heliosPipeline = std::make_unique<HeliosPipeline>(
       heliosDevice, "shaders/simple_shader.vert.spv",
       "shaders/simple_shader.frag.spv", pipelineConfig);
+
+  PipelineConfigInfo packedConfig{};
+  HeliosPipeline::packedPipelineConfigInfo(packedConfig);
+  packedConfig.renderPass = renderPass;
+  packedConfig.pipelineLayout = pipelineLayout;
+  packedPipeline = std::make_unique<HeliosPipeline>(
+      heliosDevice, "shaders/simple_shader.vert.spv",
+      "shaders/simple_shader.frag.spv", packedConfig);
+}
+
+// Picks the coarsest level whose error, projected at the point of the
+// bounding sphere nearest to the camera, stays below lodErrorThreshold.
+// Assumes a perspective projection.
+uint32_t SimpleRenderSystem::selectLod(const HeliosModel &model,
+                                       TransformComponent &transform,
+                                       const HeliosCamera &camera) const {
+  if (model.getLodCount() <= 1 || lodErrorThreshold <= 0.f) {
+    return 0;
+  }
+
+  auto bounds = transform.worldBounds(model.getBounds());
+  float depth =
+      (camera.getView() * glm::vec4{bounds.center, 1.f}).z - bounds.radius;
+  if (depth <= 0.f) {
+    return 0;
+  }
+
+  const glm::vec3 &scale = transform.scale;
+  float maxScale = std::max(
+      {std::abs(scale.x), std::abs(scale.y), std::abs(scale.z)});
+  // viewport heights covered by one model space unit at that depth
+  float unitSize = maxScale * camera.getProjection()[1][1] * 0.5f / depth;
+  uint32_t level = 0;
+  while (level + 1 < model.getLodCount() &&
+         model.getLod(level + 1).error * unitSize <= lodErrorThreshold) {
+    level++;
+  }
+  return level;
+}
+
+void SimpleRenderSystem::reserveInstances(int frameIndex, uint32_t count) {
+  auto &buffer = instanceBuffers[frameIndex];
+  if (buffer && buffer->getInstanceCount() >= count) {
+    return;
+  }
+
+  // the frame's previous submission has completed, so replacing the buffer
+  // and rewriting its set is safe
+  uint32_t capacity =
+      buffer ? std::max(count, 2 * buffer->getInstanceCount()) : count;
+  buffer = std::make_unique<HeliosBuffer>(
+      heliosDevice, sizeof(InstanceData), capacity,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  buffer->map();
+
+  auto bufferInfo = buffer->descriptorInfo();
+  HeliosDescriptorWriter(*instanceSetLayout, *descriptorPool)
+      .writeBuffer(0, &bufferInfo)
+      .overwrite(instanceSets[frameIndex]);
 }
 
 void SimpleRenderSystem::renderGameObjects(
-    VkCommandBuffer commandBuffer, std::vector<HeliosGameObject> &gameObjects,
-    const HeliosCamera &camera) {
+    FrameInfo &frameInfo, std::vector<HeliosGameObject> &gameObjects,
+    const MeshletCullSystem *meshletCulling) {
+  prepareGameObjects(frameInfo, gameObjects, meshletCulling);
+  recordDraws(frameInfo, frameInfo.commandBuffer, 0, draws.size(),
+              meshletCulling);
+}
+
+void SimpleRenderSystem::prepareGameObjects(
+    FrameInfo &frameInfo, std::vector<HeliosGameObject> &gameObjects,
+    const MeshletCullSystem *meshletCulling) {
+  lodStats = {};
+  drawStats = {};
+  cullStats = {};
+
+  frustumCuller.clear();
+  cullObjects.clear();
+  for (size_t i = 0; i < gameObjects.size(); i++) {
+    auto &obj = gameObjects[i];
+    if (!obj.model || !obj.model->isReady()) {
+      continue;
+    }
+    auto bounds = obj.transform.worldBounds(obj.model->getBounds());
+    frustumCuller.addBox((bounds.min + bounds.max) * 0.5f,
+                         (bounds.max - bounds.min) * 0.5f);
+    cullObjects.push_back(static_cast<uint32_t>(i));
+  }
+  cullStats.visible =
+      frustumCuller.cull(frameInfo.camera.getFrustumPlanes());
+  cullStats.culled = frustumCuller.getBoxCount() - cullStats.visible;
+
+  drawItems.clear();
+  draws.clear();
+  for (uint32_t box = 0; box < frustumCuller.getBoxCount(); box++) {
+    if (!frustumCuller.isVisible(box)) {
+      continue;
+    }
+    uint32_t i = cullObjects[box];
+    auto &obj = gameObjects[i];
+
+    uint32_t lod = selectLod(*obj.model, obj.transform, frameInfo.camera);
+    uint32_t fullTriangles = obj.model->getLod(0).indexCount / 3;
+    uint32_t drawnTriangles = obj.model->getLod(lod).indexCount / 3;
+    lodStats.trianglesDrawn += drawnTriangles;
+    lodStats.trianglesSaved += fullTriangles - drawnTriangles;
 
-  heliosPipeline->bind(commandBuffer);
+    // meshlets only cover level 0
+    bool meshletCulled =
+        lod == 0 && meshletCulling && meshletCulling->hasDrawCommands(i);
+    drawItems.push_back({obj.model.get(), lod, i, meshletCulled});
+  }
+  if (drawItems.empty()) {
+    return;
+  }
 
-  auto projectionView = camera.getProjection() * camera.getView();
+  std::sort(drawItems.begin(), drawItems.end(),
+            [](const DrawItem &a, const DrawItem &b) {
+              auto aFormat = a.model->getVertexFormat();
+              auto bFormat = b.model->getVertexFormat();
+              if (aFormat != bFormat) {
+                return aFormat < bFormat;
+              }
+              if (a.model != b.model) {
+                return std::less<HeliosModel *>{}(a.model, b.model);
+              }
+              if (a.meshletCulled != b.meshletCulled) {
+                return b.meshletCulled;
+              }
+              if (a.lod != b.lod) {
+                return a.lod < b.lod;
+              }
+              return a.objectIndex < b.objectIndex;
+            });
 
-  for (auto &obj : gameObjects) {
+  // instance i belongs to drawItems[i]
+  reserveInstances(frameInfo.frameIndex,
+                   static_cast<uint32_t>(drawItems.size()));
+  auto *instances = static_cast<InstanceData *>(
+      instanceBuffers[frameInfo.frameIndex]->getMappedMemory());
+  for (size_t i = 0; i < drawItems.size(); i++) {
+    auto &obj = gameObjects[drawItems[i].objectIndex];
+    instances[i].modelMatrix =
+        obj.transform.mat4() * obj.model->getDequantizeMatrix();
+    instances[i].normalMatrix = obj.transform.normalMatrix();
+  }
 
-    SimplePushConstantData push{};
+  for (size_t first = 0; first < drawItems.size();) {
+    const DrawItem &item = drawItems[first];
+    size_t count = 1;
+    while (!item.meshletCulled && first + count < drawItems.size() &&
+           drawItems[first + count].model == item.model &&
+           drawItems[first + count].lod == item.lod &&
+           !drawItems[first + count].meshletCulled) {
+      count++;
+    }
+    draws.push_back(
+        {static_cast<uint32_t>(first), static_cast<uint32_t>(count)});
+    first += count;
+  }
+  drawStats.drawCalls = static_cast<uint32_t>(draws.size());
+  drawStats.instances = static_cast<uint32_t>(drawItems.size());
+}
 
-    auto modelMatrix = obj.transform.mat4();
-    push.transform = projectionView * modelMatrix;
-    push.normalMatrix = obj.transform.normalMatrix();
+void SimpleRenderSystem::recordDraws(
+    const FrameInfo &frameInfo, VkCommandBuffer commandBuffer, size_t begin,
+    size_t end, const MeshletCullSystem *meshletCulling) const {
+  if (begin >= end) {
+    return;
+  }
+  // meshletCulling records into the frame info's command buffer
+  FrameInfo drawInfo = frameInfo;
+  drawInfo.commandBuffer = commandBuffer;
 
+  std::array<VkDescriptorSet, 2> descriptorSets{
+      frameInfo.globalDescriptorSet, instanceSets[frameInfo.frameIndex]};
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          pipelineLayout, 0,
+                          static_cast<uint32_t>(descriptorSets.size()),
+                          descriptorSets.data(), 0, nullptr);
+
+  SimplePushConstantData push{};
+  HeliosPipeline *boundPipeline = nullptr;
+  // models in the same geometry arena block share the bound buffers
+  const HeliosModel *boundModel = nullptr;
+  for (size_t d = begin; d < end; d++) {
+    const Draw &draw = draws[d];
+    const DrawItem &item = drawItems[draw.first];
+
+    HeliosPipeline *pipeline =
+        item.model->getVertexFormat() == HeliosModel::VertexFormat::Packed
+            ? packedPipeline.get()
+            : heliosPipeline.get();
+    if (pipeline != boundPipeline) {
+      pipeline->bind(commandBuffer);
+      boundPipeline = pipeline;
+    }
+    if (!boundModel || !item.model->sharesBindingWith(*boundModel)) {
+      item.model->bind(commandBuffer);
+      boundModel = item.model;
+    }
+
+    push.firstInstance = draw.first;
     vkCmdPushConstants(commandBuffer, pipelineLayout,
-                       VK_SHADER_STAGE_VERTEX_BIT |
-                           VK_SHADER_STAGE_FRAGMENT_BIT,
-                       0, sizeof(SimplePushConstantData), &push);
-    obj.model->bind(commandBuffer);
-    obj.model->draw(commandBuffer);
+                       VK_SHADER_STAGE_VERTEX_BIT, 0,
+                       sizeof(SimplePushConstantData), &push);
+    if (item.meshletCulled) {
+      meshletCulling->drawGameObject(drawInfo, item.objectIndex, *item.model);
+    } else {
+      item.model->drawLod(commandBuffer, item.lod, draw.count);
+    }
+  }
+}
+
+void SimpleRenderSystem::renderCulledGameObjects(
+    FrameInfo &frameInfo, const FrustumCullSystem &frustumCulling) {
+  VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+  lodStats = {};
+  drawStats = {};
+  // the GPU decided visibility, the CPU never learns the counts
+  cullStats = {};
+  const auto &batches = frustumCulling.getBatches();
+  if (batches.empty()) {
+    return;
+  }
+
+  // the culling system replaces its buffers when it grows them
+  int frameIndex = frameInfo.frameIndex;
+  auto bufferInfo = frustumCulling.instanceBufferInfo(frameIndex);
+  if (culledInstanceBuffers[frameIndex] != bufferInfo.buffer) {
+    HeliosDescriptorWriter(*instanceSetLayout, *descriptorPool)
+        .writeBuffer(0, &bufferInfo)
+        .overwrite(culledInstanceSets[frameIndex]);
+    culledInstanceBuffers[frameIndex] = bufferInfo.buffer;
+  }
+  std::array<VkDescriptorSet, 2> descriptorSets{
+      frameInfo.globalDescriptorSet, culledInstanceSets[frameIndex]};
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          pipelineLayout, 0,
+                          static_cast<uint32_t>(descriptorSets.size()),
+                          descriptorSets.data(), 0, nullptr);
+
+  // the commands' firstInstance points at their instances when the device
+  // supports it, otherwise it is pushed per command
+  SimplePushConstantData push{};
+  vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT,
+                     0, sizeof(SimplePushConstantData), &push);
+
+  HeliosPipeline *boundPipeline = nullptr;
+  for (size_t i = 0; i < batches.size(); i++) {
+    HeliosModel &model = *batches[i].model;
+    HeliosPipeline *pipeline =
+        model.getVertexFormat() == HeliosModel::VertexFormat::Packed
+            ? packedPipeline.get()
+            : heliosPipeline.get();
+    if (pipeline != boundPipeline) {
+      pipeline->bind(commandBuffer);
+      boundPipeline = pipeline;
+    }
+    model.bind(commandBuffer);
+    if (frustumCulling.commandsCarryFirstInstance()) {
+      frustumCulling.drawBatch(frameInfo, i);
+      drawStats.drawCalls++;
+      continue;
+    }
+    const auto &batch = batches[i];
+    for (uint32_t c = batch.firstCommand;
+         c < batch.firstCommand + batch.commandCount; c++) {
+      push.firstInstance = frustumCulling.getCommandFirstInstance(c);
+      vkCmdPushConstants(commandBuffer, pipelineLayout,
+                         VK_SHADER_STAGE_VERTEX_BIT, 0,
+                         sizeof(SimplePushConstantData), &push);
+      frustumCulling.drawCommand(frameInfo, i, c);
+      drawStats.drawCalls++;
+    }
   }
+  drawStats.instances = frustumCulling.getObjectCount();
 }
 
 } // namespace helios
@@ -1,8 +1,14 @@
 #pragma once
+#include "helios_buffer.hpp"
 #include "helios_camera.hpp"
+#include "helios_descriptors.hpp"
 #include "helios_device.hpp"
+#include "helios_frame_info.hpp"
+#include "helios_frustum_culler.hpp"
 #include "helios_game_object.hpp"
 #include "helios_pipeline.hpp"
+#include "frustum_cull_system.hpp"
+#include "meshlet_cull_system.hpp"
 #include "vulkan/vulkan_core.h"
 
 // std
@@ -13,23 +19,111 @@ namespace helios {
 
 class SimpleRenderSystem {
 public:
-  SimpleRenderSystem(HeliosDevice &device, VkRenderPass renderPass);
+  struct LodStats {
+    uint64_t trianglesDrawn = 0;
+    // compared to drawing every object at level of detail 0
+    uint64_t trianglesSaved = 0;
+  };
+
+  struct DrawStats {
+    uint32_t drawCalls = 0;
+    uint32_t instances = 0;
+  };
+
+  struct CullStats {
+    uint32_t visible = 0;
+    // outside the camera frustum
+    uint32_t culled = 0;
+  };
+
+  // globalSetLayout describes FrameInfo::globalDescriptorSet, bound as set 0
+  SimpleRenderSystem(HeliosDevice &device, VkRenderPass renderPass,
+                     VkDescriptorSetLayout globalSetLayout);
   ~SimpleRenderSystem();
 
   SimpleRenderSystem(const SimpleRenderSystem &) = delete;
   SimpleRenderSystem &operator=(const SimpleRenderSystem &) = delete;
-  void renderGameObjects(VkCommandBuffer commandBuffer,
+  // Objects outside the camera frustum are skipped. Objects sharing a model
+  // and level of detail are drawn with one instanced draw. Objects culled by
+  // meshletCulling this frame are drawn from its indirect commands one by
+  // one, all others whole.
+  void renderGameObjects(FrameInfo &frameInfo,
                          std::vector<HeliosGameObject> &gameObjects,
-                         const HeliosCamera &camera);
+                         const MeshletCullSystem *meshletCulling = nullptr);
+  // renderGameObjects split in two, so the draws can be recorded from
+  // several threads: prepareGameObjects culls, sorts and writes the instance
+  // data, recordDraws records draws [begin, end) of getDrawCount() into
+  // commandBuffer. recordDraws only reads, calls for disjoint ranges may run
+  // concurrently.
+  void prepareGameObjects(FrameInfo &frameInfo,
+                          std::vector<HeliosGameObject> &gameObjects,
+                          const MeshletCullSystem *meshletCulling = nullptr);
+  size_t getDrawCount() const { return draws.size(); }
+  void recordDraws(const FrameInfo &frameInfo, VkCommandBuffer commandBuffer,
+                   size_t begin, size_t end,
+                   const MeshletCullSystem *meshletCulling = nullptr) const;
+  // Draws the batches of frustumCulling's last cullGameObjects call, which
+  // decided on the GPU which objects are visible and at which level of
+  // detail. No meshlet culling, lodStats stay empty.
+  void renderCulledGameObjects(FrameInfo &frameInfo,
+                               const FrustumCullSystem &frustumCulling);
+
+  // Largest error a level of detail may show on screen, as a fraction of the
+  // viewport height. 0 always draws the full mesh.
+  void setLodErrorThreshold(float threshold) { lodErrorThreshold = threshold; }
+  // triangle counts of the last renderGameObjects call
+  const LodStats &getLodStats() const { return lodStats; }
+  const DrawStats &getDrawStats() const { return drawStats; }
+  // of the last renderGameObjects call, empty after renderCulledGameObjects
+  const CullStats &getCullStats() const { return cullStats; }
 
 private:
-  void createPipelineLayout();
+  struct DrawItem {
+    HeliosModel *model;
+    uint32_t lod;
+    uint32_t objectIndex;
+    bool meshletCulled;
+  };
+
+  // one draw call, drawItems [first, first + count)
+  struct Draw {
+    uint32_t first;
+    uint32_t count;
+  };
+
+  void createDescriptorSetLayout();
+  void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
   void createPipeline(VkRenderPass renderPass);
+  uint32_t selectLod(const HeliosModel &model, TransformComponent &transform,
+                     const HeliosCamera &camera) const;
+  void reserveInstances(int frameIndex, uint32_t count);
 
   HeliosDevice &heliosDevice;
 
   std::unique_ptr<HeliosPipeline> heliosPipeline;
+  std::unique_ptr<HeliosPipeline> packedPipeline;
   VkPipelineLayout pipelineLayout;
+  std::unique_ptr<HeliosDescriptorSetLayout> instanceSetLayout;
+  std::unique_ptr<HeliosDescriptorPool> descriptorPool;
+
+  // per frame in flight, the instance data of every drawn object
+  std::vector<std::unique_ptr<HeliosBuffer>> instanceBuffers;
+  std::vector<VkDescriptorSet> instanceSets;
+  // per frame in flight, sets reading FrustumCullSystem's instance buffers
+  // and the buffers they were last written with
+  std::vector<VkDescriptorSet> culledInstanceSets;
+  std::vector<VkBuffer> culledInstanceBuffers;
+  // sorted so equal models and levels are adjacent, kept between frames
+  std::vector<DrawItem> drawItems;
+  std::vector<Draw> draws;
+  // world bounds of the drawable objects, box i is gameObjects[cullObjects[i]]
+  HeliosFrustumCuller frustumCuller;
+  std::vector<uint32_t> cullObjects;
+
+  float lodErrorThreshold = 0.001f;
+  LodStats lodStats{};
+  DrawStats drawStats{};
+  CullStats cullStats{};
 };
 
 } // namespace helios